@@ -0,0 +1,310 @@
+#include "AudioMeter.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+static const double pi = 3.14159265358979323846;
+
+static float toDb(float x)
+{
+	return x > 0.0f ? max(AudioMeter::floorDb, 20.0f * log10f(x)) : AudioMeter::floorDb;
+}
+
+AudioMeter::AudioMeter()
+{
+	window.resize(fftSize);
+	re.resize(fftSize);
+	im.resize(fftSize);
+	twRe.resize(fftSize);
+	twIm.resize(fftSize);
+	bitReverse.resize(fftSize);
+
+	for (int i = 0; i < fftSize; i++) {
+		window[i] = (float)(0.5 - 0.5 * cos(2.0 * pi * i / fftSize));
+	}
+
+	int bits = 0;
+	while ((1 << bits) < fftSize) {
+		bits++;
+	}
+	for (int i = 0; i < fftSize; i++) {
+		int r = 0;
+		for (int b = 0; b < bits; b++) {
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		bitReverse[i] = r;
+	}
+
+	for (int h = 1; h < fftSize; h <<= 1) {
+		for (int j = 0; j < h; j++) {
+			twRe[h - 1 + j] = (float)cos(-pi * j / h);
+			twIm[h - 1 + j] = (float)sin(-pi * j / h);
+		}
+	}
+
+	lastTime = chrono::steady_clock::now();
+}
+
+void AudioMeter::reset(int ch, int rate)
+{
+	stride = max(ch, 0);
+	channels = min(stride, maxChannels);
+	sampleRate = rate > 0 ? rate : 48000;
+
+	ring.assign(ringFrames * channels, 0.0f);
+	markers.assign(markerCount, Marker());
+	head = 0;
+	tail = 0;
+	markerHead = 0;
+	markerTail = 0;
+	flushFrame = 0;
+	flushCount = 0;
+	droppedCount = 0;
+
+	pos = 0;
+	flushSeen = 0;
+	flushBase = 0;
+	anchored = false;
+	lastTime = chrono::steady_clock::now();
+	for (int c = 0; c < maxChannels; c++) {
+		meanSquare[c] = 0.0f;
+		holdTime[c] = 0.0f;
+	}
+	current = Levels();
+	current.channels = channels;
+	for (int c = 0; c < maxChannels; c++) {
+		current.peak[c] = floorDb;
+		current.rms[c] = floorDb;
+		current.peakHold[c] = floorDb;
+	}
+	for (int b = 0; b < bandCount; b++) {
+		current.bands[b] = floorDb;
+	}
+	analyzed = 0;
+	spectrumCount = 0;
+	cpu = chrono::microseconds(0);
+
+	//log spaced from 20 Hz to nyquist, at least one bin each
+	bandBins.resize(bandCount + 1);
+	double fmin = 20.0;
+	double fmax = sampleRate / 2.0;
+	int prev = 0;
+	for (int b = 0; b <= bandCount; b++) {
+		double f = fmin * pow(fmax / fmin, (double)b / bandCount);
+		int bin = (int)lround(f * fftSize / sampleRate);
+		bin = min(max(bin, prev + 1), fftSize / 2);
+		bandBins[b] = bin;
+		prev = bin;
+	}
+
+	lock_guard<mutex> guard(resultLock);
+	published = current;
+	publishedStats = Stats();
+}
+
+bool AudioMeter::push(const float* data, int frames, std::chrono::microseconds pts)
+{
+	if (channels == 0 || frames <= 0) {
+		return false;
+	}
+
+	uint64_t h = head.load(memory_order_relaxed);
+	uint64_t t = tail.load(memory_order_acquire);
+	if (h + frames - t > ringFrames) {
+		//the analysis fell behind, it must not hold up the audio
+		droppedCount.fetch_add(frames, memory_order_relaxed);
+		return false;
+	}
+
+	const uint64_t mask = ringFrames - 1;
+	if (stride == channels) {
+		int first = (int)min<uint64_t>(frames, ringFrames - (h & mask));
+		memcpy(&ring[(h & mask) * channels], data, sizeof(float) * first * channels);
+		if (first < frames) {
+			memcpy(&ring[0], data + first * channels, sizeof(float) * (frames - first) * channels);
+		}
+	}
+	else {
+		for (int i = 0; i < frames; i++) {
+			memcpy(&ring[((h + i) & mask) * channels], data + i * stride, sizeof(float) * channels);
+		}
+	}
+	head.store(h + frames, memory_order_release);
+
+	//a block without a marker is still timed by the one before it
+	uint64_t mh = markerHead.load(memory_order_relaxed);
+	if (mh - markerTail.load(memory_order_acquire) < markerCount) {
+		markers[mh % markerCount].frame = h;
+		markers[mh % markerCount].pts = pts.count();
+		markerHead.store(mh + 1, memory_order_release);
+	}
+	return true;
+}
+
+void AudioMeter::flush(void)
+{
+	flushFrame.store(head.load(memory_order_relaxed), memory_order_relaxed);
+	flushCount.fetch_add(1, memory_order_release);
+}
+
+void AudioMeter::fft(void)
+{
+	//split real and imaginary arrays and contiguous twiddles per stage
+	//keep the butterfly loop free of strides, the compiler vectorizes it
+	for (int h = 1; h < fftSize; h <<= 1) {
+		const float* wr = &twRe[h - 1];
+		const float* wi = &twIm[h - 1];
+		for (int k = 0; k < fftSize; k += 2 * h) {
+			float* ar = &re[k];
+			float* ai = &im[k];
+			float* br = &re[k + h];
+			float* bi = &im[k + h];
+			for (int j = 0; j < h; j++) {
+				float tr = br[j] * wr[j] - bi[j] * wi[j];
+				float ti = br[j] * wi[j] + bi[j] * wr[j];
+				br[j] = ar[j] - tr;
+				bi[j] = ai[j] - ti;
+				ar[j] += tr;
+				ai[j] += ti;
+			}
+		}
+	}
+}
+
+void AudioMeter::spectrum(uint64_t end, float dt)
+{
+	//windowed downmix of the last fftSize frames, stored bit reversed
+	const uint64_t mask = ringFrames - 1;
+	float gain = 1.0f / channels;
+	for (int i = 0; i < fftSize; i++) {
+		const float* s = &ring[((end - fftSize + i) & mask) * channels];
+		float sum = 0.0f;
+		for (int c = 0; c < channels; c++) {
+			sum += s[c];
+		}
+		re[bitReverse[i]] = sum * gain * window[i];
+		im[i] = 0.0f;
+	}
+	fft();
+
+	//a full scale sine peaks at fftSize / 4 through the hann window
+	float scale = 16.0f / ((float)fftSize * fftSize);
+	for (int b = 0; b < bandCount; b++) {
+		int lo = bandBins[b];
+		int hi = max(bandBins[b + 1], lo + 1);
+		float power = 0.0f;
+		for (int k = lo; k < hi && k <= fftSize / 2; k++) {
+			power = max(power, re[k] * re[k] + im[k] * im[k]);
+		}
+		float db = power > 0.0f ? max(floorDb, 10.0f * log10f(power * scale)) : floorDb;
+		//bars fall at 60 dB/s
+		current.bands[b] = max(db, max(floorDb, current.bands[b] - 60.0f * dt));
+	}
+	spectrumCount++;
+}
+
+bool AudioMeter::process(std::chrono::microseconds clock)
+{
+	auto t0 = chrono::steady_clock::now();
+	float dt = min(0.5f, chrono::duration<float>(t0 - lastTime).count());
+	lastTime = t0;
+	if (channels == 0) {
+		return false;
+	}
+
+	uint64_t fc = flushCount.load(memory_order_acquire);
+	if (fc != flushSeen) {
+		flushSeen = fc;
+		flushBase = flushFrame.load(memory_order_relaxed);
+		pos = max(pos, flushBase);
+		anchored = false;
+	}
+	//markerHead first, every marker it covers is below head
+	uint64_t mh = markerHead.load(memory_order_acquire);
+	uint64_t h = head.load(memory_order_acquire);
+
+	//latest block that started playing
+	uint64_t mt = markerTail.load(memory_order_relaxed);
+	while (mt < mh) {
+		const Marker& m = markers[mt % markerCount];
+		if (m.frame >= flushBase && m.pts > clock.count()) {
+			break;
+		}
+		if (m.frame >= flushBase) {
+			anchor = m;
+			anchored = true;
+		}
+		mt++;
+	}
+	markerTail.store(mt, memory_order_release);
+	if (!anchored) {
+		return false;
+	}
+
+	int64_t ahead = (clock.count() - anchor.pts) * sampleRate / 1000000;
+	uint64_t target = min<uint64_t>(h, anchor.frame + (uint64_t)max<int64_t>(ahead, 0));
+	if (target <= pos) {
+		//paused or starved
+		return false;
+	}
+
+	//peak of the new frames, rms with a 300 ms time constant
+	const uint64_t mask = ringFrames - 1;
+	float a = 1.0f - expf(-1.0f / (0.3f * sampleRate));
+	float peak[maxChannels] = { 0 };
+	for (uint64_t f = pos; f < target; f++) {
+		const float* s = &ring[(f & mask) * channels];
+		for (int c = 0; c < channels; c++) {
+			float v = s[c];
+			peak[c] = max(peak[c], fabsf(v));
+			meanSquare[c] += a * (v * v - meanSquare[c]);
+		}
+	}
+	for (int c = 0; c < channels; c++) {
+		float db = toDb(peak[c]);
+		current.peak[c] = max(db, max(floorDb, current.peak[c] - 20.0f * dt));
+		current.rms[c] = toDb(sqrtf(meanSquare[c]));
+		//hold for 1.5 s, then fall
+		if (db >= current.peakHold[c]) {
+			current.peakHold[c] = db;
+			holdTime[c] = 1.5f;
+		}
+		else if ((holdTime[c] -= dt) < 0.0f) {
+			current.peakHold[c] = max(floorDb, current.peakHold[c] - 20.0f * dt);
+		}
+	}
+
+	if (target >= fftSize) {
+		spectrum(target, dt);
+	}
+	analyzed += target - pos;
+	pos = target;
+	//the next spectrum window reaches back fftSize frames
+	tail.store(pos > fftSize ? pos - fftSize : 0, memory_order_release);
+
+	cpu += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0);
+
+	lock_guard<mutex> guard(resultLock);
+	published = current;
+	publishedStats.analyzedFrames = analyzed;
+	publishedStats.spectra = spectrumCount;
+	publishedStats.cpuTime = cpu;
+	publishedStats.load = analyzed ? cpu.count() * (double)sampleRate / (analyzed * 1000000.0) : 0.0;
+	return true;
+}
+
+AudioMeter::Levels AudioMeter::levels(void)
+{
+	lock_guard<mutex> guard(resultLock);
+	return published;
+}
+
+AudioMeter::Stats AudioMeter::stats(void)
+{
+	lock_guard<mutex> guard(resultLock);
+	Stats s = publishedStats;
+	s.droppedFrames = droppedCount.load(memory_order_relaxed);
+	return s;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+//peak/RMS meters and a spectrum of the decoded audio.
+//the decoder side copies interleaved float samples into a lock-free
+//single producer ring and never waits, a block that does not fit is
+//dropped. the analysis side follows the playback clock through the pts
+//of the pushed blocks, so the meters show what is heard rather than
+//what was decoded ahead of it.
+class AudioMeter final
+{
+public:
+	static const int maxChannels = 8;
+	static const int fftSize = 2048;
+	static const int bandCount = 48;
+	//bottom of the scales in dBFS
+	static constexpr float floorDb = -90.0f;
+
+	struct Levels {
+		int channels = 0;
+		float peak[maxChannels] = { 0 };
+		float rms[maxChannels] = { 0 };
+		float peakHold[maxChannels] = { 0 };
+		float bands[bandCount] = { 0 };
+	};
+
+	struct Stats {
+		int64_t analyzedFrames = 0;
+		int64_t droppedFrames = 0;
+		int64_t spectra = 0;
+		std::chrono::microseconds cpuTime = std::chrono::microseconds(0);
+		//analysis time per second of audio
+		double load = 0.0;
+	};
+
+private:
+	struct Marker {
+		uint64_t frame = 0;
+		int64_t pts = 0;
+	};
+
+	static const uint64_t ringFrames = 1 << 18;
+	static const uint64_t markerCount = 1 << 10;
+
+	int channels = 0;
+	int stride = 0;
+	int sampleRate = 48000;
+
+	//interleaved with channels per frame, indexes count frames forever
+	std::vector<float> ring;
+	std::atomic<uint64_t> head{ 0 };
+	std::atomic<uint64_t> tail{ 0 };
+	std::vector<Marker> markers;
+	std::atomic<uint64_t> markerHead{ 0 };
+	//head at the last flush, frames before it are skipped
+	std::atomic<uint64_t> flushFrame{ 0 };
+	std::atomic<uint64_t> flushCount{ 0 };
+	std::atomic<int64_t> droppedCount{ 0 };
+
+	//written by the analysis side, the decoder side reads it
+	std::atomic<uint64_t> markerTail{ 0 };
+
+	//analysis side only
+	uint64_t pos = 0;
+	uint64_t flushSeen = 0;
+	uint64_t flushBase = 0;
+	Marker anchor;
+	bool anchored = false;
+	std::chrono::steady_clock::time_point lastTime;
+	float meanSquare[maxChannels] = { 0 };
+	float holdTime[maxChannels] = { 0 };
+	std::vector<float> window;
+	std::vector<float> re;
+	std::vector<float> im;
+	//twiddles of every stage back to back, stage h at [h - 1, 2h - 1)
+	std::vector<float> twRe;
+	std::vector<float> twIm;
+	std::vector<int> bitReverse;
+	//first bin of every band, bandCount + 1 entries
+	std::vector<int> bandBins;
+	Levels current;
+	int64_t analyzed = 0;
+	int64_t spectrumCount = 0;
+	std::chrono::microseconds cpu = std::chrono::microseconds(0);
+
+	std::mutex resultLock;
+	Levels published;
+	Stats publishedStats;
+
+	void fft(void);
+	void spectrum(uint64_t end, float dt);
+
+public:
+	AudioMeter();
+	AudioMeter(const AudioMeter&) = delete;
+	AudioMeter& operator=(const AudioMeter&) = delete;
+
+	//neither side may run during a reset.
+	//channels past maxChannels are not analyzed
+	void reset(int channels, int sampleRate);
+
+	//decoder side, interleaved floats of the reset channel count.
+	//never blocks, false when the block was dropped
+	bool push(const float* data, int frames, std::chrono::microseconds pts);
+	//decoder side, after a seek
+	void flush(void);
+
+	//analysis side, catches up to the playback clock.
+	//false when there was nothing new
+	bool process(std::chrono::microseconds clock);
+
+	//any thread
+	Levels levels(void);
+	Stats stats(void);
+};
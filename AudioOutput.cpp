@@ -0,0 +1,77 @@
+#include "AudioOutput.h"
+#include "QtAudioSink.h"
+#include "LoopbackAudioSink.h"
+#include "FileAudioSink.h"
+
+using namespace std;
+
+const char* AudioOutput::backendName(Backend b)
+{
+	switch (b) {
+	case Backend::BACKEND_QT:
+		return "qt";
+	case Backend::BACKEND_NULL:
+		return "null";
+	case Backend::BACKEND_WAV:
+		return "wav";
+	case Backend::BACKEND_RAW:
+		return "raw";
+	}
+	return "?";
+}
+
+bool AudioOutput::parse(const std::string& spec, Backend* b, std::string* path)
+{
+	path->clear();
+	if (spec == "qt") {
+		*b = Backend::BACKEND_QT;
+		return true;
+	}
+	if (spec == "null") {
+		*b = Backend::BACKEND_NULL;
+		return true;
+	}
+
+	auto colon = spec.find(':');
+	if (colon == string::npos || colon + 1 == spec.size()) {
+		return false;
+	}
+	string kind = spec.substr(0, colon);
+	if (kind == "wav") {
+		*b = Backend::BACKEND_WAV;
+	}
+	else if (kind == "raw") {
+		*b = Backend::BACKEND_RAW;
+	}
+	else {
+		return false;
+	}
+	*path = spec.substr(colon + 1);
+	return true;
+}
+
+int AudioOutput::negotiateSampleRate(Backend b, int sourceRate, int channels)
+{
+	if (b == Backend::BACKEND_QT) {
+		return QtAudioSink::supportedSampleRate(sourceRate, channels);
+	}
+	//the timer outputs and files take any rate
+	return sourceRate > 0 ? sourceRate : 48000;
+}
+
+AudioOutput* AudioOutput::create(Backend b, const std::string& path, const QAudioFormat& format)
+{
+	if (b == Backend::BACKEND_QT) {
+		return new QtAudioSink(format);
+	}
+	if (b == Backend::BACKEND_NULL) {
+		return new LoopbackAudioSink(format.sampleRate(), format.channelCount(), chrono::microseconds(0));
+	}
+
+	auto sink = new FileAudioSink(format.sampleRate(), format.channelCount(), b == Backend::BACKEND_WAV);
+	if (sink->open(path) < 0) {
+		delete sink;
+		return nullptr;
+	}
+	return sink;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+class NemoAudioDevice;
+class PlaybackClock;
+class SyncProbe;
+class QAudioFormat;
+
+//where the audio of a ScreenWidget goes.
+//every backend pulls interleaved float samples from a NemoAudioDevice and
+//reports the same figures, ScreenWidget sizes its ring, compensates the
+//output latency and counts underruns through this interface only.
+//qt plays on the sound card, null plays into nothing on a timer at the
+//nominal sample rate and the file backends do the same while writing
+//what they play to a WAV or raw float file.
+class AudioOutput
+{
+public:
+	enum class Backend {
+		BACKEND_QT,
+		BACKEND_NULL,
+		BACKEND_WAV,
+		BACKEND_RAW
+	};
+
+	virtual ~AudioOutput() {}
+
+	virtual Backend backend(void) const = 0;
+	virtual int channelCount(void) const = 0;
+	//only the timer backends know when a sample becomes audible, and only
+	//they follow a virtual clock. both must be set before start
+	virtual void setProbe(SyncProbe* p) {}
+	virtual void setClock(PlaybackClock* c) {}
+	//timer backends play this many ppm fast, like a sound card whose
+	//crystal is off. for drift tests, set before start
+	virtual void setRateSkew(double ppm) {}
+	//used by the next start, 0 keeps the backend default
+	virtual void setBufferTime(std::chrono::microseconds t) = 0;
+
+	virtual void start(NemoAudioDevice* dev) = 0;
+	virtual void stop(void) = 0;
+	virtual void suspend(void) = 0;
+	virtual void resume(void) = 0;
+
+	//bytes, rounded by the backend
+	virtual int64_t bufferSize(void) const = 0;
+	//audio pulled from the device but not played yet
+	virtual std::chrono::microseconds latency(void) const = 0;
+	virtual int64_t underruns(void) const = 0;
+
+	static const char* backendName(Backend b);
+	//"qt", "null", "wav:<path>" or "raw:<path>". false on a syntax error
+	static bool parse(const std::string& spec, Backend* b, std::string* path);
+	//the rate to open the backend with for a source, the source rate when
+	//the backend plays it as it is. samples are always float
+	static int negotiateSampleRate(Backend b, int sourceRate, int channels);
+	//nullptr when the file cannot be written
+	static AudioOutput* create(Backend b, const std::string& path, const QAudioFormat& format);
+};
@@ -0,0 +1,839 @@
+#include "ClipExporter.h"
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <QFile>
+#include <QDebug>
+#include "NemoThreadPool.h"
+#include "ProbeCache.h"
+
+using namespace std;
+
+static const AVRational usTimeBase = { 1, 1000000 };
+
+//NAL units of an Annex B buffer as offset and size, without start codes
+static void splitAnnexB(const uint8_t* data, int size, vector<pair<int, int>>* nals)
+{
+	int begin = -1;
+	int i = 0;
+	while (i + 2 < size) {
+		if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+			if (begin >= 0) {
+				//the zero of a 4 byte start code is not part of the unit
+				int end = i;
+				while (end > begin && data[end - 1] == 0) {
+					end--;
+				}
+				nals->push_back({ begin, end - begin });
+			}
+			i += 3;
+			begin = i;
+			continue;
+		}
+		i++;
+	}
+	if (begin >= 0 && begin < size) {
+		nals->push_back({ begin, size - begin });
+	}
+}
+
+//a NAL unit with a length of nalLength bytes, or a start code for 0
+static bool appendNal(vector<uint8_t>* out, const uint8_t* nal, int size, int nalLength)
+{
+	if (nalLength == 0) {
+		static const uint8_t startCode[] = { 0, 0, 0, 1 };
+		out->insert(out->end(), startCode, startCode + 4);
+	}
+	else if (nalLength < 4 && size >= (1 << (8 * nalLength))) {
+		return false;
+	}
+	else {
+		for (int i = nalLength - 1; i >= 0; i--) {
+			out->push_back((uint8_t)(size >> (8 * i)));
+		}
+	}
+	out->insert(out->end(), nal, nal + size);
+	return true;
+}
+
+//the parameter sets of an avcC, hvcC or Annex B extradata in the packet
+//format of the stream. false when the extradata cannot be read
+static bool parameterSets(const AVCodecParameters* par, int* nalLength, vector<uint8_t>* headers)
+{
+	const uint8_t* d = par->extradata;
+	int size = par->extradata_size;
+	vector<pair<int, int>> nals;
+	*nalLength = 0;
+	if (size > 0 && d[0] == 1 && par->codec_id == AVCodecID::AV_CODEC_ID_H264) {
+		//avcC: sps count in the low 5 bits, then a pps count
+		if (size < 6) {
+			return false;
+		}
+		*nalLength = (d[4] & 3) + 1;
+		int pos = 5;
+		for (int list = 0; list < 2; list++) {
+			if (pos >= size) {
+				return false;
+			}
+			int count = list == 0 ? (d[pos] & 0x1f) : d[pos];
+			pos++;
+			for (int i = 0; i < count; i++) {
+				if (pos + 2 > size) {
+					return false;
+				}
+				int len = (d[pos] << 8) | d[pos + 1];
+				pos += 2;
+				if (pos + len > size) {
+					return false;
+				}
+				nals.push_back({ pos, len });
+				pos += len;
+			}
+		}
+	}
+	else if (size > 0 && d[0] == 1 && par->codec_id == AVCodecID::AV_CODEC_ID_HEVC) {
+		//hvcC: arrays of vps, sps, pps and sei after a 23 byte header
+		if (size < 23) {
+			return false;
+		}
+		*nalLength = (d[21] & 3) + 1;
+		int arrays = d[22];
+		int pos = 23;
+		for (int a = 0; a < arrays; a++) {
+			if (pos + 3 > size) {
+				return false;
+			}
+			int count = (d[pos + 1] << 8) | d[pos + 2];
+			pos += 3;
+			for (int i = 0; i < count; i++) {
+				if (pos + 2 > size) {
+					return false;
+				}
+				int len = (d[pos] << 8) | d[pos + 1];
+				pos += 2;
+				if (pos + len > size) {
+					return false;
+				}
+				nals.push_back({ pos, len });
+				pos += len;
+			}
+		}
+	}
+	else if (size > 0) {
+		splitAnnexB(d, size, &nals);
+	}
+
+	for (auto& n : nals) {
+		if (!appendNal(headers, d + n.first, n.second, *nalLength)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//replaces the payload, keeps timestamps, flags and side data
+static int setPacketData(AVPacket* pkt, const vector<uint8_t>& data)
+{
+	AVPacket* p = av_packet_alloc();
+	if (!p) {
+		return AVERROR(ENOMEM);
+	}
+	int ret = av_new_packet(p, (int)data.size());
+	if (ret >= 0) {
+		ret = av_packet_copy_props(p, pkt);
+	}
+	if (ret >= 0) {
+		memcpy(p->data, data.data(), data.size());
+		av_packet_unref(pkt);
+		av_packet_move_ref(pkt, p);
+	}
+	av_packet_free(&p);
+	return ret;
+}
+
+ClipExporter::ClipExporter(const QString& source, const QString& target, const Options& opt)
+{
+	sourcePath = source;
+	targetPath = target;
+	options = opt;
+	options.packetsPerStep = max(1, options.packetsPerStep);
+}
+
+ClipExporter::~ClipExporter()
+{
+	close();
+}
+
+void ClipExporter::close(void)
+{
+	if (output) {
+		if (output->pb) {
+			avio_closep(&output->pb);
+		}
+		avformat_free_context(output);
+		output = nullptr;
+	}
+	m_closeEncoder();
+	m_releaseHead();
+	avformat_close_input(&input);
+	av_packet_free(&packet);
+	outputs.clear();
+	outputIndex.clear();
+}
+
+int ClipExporter::open(void)
+{
+	startTime = chrono::steady_clock::now();
+	opened = true;
+	std::string source = sourcePath.toStdString();
+	std::string target = targetPath.toStdString();
+
+	if (options.end <= options.start) {
+		qDebug("export: empty range");
+		return AVERROR(EINVAL);
+	}
+	packet = av_packet_alloc();
+	if (!packet) {
+		return AVERROR(ENOMEM);
+	}
+
+	//a second demuxer, playback keeps its own
+	int ret = avformat_open_input(&input, source.c_str(), NULL, NULL);
+	if (ret < 0) {
+		qDebug("export: cannot open %s", source.c_str());
+		return ret;
+	}
+	//the layout playback probed
+	if (ProbeCache::instance()->restore(sourcePath, input) < 0) {
+		ret = avformat_find_stream_info(input, NULL);
+		if (ret < 0) {
+			qDebug("export: cannot find stream info");
+			return ret;
+		}
+	}
+
+	vector<int> streams = options.streams;
+	if (streams.empty()) {
+		for (auto type : { AVMediaType::AVMEDIA_TYPE_VIDEO, AVMediaType::AVMEDIA_TYPE_AUDIO }) {
+			int index = av_find_best_stream(input, type, -1, -1, NULL, 0);
+			if (index >= 0) {
+				streams.push_back(index);
+			}
+		}
+	}
+
+	ret = avformat_alloc_output_context2(&output, NULL, NULL, target.c_str());
+	if (ret < 0) {
+		qDebug("export: no container for %s", target.c_str());
+		return ret;
+	}
+
+	outputIndex.assign(input->nb_streams, -1);
+	for (int index : streams) {
+		if (index < 0 || index >= (int)input->nb_streams || outputIndex[index] >= 0) {
+			continue;
+		}
+		AVStream* in = input->streams[index];
+		if (in->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+			continue;
+		}
+		AVStream* os = avformat_new_stream(output, NULL);
+		if (!os) {
+			return AVERROR(ENOMEM);
+		}
+		ret = avcodec_parameters_copy(os->codecpar, in->codecpar);
+		if (ret < 0) {
+			return ret;
+		}
+		//the tag of the source container may mean something else here
+		os->codecpar->codec_tag = 0;
+		os->time_base = in->time_base;
+		os->disposition = in->disposition;
+		av_dict_copy(&os->metadata, in->metadata, 0);
+
+		outputIndex[index] = (int)outputs.size();
+		Output o;
+		o.source = index;
+		o.stream = os;
+		outputs.push_back(o);
+		if (refIndex < 0 || (in->codecpar->codec_type == AVMediaType::AVMEDIA_TYPE_VIDEO &&
+			input->streams[refIndex]->codecpar->codec_type != AVMediaType::AVMEDIA_TYPE_VIDEO)) {
+			refIndex = index;
+		}
+	}
+	if (outputs.empty()) {
+		qDebug("export: no stream to export");
+		return AVERROR_STREAM_NOT_FOUND;
+	}
+	for (unsigned int i = 0; i < input->nb_streams; i++) {
+		if (outputIndex[i] < 0) {
+			input->streams[i]->discard = AVDiscard::AVDISCARD_ALL;
+		}
+	}
+
+	if (!(output->oformat->flags & AVFMT_NOFILE)) {
+		ret = avio_open(&output->pb, target.c_str(), AVIO_FLAG_WRITE);
+		if (ret < 0) {
+			qDebug("export: cannot write %s", target.c_str());
+			return ret;
+		}
+	}
+	ret = avformat_write_header(output, NULL);
+	if (ret < 0) {
+		qDebug("export: avformat_write_header error: %d", ret);
+		return ret;
+	}
+
+	//lands on a keyframe at or before the start, m_readHead finds the last one
+	auto tb = input->streams[refIndex]->time_base;
+	ret = av_seek_frame(input, refIndex, av_rescale_q(options.start.count(), usTimeBase, tb),
+		AVSEEK_FLAG_BACKWARD);
+	if (ret < 0 && options.start.count() > 0) {
+		qDebug("export: av_seek_frame error: %d", ret);
+		return ret;
+	}
+	return 0;
+}
+
+int ClipExporter::m_write(AVPacket* pkt, AVRational from, int out)
+{
+	AVStream* os = outputs[out].stream;
+	if (pkt->pts != AV_NOPTS_VALUE) {
+		int64_t end = av_rescale_q(pkt->pts + pkt->duration, from, usTimeBase);
+		lock.lock();
+		st.packets++;
+		st.bytes += pkt->size;
+		st.clipEnd = max(st.clipEnd, chrono::microseconds(end));
+		reached = max(reached, chrono::microseconds(av_rescale_q(pkt->pts, from, usTimeBase)));
+		lock.unlock();
+	}
+
+	//the clip starts at 0
+	int64_t shift = av_rescale_q(origin.count(), usTimeBase, from);
+	if (pkt->pts != AV_NOPTS_VALUE) {
+		pkt->pts -= shift;
+	}
+	if (pkt->dts != AV_NOPTS_VALUE) {
+		pkt->dts -= shift;
+	}
+	av_packet_rescale_ts(pkt, from, os->time_base);
+	pkt->stream_index = os->index;
+	pkt->pos = -1;
+	//takes the reference
+	int ret = av_interleaved_write_frame(output, pkt);
+	if (ret < 0) {
+		qDebug("export: av_interleaved_write_frame error: %d", ret);
+	}
+	return ret;
+}
+
+int ClipExporter::m_copy(AVPacket* pkt)
+{
+	Output& o = outputs[outputIndex[pkt->stream_index]];
+	if (o.done) {
+		av_packet_unref(pkt);
+		return 0;
+	}
+
+	//cut in decode order, every copied frame has its references
+	auto tb = input->streams[pkt->stream_index]->time_base;
+	int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+	if (ts != AV_NOPTS_VALUE && av_rescale_q(ts, tb, usTimeBase) >= options.end.count()) {
+		o.done = true;
+		finishedOutputs++;
+		av_packet_unref(pkt);
+		return 0;
+	}
+
+	//frames before the cut, leading frames of an open GOP refer to them
+	bool early = false;
+	if (pkt->pts != AV_NOPTS_VALUE) {
+		early = pkt->stream_index == refIndex ? pkt->pts < refFirst :
+			av_rescale_q(pkt->pts, tb, usTimeBase) < origin.count();
+	}
+	if (early) {
+		av_packet_unref(pkt);
+		return 0;
+	}
+	//the encoded frames replaced the source's parameter sets
+	if (inband && pkt->stream_index == refIndex && pkt->pts == refFirst && sourceHeaders.size()) {
+		vector<uint8_t> data = sourceHeaders;
+		data.insert(data.end(), pkt->data, pkt->data + pkt->size);
+		int ret = setPacketData(pkt, data);
+		if (ret < 0) {
+			av_packet_unref(pkt);
+			return ret;
+		}
+	}
+	return m_write(pkt, tb, outputIndex[pkt->stream_index]);
+}
+
+void ClipExporter::m_releaseHead(void)
+{
+	for (auto& p : head) {
+		av_packet_free(&p);
+	}
+	head.clear();
+	headCursor = 0;
+}
+
+int ClipExporter::m_readHead(void)
+{
+	AVStream* ref = input->streams[refIndex];
+	int64_t start = av_rescale_q(options.start.count(), usTimeBase, ref->time_base);
+	for (int n = 0; n < options.packetsPerStep; n++) {
+		int ret = av_read_frame(input, packet);
+		if (ret == AVERROR_EOF) {
+			return 0;
+		}
+		if (ret < 0) {
+			return ret;
+		}
+		if (outputIndex[packet->stream_index] < 0) {
+			av_packet_unref(packet);
+			continue;
+		}
+
+		bool last = false;
+		if (packet->stream_index == refIndex) {
+			if (nextKey != AV_NOPTS_VALUE) {
+				//the leading pictures of an open GOP show before the next
+				//keyframe and decode after it, the head ends behind them
+				last = packet->pts == AV_NOPTS_VALUE || packet->pts > nextKey;
+			}
+			else if ((packet->flags & AV_PKT_FLAG_KEY) && packet->pts != AV_NOPTS_VALUE) {
+				if (key == AV_NOPTS_VALUE || packet->pts <= start) {
+					//a later keyframe still before the start
+					key = packet->pts;
+					m_releaseHead();
+				}
+				else {
+					nextKey = packet->pts;
+					nextKeyDts = packet->dts;
+				}
+			}
+		}
+		if (key == AV_NOPTS_VALUE) {
+			av_packet_unref(packet);
+			continue;
+		}
+		AVPacket* p = av_packet_clone(packet);
+		av_packet_unref(packet);
+		if (!p) {
+			return AVERROR(ENOMEM);
+		}
+		head.push_back(p);
+		if (last) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int ClipExporter::m_startHead(void)
+{
+	if (key == AV_NOPTS_VALUE) {
+		qDebug("export: no keyframe in the range");
+		return AVERROR_INVALIDDATA;
+	}
+
+	AVStream* ref = input->streams[refIndex];
+	refFirst = key;
+	lock.lock();
+	origin = chrono::microseconds(av_rescale_q(key, ref->time_base, usTimeBase));
+	st.clipStart = origin;
+	reached = origin;
+	lock.unlock();
+
+	phase = Phase::PHASE_COPY;
+	int64_t start = av_rescale_q(options.start.count(), usTimeBase, ref->time_base);
+	if (options.boundary == Boundary::BOUNDARY_REENCODE && key < start) {
+		encodeStart = start;
+		if (m_openEncoder() == 0) {
+			phase = Phase::PHASE_ENCODE;
+		}
+		else {
+			m_closeEncoder();
+			inband = false;
+		}
+	}
+	headCursor = 0;
+	return 0;
+}
+
+int ClipExporter::m_openEncoder(void)
+{
+	AVStream* in = input->streams[refIndex];
+	if (in->codecpar->codec_type != AVMediaType::AVMEDIA_TYPE_VIDEO) {
+		return 1;
+	}
+	const AVCodec* dc = avcodec_find_decoder(in->codecpar->codec_id);
+	const AVCodec* ec = avcodec_find_encoder(in->codecpar->codec_id);
+	if (!dc || !ec) {
+		qDebug("export: no encoder for %s, the clip starts on the keyframe",
+			avcodec_get_name(in->codecpar->codec_id));
+		return 1;
+	}
+
+	//decoders switch to parameter sets that come in-band
+	inband = in->codecpar->codec_id == AVCodecID::AV_CODEC_ID_H264 ||
+		in->codecpar->codec_id == AVCodecID::AV_CODEC_ID_HEVC;
+	sourceHeaders.clear();
+	if (inband && !parameterSets(in->codecpar, &nalLength, &sourceHeaders)) {
+		qDebug("export: cannot read the %s headers, the clip starts on the keyframe",
+			avcodec_get_name(in->codecpar->codec_id));
+		return 1;
+	}
+
+	decoder = avcodec_alloc_context3(dc);
+	encoder = avcodec_alloc_context3(ec);
+	frame = av_frame_alloc();
+	encoded = av_packet_alloc();
+	int ret = decoder && encoder && frame && encoded ? 0 : AVERROR(ENOMEM);
+	if (ret >= 0) {
+		ret = avcodec_parameters_to_context(decoder, in->codecpar);
+	}
+	if (ret >= 0) {
+		decoder->pkt_timebase = in->time_base;
+		ret = avcodec_open2(decoder, dc, NULL);
+	}
+	if (ret >= 0) {
+		//what the source encoder was given, so its headers come out the same
+		encoder->width = in->codecpar->width;
+		encoder->height = in->codecpar->height;
+		encoder->pix_fmt = (AVPixelFormat)in->codecpar->format;
+		encoder->sample_aspect_ratio = in->codecpar->sample_aspect_ratio;
+		encoder->color_range = in->codecpar->color_range;
+		encoder->color_primaries = in->codecpar->color_primaries;
+		encoder->color_trc = in->codecpar->color_trc;
+		encoder->colorspace = in->codecpar->color_space;
+		encoder->bit_rate = in->codecpar->bit_rate;
+		encoder->framerate = in->avg_frame_rate;
+		encoder->time_base = in->avg_frame_rate.num > 0 ? av_inv_q(in->avg_frame_rate) : in->time_base;
+		//one GOP without reordering, it ends where the copy begins
+		encoder->gop_size = INT_MAX;
+		encoder->max_b_frames = 0;
+		if (!inband && (output->oformat->flags & AVFMT_GLOBALHEADER)) {
+			encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+		}
+		ret = avcodec_open2(encoder, ec, NULL);
+	}
+	if (ret < 0) {
+		qDebug("export: cannot set up %s, the clip starts on the keyframe", ec->name);
+		return 1;
+	}
+	//the copied rest decodes with the source headers only
+	if (!inband && (encoder->extradata_size != in->codecpar->extradata_size ||
+		(encoder->extradata_size && memcmp(encoder->extradata, in->codecpar->extradata, encoder->extradata_size)))) {
+		qDebug("export: %s headers differ from the source, the clip starts on the keyframe", ec->name);
+		return 1;
+	}
+
+	refFirst = nextKey != AV_NOPTS_VALUE ? nextKey : INT64_MAX;
+	encodeEnd = av_rescale_q(options.end.count(), usTimeBase, in->time_base);
+	encodeDelay = nextKey != AV_NOPTS_VALUE && nextKeyDts != AV_NOPTS_VALUE ?
+		max<int64_t>(0, nextKey - nextKeyDts) : 0;
+	lastPts = AV_NOPTS_VALUE;
+	encodedFrames = 0;
+	if (encodeEnd <= refFirst) {
+		//the range ends in the first GOP, nothing of the stream is copied
+		outputs[outputIndex[refIndex]].done = true;
+		finishedOutputs++;
+	}
+	lock.lock();
+	origin = chrono::microseconds(av_rescale_q(encodeStart, in->time_base, usTimeBase));
+	st.boundary = Boundary::BOUNDARY_REENCODE;
+	st.clipStart = origin;
+	reached = origin;
+	lock.unlock();
+	return 0;
+}
+
+void ClipExporter::m_closeEncoder(void)
+{
+	av_packet_free(&encoded);
+	av_frame_free(&frame);
+	avcodec_free_context(&encoder);
+	avcodec_free_context(&decoder);
+}
+
+int ClipExporter::m_drainEncoder(void)
+{
+	AVStream* in = input->streams[refIndex];
+	int ret = 0;
+	while (ret >= 0 && avcodec_receive_packet(encoder, encoded) == 0) {
+		av_packet_rescale_ts(encoded, encoder->time_base, in->time_base);
+		encoded->dts = encoded->pts - encodeDelay;
+		if (inband && nalLength > 0) {
+			//the encoder writes start codes
+			vector<pair<int, int>> nals;
+			vector<uint8_t> data;
+			splitAnnexB(encoded->data, encoded->size, &nals);
+			for (auto& n : nals) {
+				if (!appendNal(&data, encoded->data + n.first, n.second, nalLength)) {
+					ret = AVERROR(EINVAL);
+				}
+			}
+			if (ret >= 0) {
+				ret = setPacketData(encoded, data);
+			}
+			if (ret < 0) {
+				av_packet_unref(encoded);
+				break;
+			}
+		}
+		ret = m_write(encoded, in->time_base, outputIndex[refIndex]);
+	}
+	return ret;
+}
+
+int ClipExporter::m_encode(AVFrame* f)
+{
+	//the frames from the start to the copied keyframe, leading pictures
+	//too, or to the end of a range inside the first GOP
+	int64_t ts = f->best_effort_timestamp;
+	if (ts == AV_NOPTS_VALUE || ts < encodeStart || ts >= refFirst || ts >= encodeEnd) {
+		return 0;
+	}
+	if (f->format != encoder->pix_fmt || f->width != encoder->width || f->height != encoder->height) {
+		qDebug("export: the frame format changed in the first GOP");
+		return AVERROR(EINVAL);
+	}
+	int64_t pts = av_rescale_q(ts, input->streams[refIndex]->time_base, encoder->time_base);
+	if (lastPts != AV_NOPTS_VALUE && pts <= lastPts) {
+		pts = lastPts + 1;
+	}
+	lastPts = pts;
+	f->pts = pts;
+	f->pict_type = encodedFrames == 0 ? AVPictureType::AV_PICTURE_TYPE_I : AVPictureType::AV_PICTURE_TYPE_NONE;
+	encodedFrames++;
+	int ret = avcodec_send_frame(encoder, f);
+	return ret < 0 ? ret : m_drainEncoder();
+}
+
+int ClipExporter::m_encodeHead(void)
+{
+	int ret = 0;
+	int n = 0;
+	//every head packet of the stream is decoded, the keyframe after the
+	//start too: its leading pictures refer to it
+	while (ret >= 0 && n < options.framesPerStep && headCursor < head.size()) {
+		AVPacket* p = head[headCursor++];
+		if (p->stream_index != refIndex) {
+			continue;
+		}
+		n++;
+		ret = avcodec_send_packet(decoder, p);
+		while (ret >= 0) {
+			ret = avcodec_receive_frame(decoder, frame);
+			if (ret < 0) {
+				ret = ret == AVERROR(EAGAIN) ? 0 : ret;
+				break;
+			}
+			ret = m_encode(frame);
+			av_frame_unref(frame);
+		}
+	}
+	if (ret >= 0 && headCursor < head.size()) {
+		lock.lock();
+		st.reencodedFrames = encodedFrames;
+		lock.unlock();
+		return 1;
+	}
+
+	if (ret >= 0) {
+		avcodec_send_packet(decoder, NULL);
+		while (ret >= 0 && avcodec_receive_frame(decoder, frame) == 0) {
+			ret = m_encode(frame);
+			av_frame_unref(frame);
+		}
+	}
+	if (ret >= 0) {
+		ret = avcodec_send_frame(encoder, NULL);
+		if (ret >= 0) {
+			ret = m_drainEncoder();
+		}
+	}
+	lock.lock();
+	st.reencodedFrames = encodedFrames;
+	lock.unlock();
+	qDebug("export: %lld frames of the first GOP encoded again", (long long)encodedFrames);
+	return ret < 0 ? ret : 0;
+}
+
+int ClipExporter::m_nextPacket(AVPacket* pkt)
+{
+	if (headCursor < head.size()) {
+		av_packet_move_ref(pkt, head[headCursor]);
+		av_packet_free(&head[headCursor]);
+		headCursor++;
+		return 0;
+	}
+	if (!head.empty()) {
+		m_releaseHead();
+	}
+	return av_read_frame(input, pkt);
+}
+
+int ClipExporter::step(void)
+{
+	if (canceled) {
+		return AVERROR_EXIT;
+	}
+	if (phase == Phase::PHASE_HEAD) {
+		int ret = m_readHead();
+		if (ret == 0) {
+			ret = m_startHead();
+		}
+		return ret < 0 ? ret : 1;
+	}
+	if (phase == Phase::PHASE_ENCODE) {
+		int ret = m_encodeHead();
+		if (ret == 0) {
+			m_closeEncoder();
+			//the copy goes through the head again
+			headCursor = 0;
+			phase = Phase::PHASE_COPY;
+		}
+		return ret < 0 ? ret : 1;
+	}
+
+	bool end = false;
+	for (int n = 0; n < options.packetsPerStep && !end; n++) {
+		int ret = m_nextPacket(packet);
+		if (ret == AVERROR_EOF) {
+			end = true;
+			break;
+		}
+		if (ret < 0) {
+			return ret;
+		}
+		if (outputIndex[packet->stream_index] < 0) {
+			av_packet_unref(packet);
+			continue;
+		}
+		ret = m_copy(packet);
+		if (ret < 0) {
+			return ret;
+		}
+		end = finishedOutputs == (int)outputs.size();
+	}
+	if (!end) {
+		return 1;
+	}
+	return av_write_trailer(output);
+}
+
+void ClipExporter::m_finish(int ret)
+{
+	close();
+	if (ret < 0) {
+		//never leave half a clip behind
+		QFile::remove(targetPath);
+	}
+
+	lock.lock();
+	st.elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime);
+	if (st.elapsed.count() > 0) {
+		st.speed = (double)(st.clipEnd - st.clipStart).count() / st.elapsed.count();
+	}
+	result = ret;
+	Stats s = st;
+	lock.unlock();
+
+	if (ret < 0) {
+		qDebug("export %s failed: %d", targetPath.toStdString().c_str(), ret);
+	}
+	else {
+		qDebug("export %s: %lld - %lld ms, %lld packets, %.1fx real time", targetPath.toStdString().c_str(),
+			(long long)s.clipStart.count() / 1000, (long long)s.clipEnd.count() / 1000,
+			(long long)s.packets, s.speed);
+	}
+}
+
+int ClipExporter::run(void)
+{
+	lock.lock();
+	finished = false;
+	lock.unlock();
+
+	int ret = open();
+	while (ret >= 0 && (ret = step()) > 0) {
+	}
+	m_finish(ret);
+
+	lock.lock();
+	finished = true;
+	lock.unlock();
+	finishCV.notify_all();
+	return ret;
+}
+
+void ClipExporter::stepTask(std::shared_ptr<ClipExporter> exporter,
+	std::function<void(int, const Stats&)> done)
+{
+	int ret = 0;
+	if (!exporter->opened) {
+		ret = exporter->open();
+		ret = ret < 0 ? ret : 1;
+	}
+	else {
+		ret = exporter->step();
+	}
+	if (ret > 0) {
+		//behind the playback tasks that came in meanwhile
+		NemoThreadPool::instance()->post(NemoThreadPool::Priority::PRIORITY_BACKGROUND,
+			[exporter, done]() { stepTask(exporter, done); });
+		return;
+	}
+
+	exporter->m_finish(ret);
+	if (done) {
+		done(ret, exporter->stats());
+	}
+	exporter->lock.lock();
+	exporter->finished = true;
+	exporter->lock.unlock();
+	exporter->finishCV.notify_all();
+}
+
+std::shared_ptr<ClipExporter> ClipExporter::start(const QString& source, const QString& target,
+	const Options& opt, std::function<void(int, const Stats&)> done)
+{
+	auto exporter = make_shared<ClipExporter>(source, target, opt);
+	exporter->finished = false;
+	NemoThreadPool::instance()->post(NemoThreadPool::Priority::PRIORITY_BACKGROUND,
+		[exporter, done]() { stepTask(exporter, done); });
+	return exporter;
+}
+
+void ClipExporter::wait(void)
+{
+	unique_lock<mutex> guard(lock);
+	finishCV.wait(guard, [this]() { return finished; });
+}
+
+bool ClipExporter::isFinished(void) const
+{
+	lock_guard<mutex> guard(lock);
+	return finished;
+}
+
+double ClipExporter::progress(void) const
+{
+	lock_guard<mutex> guard(lock);
+	if (finished && result >= 0 && st.packets > 0) {
+		return 1.0;
+	}
+	auto range = options.end - origin;
+	if (range.count() <= 0) {
+		return 0.0;
+	}
+	return max(0.0, min(1.0, (double)(reached - origin).count() / range.count()));
+}
+
+ClipExporter::Stats ClipExporter::stats(void) const
+{
+	lock_guard<mutex> guard(lock);
+	return st;
+}
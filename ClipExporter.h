@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+#include <QString>
+#include "FFmpegHeader.h"
+
+//cuts a time range out of a media file into a new container without
+//transcoding. the source is opened a second time, with the stream layout
+//from ProbeCache when playback already probed it, so the playing demuxer
+//is never touched. packets are copied from the keyframe at or before the
+//start; with BOUNDARY_REENCODE the first GOP is decoded and encoded again
+//from the exact start instead. in the background the work runs on the
+//shared pool at background priority, a bounded number of packets or
+//encoded frames per task.
+class ClipExporter final
+{
+public:
+	enum class Boundary {
+		//the clip starts on the keyframe at or before the start
+		BOUNDARY_KEYFRAME,
+		//the frames from the start to the next keyframe are encoded again,
+		//with the leading pictures of an open GOP after it, which refer to
+		//frames before it. H.264 and HEVC get the encoder's parameter sets
+		//in-band and the source's again on the first copied keyframe. other
+		//codecs fall back to the keyframe when the encoder's headers differ
+		//from the source, the copied rest would not decode with them
+		BOUNDARY_REENCODE
+	};
+
+	struct Options {
+		//media time, the same as seek positions
+		std::chrono::microseconds start = std::chrono::microseconds(0);
+		std::chrono::microseconds end = std::chrono::microseconds(0);
+		//stream indexes to export, empty for the best video and audio
+		std::vector<int> streams;
+		Boundary boundary = Boundary::BOUNDARY_KEYFRAME;
+		//read or copied per pool task
+		int packetsPerStep = 256;
+		//decoded and encoded again per pool task
+		int framesPerStep = 8;
+	};
+
+	struct Stats {
+		int64_t packets = 0;
+		int64_t bytes = 0;
+		int64_t reencodedFrames = 0;
+		//media time of the first and the last exported frame
+		std::chrono::microseconds clipStart = std::chrono::microseconds(0);
+		std::chrono::microseconds clipEnd = std::chrono::microseconds(0);
+		Boundary boundary = Boundary::BOUNDARY_KEYFRAME;
+		std::chrono::microseconds elapsed = std::chrono::microseconds(0);
+		//clip seconds per second of work
+		double speed = 0.0;
+	};
+
+private:
+	struct Output {
+		int source = -1;
+		AVStream* stream = nullptr;
+		bool done = false;
+	};
+
+	enum class Phase {
+		//reading from the keyframe at or before the start past the next one
+		PHASE_HEAD,
+		//encoding the read packets again from the start
+		PHASE_ENCODE,
+		//copying the read packets, then the rest of the range
+		PHASE_COPY
+	};
+
+	QString sourcePath;
+	QString targetPath;
+	Options options;
+
+	AVFormatContext* input = nullptr;
+	AVFormatContext* output = nullptr;
+	AVPacket* packet = nullptr;
+	//source stream index to output, -1 for streams left out
+	std::vector<int> outputIndex;
+	std::vector<Output> outputs;
+	//the stream whose keyframes snap the cut
+	int refIndex = -1;
+	//its first copied pts, the frames before it are cut or encoded again
+	int64_t refFirst = 0;
+	//media time that becomes 0 in the clip
+	std::chrono::microseconds origin = std::chrono::microseconds(0);
+	bool opened = false;
+	Phase phase = Phase::PHASE_HEAD;
+	int finishedOutputs = 0;
+
+	//the first GOP and the leading pictures of the next keyframe, in
+	//decode order. the cursor is the next packet to encode or copy
+	std::vector<AVPacket*> head;
+	size_t headCursor = 0;
+	//pts of the keyframe at or before the start and of the next one
+	int64_t key = AV_NOPTS_VALUE;
+	int64_t nextKey = AV_NOPTS_VALUE;
+	int64_t nextKeyDts = AV_NOPTS_VALUE;
+
+	//the head encoded again
+	AVCodecContext* decoder = nullptr;
+	AVCodecContext* encoder = nullptr;
+	AVFrame* frame = nullptr;
+	AVPacket* encoded = nullptr;
+	int64_t encodeStart = 0;
+	int64_t encodeEnd = 0;
+	//encoded frames decode before the copied keyframe
+	int64_t encodeDelay = 0;
+	int64_t lastPts = AV_NOPTS_VALUE;
+	int64_t encodedFrames = 0;
+	//parameter sets go in-band, in the source's packet format: NAL units
+	//with a length of this many bytes, 0 for start codes
+	bool inband = false;
+	int nalLength = 0;
+	//the source's parameter sets, put before the first copied keyframe
+	std::vector<uint8_t> sourceHeaders;
+	std::chrono::steady_clock::time_point startTime;
+
+	mutable std::mutex lock;
+	std::condition_variable finishCV;
+	bool finished = true;
+	int result = 0;
+	Stats st;
+	std::chrono::microseconds reached = std::chrono::microseconds(0);
+	std::atomic<bool> canceled{ false };
+
+	//reads a bounded number of packets of the head, 0 when it is complete
+	int m_readHead(void);
+	//where the clip starts once the head is read, picks the next phase
+	int m_startHead(void);
+	//0 when the head is encoded again, 1 when it has to be copied after all
+	int m_openEncoder(void);
+	//a bounded number of head packets through the decoder, 0 when done
+	int m_encodeHead(void);
+	int m_encode(AVFrame* f);
+	int m_drainEncoder(void);
+	void m_closeEncoder(void);
+	void m_releaseHead(void);
+	//the next head packet, then the next one of the source
+	int m_nextPacket(AVPacket* pkt);
+	//cuts a source packet to the range, takes its reference
+	int m_copy(AVPacket* pkt);
+	int m_write(AVPacket* pkt, AVRational from, int out);
+	void m_finish(int ret);
+	void close(void);
+	static void stepTask(std::shared_ptr<ClipExporter> exporter,
+		std::function<void(int, const Stats&)> done);
+
+public:
+	ClipExporter(const QString& source, const QString& target, const Options& opt);
+	~ClipExporter();
+	ClipExporter(const ClipExporter&) = delete;
+	ClipExporter& operator=(const ClipExporter&) = delete;
+
+	//0 on success
+	int open(void);
+	//one bounded piece of work. 1 while more remains, 0 when the clip is
+	//written, negative on an error
+	int step(void);
+	//open and every step on the calling thread
+	int run(void);
+
+	//open and steps on the pool, done runs on a pool thread at the end
+	//with the result of run
+	static std::shared_ptr<ClipExporter> start(const QString& source, const QString& target,
+		const Options& opt, std::function<void(int, const Stats&)> done);
+	//the target is removed, a running export ends with AVERROR_EXIT
+	void cancel(void) { canceled = true; }
+	//until a started export has ended
+	void wait(void);
+	bool isFinished(void) const;
+
+	const QString& target(void) const { return targetPath; }
+	//share of the range written, 0 to 1
+	double progress(void) const;
+	Stats stats(void) const;
+};
@@ -0,0 +1,101 @@
+#include "FileAudioSink.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+//RIFF, fmt with the extension size, fact and the data chunk header
+static const int wavHeaderSize = 58;
+//WAVE_FORMAT_IEEE_FLOAT
+static const int wavFormatFloat = 3;
+
+static void putLE(char* p, uint32_t v, int bytes)
+{
+	for (int i = 0; i < bytes; i++) {
+		p[i] = (char)(v >> (8 * i));
+	}
+}
+
+FileAudioSink::FileAudioSink(int rate, int channelCount, bool asWav)
+	: LoopbackAudioSink(rate, channelCount, chrono::microseconds(0))
+{
+	wav = asWav;
+}
+
+FileAudioSink::~FileAudioSink()
+{
+	//the play thread writes to the file
+	stop();
+	out.close();
+}
+
+int FileAudioSink::open(const std::string& path)
+{
+	out.open(path, ios::out | ios::binary | ios::trunc);
+	if (!out) {
+		return -1;
+	}
+	dataBytes = 0;
+	writeHeader();
+	return out ? 0 : -1;
+}
+
+void FileAudioSink::stop(void)
+{
+	LoopbackAudioSink::stop();
+	writeHeader();
+}
+
+void FileAudioSink::writeHeader(void)
+{
+	if (!wav || !out.is_open()) {
+		return;
+	}
+
+	//sizes are 32 bit, a longer file keeps the maximum
+	uint32_t data = (uint32_t)min<int64_t>(dataBytes, UINT32_MAX - wavHeaderSize);
+	uint32_t frameBytes = channels * (uint32_t)sizeof(float);
+	char h[wavHeaderSize];
+	memcpy(h, "RIFF", 4);
+	putLE(h + 4, wavHeaderSize - 8 + data, 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	putLE(h + 16, 18, 4);
+	putLE(h + 20, wavFormatFloat, 2);
+	putLE(h + 22, channels, 2);
+	putLE(h + 24, sampleRate, 4);
+	putLE(h + 28, sampleRate * frameBytes, 4);
+	putLE(h + 32, frameBytes, 2);
+	putLE(h + 34, 32, 2);
+	putLE(h + 36, 0, 2);
+	//float formats need the frame count
+	memcpy(h + 38, "fact", 4);
+	putLE(h + 42, 4, 4);
+	putLE(h + 46, data / frameBytes, 4);
+	memcpy(h + 50, "data", 4);
+	putLE(h + 54, data, 4);
+
+	auto pos = out.tellp();
+	out.seekp(0);
+	out.write(h, sizeof(h));
+	if (dataBytes > 0) {
+		out.seekp(pos);
+	}
+	out.flush();
+}
+
+void FileAudioSink::write(const char* data, int64_t size)
+{
+	if (data) {
+		out.write(data, size);
+	}
+	else {
+		if (zeros.empty()) {
+			zeros.resize(65536);
+		}
+		for (int64_t left = size; left > 0; left -= (int64_t)zeros.size()) {
+			out.write(zeros.data(), min<int64_t>(left, zeros.size()));
+		}
+	}
+	dataBytes += size;
+}
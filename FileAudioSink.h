@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include "LoopbackAudioSink.h"
+
+//the null output that also writes what it plays to a file, as 32 bit
+//float WAV or headerless interleaved float. paced the same way, so the
+//file has the audio of a real run including the silence of underruns,
+//and on a virtual clock it is written as fast as the pipeline decodes.
+class FileAudioSink final : public LoopbackAudioSink
+{
+private:
+	std::ofstream out;
+	bool wav = true;
+	int64_t dataBytes = 0;
+	std::vector<char> zeros;
+
+	void writeHeader(void);
+
+protected:
+	void write(const char* data, int64_t size) override;
+
+public:
+	FileAudioSink(int sampleRate, int channels, bool wav);
+	~FileAudioSink();
+
+	//truncates the file, 0 on success
+	int open(const std::string& path);
+
+	Backend backend(void) const override { return wav ? Backend::BACKEND_WAV : Backend::BACKEND_RAW; }
+	//the header is complete after every stop
+	void stop(void) override;
+};
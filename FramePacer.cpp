@@ -0,0 +1,140 @@
+#include "FramePacer.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+FramePacer::FramePacer()
+{
+	origin = chrono::steady_clock::now();
+}
+
+double FramePacer::toUs(TimePoint t) const
+{
+	return (double)chrono::duration_cast<chrono::microseconds>(t - origin).count();
+}
+
+FramePacer::TimePoint FramePacer::fromUs(double us) const
+{
+	return origin + chrono::microseconds((int64_t)us);
+}
+
+void FramePacer::reset(double refreshHz)
+{
+	lock_guard<mutex> guard(lock);
+	refresh = refreshHz > 0.0 ? 1000000.0 / refreshHz : 0.0;
+	phase = 0.0;
+	samples = 0;
+	hasSwap = false;
+	lastTarget = 0.0;
+	hasTarget = false;
+	hasPresent = false;
+	presentCount = 0;
+	intervalSum = 0.0;
+	intervalSum2 = 0.0;
+}
+
+void FramePacer::onSwap(TimePoint t, bool newFrame)
+{
+	lock_guard<mutex> guard(lock);
+	double now = toUs(t);
+
+	if (hasSwap) {
+		double d = now - lastSwap;
+		if (refresh <= 0.0) {
+			//first guess, refined below
+			refresh = d;
+		}
+
+		//swaps only happen when something was drawn, so a delta
+		//spans a whole number of refreshes
+		double k = floor(d / refresh + 0.5);
+		if (k >= 1.0 && k <= 8.0 && fabs(d - k * refresh) < refresh / 4) {
+			refresh += (d / k - refresh) * 0.05;
+			samples++;
+
+			//low-pass the phase, swap signals arrive with some delay
+			double predicted = phase + floor((now - phase) / refresh + 0.5) * refresh;
+			phase = predicted + (now - predicted) * 0.1;
+		}
+		else if (d > refresh * 8) {
+			//idle, keep the estimate and take the new phase
+			phase = now;
+		}
+	}
+	else {
+		phase = now;
+	}
+	hasSwap = true;
+	lastSwap = now;
+
+	if (newFrame) {
+		if (hasPresent) {
+			double d = now - lastPresent;
+			intervalSum += d;
+			intervalSum2 += d * d;
+			presentCount++;
+		}
+		hasPresent = true;
+		lastPresent = now;
+	}
+}
+
+bool FramePacer::valid(void) const
+{
+	lock_guard<mutex> guard(lock);
+	return m_valid();
+}
+
+FramePacer::TimePoint FramePacer::schedule(int64_t pts, TimePoint due)
+{
+	lock_guard<mutex> guard(lock);
+	if (!m_valid()) {
+		return due;
+	}
+
+	if (!hasTarget || pts != lastPts) {
+		//nearest vsync, but never the one of the previous frame
+		double t = toUs(due);
+		double target = phase + floor((t - phase) / refresh + 0.5) * refresh;
+		if (hasTarget && target < lastTarget + refresh / 2) {
+			target = lastTarget + refresh;
+		}
+		lastTarget = target;
+		lastPts = pts;
+		hasTarget = true;
+	}
+
+	//upload and paint between the previous vsync and the target
+	return fromUs(lastTarget - refresh / 2);
+}
+
+double FramePacer::matchSpeed(std::chrono::microseconds frameDuration, double tolerance) const
+{
+	lock_guard<mutex> guard(lock);
+	if (!m_valid() || frameDuration.count() <= 0) {
+		return 1.0;
+	}
+
+	double d = (double)frameDuration.count();
+	double n = floor(d / refresh + 0.5);
+	if (n < 1.0) {
+		return 1.0;
+	}
+	double speed = d / (n * refresh);
+	return fabs(speed - 1.0) <= tolerance ? speed : 1.0;
+}
+
+FramePacer::Stats FramePacer::stats(void) const
+{
+	lock_guard<mutex> guard(lock);
+	Stats ret;
+	ret.refresh = chrono::microseconds((int64_t)refresh);
+	ret.presents = presentCount;
+	if (presentCount) {
+		double mean = intervalSum / presentCount;
+		ret.intervalMean = (int64_t)mean;
+		ret.intervalStdDev = (int64_t)sqrt(max(0.0, intervalSum2 / presentCount - mean * mean));
+	}
+	return ret;
+}
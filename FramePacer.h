@@ -0,0 +1,67 @@
+#pragma once
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+//presentation scheduler locked to the display refresh.
+//the refresh interval and vsync phase are estimated from buffer swap
+//times, every frame is assigned the vsync nearest to its due time so
+//24 fps on 60 Hz becomes a steady 3:2 cadence instead of jitter.
+//when the content rate is a near multiple of the refresh, matchSpeed
+//returns the playback speed that removes the periodic repeat or drop.
+class FramePacer final
+{
+public:
+	struct Stats {
+		std::chrono::microseconds refresh = std::chrono::microseconds(0);
+		//intervals between swaps that showed a new frame
+		int64_t presents = 0;
+		int64_t intervalMean = 0;
+		int64_t intervalStdDev = 0;
+	};
+
+private:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	mutable std::mutex lock;
+	//estimated refresh interval and the time of one vsync, in us
+	double refresh = 0.0;
+	double phase = 0.0;
+	int samples = 0;
+	bool hasSwap = false;
+	double lastSwap = 0.0;
+	//vsync picked for the latest frame, frames never share one
+	double lastTarget = 0.0;
+	bool hasTarget = false;
+	int64_t lastPts = 0;
+	TimePoint origin;
+
+	bool hasPresent = false;
+	double lastPresent = 0.0;
+	int64_t presentCount = 0;
+	double intervalSum = 0.0;
+	double intervalSum2 = 0.0;
+
+	double toUs(TimePoint t) const;
+	TimePoint fromUs(double us) const;
+	bool m_valid(void) const { return samples >= 8 && refresh > 0.0; }
+
+public:
+	FramePacer();
+
+	//start from the rate the display reports, 0 when unknown
+	void reset(double refreshHz);
+	//GUI thread, after every buffer swap; newFrame when it showed a new frame
+	void onSwap(TimePoint t, bool newFrame);
+
+	bool valid(void) const;
+	//when to hand the frame with this pts, due at wall time due, to the
+	//GUI thread. fixed after the first call for a frame, returns due
+	//unchanged until the refresh is known
+	TimePoint schedule(int64_t pts, TimePoint due);
+	//speed that makes each frame last a whole number of refreshes,
+	//1.0 unless it is within tolerance
+	double matchSpeed(std::chrono::microseconds frameDuration, double tolerance) const;
+
+	Stats stats(void) const;
+};
@@ -0,0 +1,373 @@
+#include "FrameServer.h"
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace std;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+	"ring atomics are shared between processes");
+
+static size_t alignUp(size_t n, size_t a)
+{
+	return (n + a - 1) / a * a;
+}
+
+static size_t slotHeaderSize(void)
+{
+	return alignUp(sizeof(FrameSlotHeader), FrameServer::slotAlign);
+}
+
+static FrameSlotHeader* slotAt(const FrameRingHeader* ring, uint64_t sequence)
+{
+	auto base = (uint8_t*)ring + ring->headerSize;
+	return (FrameSlotHeader*)(base + (sequence - 1) % ring->slotCount * ring->slotSize);
+}
+
+std::string FrameServer::objectName(const std::string& name)
+{
+#ifdef _WIN32
+	return "Local\\" + name;
+#else
+	return "/" + name;
+#endif
+}
+
+FrameServer::~FrameServer()
+{
+	stop();
+}
+
+void FrameServer::start(const std::string& n, Format f, int slots)
+{
+	lock_guard<mutex> guard(lock);
+	m_destroy();
+	name = n;
+	format = f;
+	slotCount = max(2, slots);
+	st = Stats();
+	active = true;
+}
+
+void FrameServer::stop(void)
+{
+	lock_guard<mutex> guard(lock);
+	active = false;
+	m_destroy();
+}
+
+int FrameServer::m_create(size_t frameBytes)
+{
+	//some room for a size change, the ring is made again when it is outgrown
+	size_t dataSize = alignUp(frameBytes + frameBytes / 8, slotAlign);
+	size_t slotSize = slotHeaderSize() + dataSize;
+	size_t headerSize = alignUp(sizeof(FrameRingHeader), slotAlign);
+	size_t size = headerSize + slotSize * slotCount;
+	string object = objectName(name);
+
+	void* p = nullptr;
+#ifdef _WIN32
+	HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((uint64_t)size >> 32), (DWORD)size, object.c_str());
+	if (!h) {
+		return -1;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		//readers still hold the old ring, try again with a later frame
+		CloseHandle(h);
+		return -1;
+	}
+	p = MapViewOfFile(h, FILE_MAP_WRITE, 0, 0, size);
+	if (!p) {
+		CloseHandle(h);
+		return -1;
+	}
+	mapping = h;
+#else
+	//readers keep a replaced ring mapped until they see closed
+	shm_unlink(object.c_str());
+	int fd = shm_open(object.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		return -errno;
+	}
+	if (ftruncate(fd, (off_t)size) < 0) {
+		int err = errno;
+		close(fd);
+		shm_unlink(object.c_str());
+		return -err;
+	}
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		shm_unlink(object.c_str());
+		return -1;
+	}
+#endif
+
+	//the header goes in last, a reader that sees the magic sees the rest
+	ring = (FrameRingHeader*)p;
+	ring->version = ringVersion;
+	ring->slotCount = slotCount;
+	ring->headerSize = (uint32_t)headerSize;
+	ring->slotSize = slotSize;
+	ring->closed.store(0, memory_order_relaxed);
+	ring->notify.store(0, memory_order_relaxed);
+	ring->published.store(0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	ring->magic = ringMagic;
+	mapSize = size;
+	capacity = dataSize;
+	return 0;
+}
+
+void FrameServer::m_destroy(void)
+{
+	if (!ring) {
+		return;
+	}
+
+	ring->closed.store(1, memory_order_release);
+	ring->notify.fetch_add(1, memory_order_release);
+#ifdef __linux__
+	syscall(SYS_futex, &ring->notify, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+
+#ifdef _WIN32
+	UnmapViewOfFile(ring);
+	CloseHandle((HANDLE)mapping);
+	mapping = nullptr;
+#else
+	munmap(ring, mapSize);
+	shm_unlink(objectName(name).c_str());
+#endif
+	ring = nullptr;
+	mapSize = 0;
+	capacity = 0;
+}
+
+int FrameServer::publish(int64_t pts, AVPixelFormat pixelFormat, int width, int height,
+	const uint8_t* const data[4], const int linesize[4])
+{
+	if (!active) {
+		return -1;
+	}
+	auto t0 = chrono::steady_clock::now();
+
+	lock_guard<mutex> guard(lock);
+	int size = av_image_get_buffer_size(pixelFormat, width, height, lineAlign);
+	if (size <= 0) {
+		st.skipped++;
+		return -1;
+	}
+	if ((size_t)size > capacity) {
+		m_destroy();
+		if (m_create(size) < 0) {
+			st.skipped++;
+			return -1;
+		}
+	}
+
+	uint64_t sequence = ring->published.load(memory_order_relaxed) + 1;
+	auto slot = slotAt(ring, sequence);
+	auto dst = (uint8_t*)slot + slotHeaderSize();
+
+	//readers that compare the state before and after know it is torn
+	slot->state.store(sequence * 2 - 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->sequence = sequence;
+	slot->pts = pts;
+	slot->format = pixelFormat;
+	slot->width = width;
+	slot->height = height;
+	//the layout av_image_copy_to_buffer writes
+	int lines[4] = { 0 };
+	uint8_t* planes[4] = { nullptr };
+	av_image_fill_arrays(planes, lines, dst, pixelFormat, width, height, lineAlign);
+	for (int i = 0; i < 4; i++) {
+		slot->linesize[i] = lines[i];
+		slot->offset[i] = planes[i] ? (uint64_t)(planes[i] - (uint8_t*)slot) : 0;
+	}
+	slot->size = size;
+	av_image_copy_to_buffer(dst, size, data, linesize, pixelFormat, width, height, lineAlign);
+	slot->publishTime = chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+
+	slot->state.store(sequence * 2, memory_order_release);
+	ring->published.store(sequence, memory_order_release);
+	ring->notify.fetch_add(1, memory_order_release);
+#ifdef __linux__
+	//a wake without sleepers costs one system call
+	syscall(SYS_futex, &ring->notify, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+
+	auto dt = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0);
+	st.published++;
+	st.bytes += size;
+	st.publishTime += dt;
+	st.publishMax = max(st.publishMax, dt);
+	return 0;
+}
+
+FrameServer::Stats FrameServer::stats(void)
+{
+	lock_guard<mutex> guard(lock);
+	return st;
+}
+
+FrameClient::~FrameClient()
+{
+	detach();
+}
+
+int FrameClient::attach(const std::string& name)
+{
+	detach();
+	string object = FrameServer::objectName(name);
+	void* p = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	HANDLE h = OpenFileMappingA(FILE_MAP_READ, FALSE, object.c_str());
+	if (!h) {
+		return -1;
+	}
+	p = MapViewOfFile(h, FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (!p || !VirtualQuery(p, &info, sizeof(info))) {
+		if (p) {
+			UnmapViewOfFile(p);
+		}
+		CloseHandle(h);
+		return -1;
+	}
+	size = info.RegionSize;
+	mapping = h;
+#else
+	int fd = shm_open(object.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		return -errno;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) < 0 || sb.st_size < (off_t)sizeof(FrameRingHeader)) {
+		//created but not sized yet
+		close(fd);
+		return -EAGAIN;
+	}
+	size = (size_t)sb.st_size;
+	p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return -errno;
+	}
+#endif
+
+	ring = (const FrameRingHeader*)p;
+	mapSize = size;
+	atomic_thread_fence(memory_order_acquire);
+	if (ring->magic != FrameServer::ringMagic || ring->version != FrameServer::ringVersion ||
+		ring->headerSize + ring->slotSize * ring->slotCount > mapSize) {
+		detach();
+		return -EAGAIN;
+	}
+	return 0;
+}
+
+void FrameClient::detach(void)
+{
+	if (!ring) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(ring);
+	CloseHandle((HANDLE)mapping);
+	mapping = nullptr;
+#else
+	munmap((void*)ring, mapSize);
+#endif
+	ring = nullptr;
+	mapSize = 0;
+}
+
+bool FrameClient::isClosed(void) const
+{
+	return !ring || ring->closed.load(memory_order_acquire);
+}
+
+uint64_t FrameClient::wait(uint64_t after, std::chrono::milliseconds timeout)
+{
+	if (!ring) {
+		return 0;
+	}
+	auto deadline = chrono::steady_clock::now() + timeout;
+	while (true) {
+		//read notify first, a frame published after it changes the word
+		uint32_t word = ring->notify.load(memory_order_acquire);
+		uint64_t latest = ring->published.load(memory_order_acquire);
+		if (latest > after || ring->closed.load(memory_order_acquire)) {
+			return latest;
+		}
+		auto now = chrono::steady_clock::now();
+		if (now >= deadline) {
+			return latest;
+		}
+#ifdef __linux__
+		auto left = chrono::duration_cast<chrono::nanoseconds>(deadline - now);
+		struct timespec ts;
+		ts.tv_sec = (time_t)(left.count() / 1000000000);
+		ts.tv_nsec = (long)(left.count() % 1000000000);
+		syscall(SYS_futex, &ring->notify, FUTEX_WAIT, word, &ts, NULL, 0);
+#else
+		(void)word;
+		this_thread::sleep_for(chrono::milliseconds(1));
+#endif
+	}
+}
+
+bool FrameClient::acquire(uint64_t sequence, Frame* f) const
+{
+	if (!ring || sequence == 0) {
+		return false;
+	}
+	auto slot = slotAt(ring, sequence);
+	uint64_t state = slot->state.load(memory_order_acquire);
+	if (state != sequence * 2) {
+		//overwritten by a newer frame, or still being written
+		return false;
+	}
+
+	f->sequence = sequence;
+	f->pts = slot->pts;
+	f->publishTime = slot->publishTime;
+	f->format = (AVPixelFormat)slot->format;
+	f->width = slot->width;
+	f->height = slot->height;
+	for (int i = 0; i < 4; i++) {
+		f->linesize[i] = slot->linesize[i];
+		f->data[i] = slot->offset[i] ? (const uint8_t*)slot + slot->offset[i] : nullptr;
+	}
+	f->state = state;
+	f->slot = slot;
+	return check(*f);
+}
+
+bool FrameClient::check(const Frame& f) const
+{
+	atomic_thread_fence(memory_order_acquire);
+	return f.slot && f.slot->state.load(memory_order_relaxed) == f.state;
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include "FFmpegHeader.h"
+
+//decoded frames published to a shared memory ring for other processes.
+//the player copies every frame into the next slot and never waits for
+//a reader; readers map the ring read-only, use the planes in place and
+//check afterwards that the slot was not overwritten meanwhile (seqlock).
+//a new frame bumps notify, readers sleep on it with a futex on linux.
+
+//start of the shared memory object
+struct FrameRingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	//offset of the first slot, slots follow back to back
+	uint32_t headerSize;
+	uint64_t slotSize;
+	//set when the server closes or outgrows the ring, readers attach again
+	std::atomic<uint32_t> closed;
+	//futex word, changes with every frame
+	std::atomic<uint32_t> notify;
+	//sequence of the latest complete frame, 0 before the first
+	std::atomic<uint64_t> published;
+};
+
+//start of every slot, the planes follow at dataOffset
+struct FrameSlotHeader {
+	//2 * sequence - 1 while the slot is written, 2 * sequence when complete
+	std::atomic<uint64_t> state;
+	uint64_t sequence;
+	//media time and the steady clock at publish, in us
+	int64_t pts;
+	int64_t publishTime;
+	//AVPixelFormat
+	int32_t format;
+	int32_t width;
+	int32_t height;
+	int32_t linesize[4];
+	//from the start of the slot
+	uint64_t offset[4];
+	uint64_t size;
+};
+
+class FrameServer final
+{
+public:
+	static const uint32_t ringMagic = 0x53464d4e;
+	static const uint32_t ringVersion = 1;
+	//header and planes start on cache lines, rows on 32 bytes
+	static const int slotAlign = 64;
+	static const int lineAlign = 32;
+
+	enum class Format {
+		//as decoded, before the video filter
+		FORMAT_NATIVE,
+		//packed RGB24 as displayed
+		FORMAT_RGB24
+	};
+
+	struct Stats {
+		int64_t published = 0;
+		//larger than the slots or without a ring
+		int64_t skipped = 0;
+		int64_t bytes = 0;
+		std::chrono::microseconds publishTime = std::chrono::microseconds(0);
+		std::chrono::microseconds publishMax = std::chrono::microseconds(0);
+	};
+
+private:
+	std::mutex lock;
+	std::string name;
+	Format format = Format::FORMAT_NATIVE;
+	int slotCount = 4;
+	std::atomic<bool> active{ false };
+
+	FrameRingHeader* ring = nullptr;
+	size_t mapSize = 0;
+	//slot data bytes of the current ring
+	size_t capacity = 0;
+#ifdef _WIN32
+	void* mapping = nullptr;
+#endif
+	Stats st;
+
+	int m_create(size_t frameBytes);
+	void m_destroy(void);
+
+public:
+	FrameServer() {}
+	~FrameServer();
+	FrameServer(const FrameServer&) = delete;
+	FrameServer& operator=(const FrameServer&) = delete;
+
+	//the ring is created with the first frame and grows with the frames
+	void start(const std::string& name, Format f, int slots = 4);
+	void stop(void);
+	bool isActive(void) const { return active; }
+	Format currentFormat(void) const { return format; }
+
+	//never blocks on readers. 0 when published, negative when skipped
+	int publish(int64_t pts, AVPixelFormat pixelFormat, int width, int height,
+		const uint8_t* const data[4], const int linesize[4]);
+
+	Stats stats(void);
+
+	//readable shm name of a server name, also used by FrameClient
+	static std::string objectName(const std::string& name);
+};
+
+//read-only side of the ring, the reference consumer
+class FrameClient final
+{
+public:
+	//view into the slot, valid until check() says otherwise
+	struct Frame {
+		uint64_t sequence = 0;
+		int64_t pts = 0;
+		int64_t publishTime = 0;
+		AVPixelFormat format = AVPixelFormat::AV_PIX_FMT_NONE;
+		int width = 0;
+		int height = 0;
+		int linesize[4] = { 0 };
+		const uint8_t* data[4] = { nullptr };
+		uint64_t state = 0;
+		const FrameSlotHeader* slot = nullptr;
+	};
+
+private:
+	const FrameRingHeader* ring = nullptr;
+	size_t mapSize = 0;
+#ifdef _WIN32
+	void* mapping = nullptr;
+#endif
+
+public:
+	FrameClient() {}
+	~FrameClient();
+	FrameClient(const FrameClient&) = delete;
+	FrameClient& operator=(const FrameClient&) = delete;
+
+	//0 on success, negative while there is no ring
+	int attach(const std::string& name);
+	void detach(void);
+	bool isAttached(void) const { return ring != nullptr; }
+	//the server closed or replaced the ring, attach again
+	bool isClosed(void) const;
+
+	//sequence of the latest frame, waits up to timeout for one newer than after
+	uint64_t wait(uint64_t after, std::chrono::milliseconds timeout);
+	//the frame with this sequence, false when it was overwritten already
+	bool acquire(uint64_t sequence, Frame* f) const;
+	//after using the planes, false when the server overwrote them meanwhile
+	bool check(const Frame& f) const;
+};
@@ -0,0 +1,307 @@
+#include "GLRenderer.h"
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <QDebug>
+
+using namespace std;
+
+void GLRenderer::initShaderScript(void)
+{
+	stringstream vs, fs;
+
+	vs << "#version 330 core" << endl
+		<< "layout(location = 0) in vec3 aPos;" << endl
+		<< "layout(location = 1) in vec2 aTexCoord;" << endl
+		<< "out vec2 optTexCoord;" << endl
+		<< "void main()" << endl
+		<< "{" << endl
+		<< "gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);" << endl
+		<< "optTexCoord = aTexCoord;" << endl
+		<< "}" << endl;
+	vsCode = vs.str();
+
+	fs << "#version 330 core" << endl
+		<< "in vec2 optTexCoord;" << endl
+		<< "out vec4 FragColor;" << endl
+		<< "uniform sampler2D texture0;" << endl
+		<< "void main()" << endl
+		<< "{" << endl
+		<< "FragColor = texture(texture0, optTexCoord);" << endl
+		<< "}" << endl;
+	fsCode = fs.str();
+
+	stringstream ovs, ofs;
+
+	ovs << "#version 330 core" << endl
+		<< "layout(location = 0) in vec2 aPos;" << endl
+		<< "layout(location = 1) in vec4 aColor;" << endl
+		<< "out vec4 optColor;" << endl
+		<< "void main()" << endl
+		<< "{" << endl
+		<< "gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0);" << endl
+		<< "optColor = aColor;" << endl
+		<< "}" << endl;
+	overlayVsCode = ovs.str();
+
+	ofs << "#version 330 core" << endl
+		<< "in vec4 optColor;" << endl
+		<< "out vec4 FragColor;" << endl
+		<< "void main()" << endl
+		<< "{" << endl
+		<< "FragColor = optColor;" << endl
+		<< "}" << endl;
+	overlayFsCode = ofs.str();
+}
+
+bool GLRenderer::createProgram(void)
+{
+	initShaderScript();
+
+	program = linkProgram(vsCode, fsCode);
+	overlayProgram = linkProgram(overlayVsCode, overlayFsCode);
+	if (!program || !overlayProgram) {
+		return false;
+	}
+
+	qDebug("createProgram done");
+	return true;
+}
+
+GLuint GLRenderer::linkProgram(const std::string& vs, const std::string& fs)
+{
+	const char* vertexShaderSource = vs.c_str();
+	const char* fragmentShaderSource = fs.c_str();
+	int  success = 0;
+	char infoLog[512] = { '\0' };
+
+	auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+	glCompileShader(vertexShader);
+	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+		qDebug("ERROR::vertexShader::COMPILATION_FAILED");
+		qDebug(infoLog);
+		return 0;
+	}
+
+	//fragment shader
+	auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+	glCompileShader(fragmentShader);
+	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+		qDebug("ERROR::fragmentShader::COMPILATION_FAILED");
+		qDebug(infoLog);
+		return 0;
+	}
+
+	//link shader program
+	GLuint prog = glCreateProgram();
+	glAttachShader(prog, vertexShader);
+	glAttachShader(prog, fragmentShader);
+	glLinkProgram(prog);
+	glGetProgramiv(prog, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(prog, 512, NULL, infoLog);
+		qDebug("ERROR::shaderProgram::FAILED");
+		qDebug(infoLog);
+		return 0;
+	}
+
+	//release shaders after link
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	return prog;
+}
+
+bool GLRenderer::initialize(void)
+{
+	initializeOpenGLFunctions();
+
+	//compile and link program
+	if (!createProgram()) {
+		return false;
+	}
+
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
+
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_DYNAMIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	//meter overlay, x y r g b a per vertex, filled on every paint
+	glGenVertexArrays(1, &overlayVAO);
+	glBindVertexArray(overlayVAO);
+	glGenBuffers(1, &overlayVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, overlayVBO);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	// texture
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//uniforms are set on the program in use
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "texture0"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	//rows of RGB24 frames are packed, any width is possible
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	ready = true;
+	qDebug("GLRenderer::initialize done");
+	return true;
+}
+
+void GLRenderer::release(void)
+{
+	if (!ready) {
+		return;
+	}
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+	glDeleteVertexArrays(1, &overlayVAO);
+	glDeleteBuffers(1, &overlayVBO);
+	glDeleteTextures(1, &texture);
+	glDeleteProgram(program);
+	glDeleteProgram(overlayProgram);
+	VAO = VBO = EBO = overlayVAO = overlayVBO = texture = 0;
+	program = overlayProgram = 0;
+	textureWidth = textureHeight = 0;
+	ready = false;
+}
+
+void GLRenderer::upload(const uint8_t* rgb, int width, int height)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	if (width != textureWidth || height != textureHeight) {
+		//reallocate only when the size changes
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
+			width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+		textureWidth = width;
+		textureHeight = height;
+	}
+	else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+			width, height, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+	}
+}
+
+void GLRenderer::clear(void)
+{
+	uint8_t arr[3] = { 0 };
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
+		1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, arr);
+	textureWidth = 1;
+	textureHeight = 1;
+}
+
+void GLRenderer::paint(const AudioMeter::Levels* meters)
+{
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	// bind textures on corresponding texture units
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glUseProgram(program);
+
+	// render container
+	glBindVertexArray(VAO);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+
+	if (meters) {
+		paintMeters(*meters);
+	}
+}
+
+void GLRenderer::paintMeters(const AudioMeter::Levels& lv)
+{
+	if (lv.channels == 0 || !overlayProgram) {
+		return;
+	}
+
+	vector<float> v;
+	v.reserve((2 + 3 * lv.channels + AudioMeter::bandCount) * 36);
+	auto quad = [&v](float x0, float y0, float x1, float y1, float r, float g, float b, float a) {
+		float q[6][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y0 }, { x1, y1 }, { x0, y1 } };
+		for (auto& p : q) {
+			v.insert(v.end(), { p[0], p[1], r, g, b, a });
+		}
+	};
+	//meters show -60..0 dBFS, the spectrum the full range
+	auto meterLevel = [](float db) {
+		return max(0.0f, min(1.0f, (db + 60.0f) / 60.0f));
+	};
+	auto bandLevel = [](float db) {
+		return max(0.0f, min(1.0f, (db - AudioMeter::floorDb) / -AudioMeter::floorDb));
+	};
+
+	//bottom left, in normalized device coordinates
+	const float left = -0.97f, bottom = -0.95f, height = 0.35f, gap = 0.01f;
+	const float meterWidth = 0.025f, bandWidth = 0.012f;
+	float spectrumLeft = left + gap + lv.channels * (meterWidth + gap) + gap;
+	float right = spectrumLeft + AudioMeter::bandCount * bandWidth + gap;
+	quad(left, bottom, right, bottom + height + 2 * gap, 0.0f, 0.0f, 0.0f, 0.6f);
+
+	float y0 = bottom + gap;
+	for (int c = 0; c < lv.channels; c++) {
+		float x = left + gap + c * (meterWidth + gap);
+		float r = 0.2f, g = 0.9f, b = 0.2f;
+		if (lv.peak[c] > -3.0f) {
+			g = 0.2f;
+			r = 1.0f;
+		}
+		else if (lv.peak[c] > -18.0f) {
+			r = 1.0f;
+		}
+		quad(x, y0, x + meterWidth, y0 + height * meterLevel(lv.peak[c]), r, g, b, 0.4f);
+		quad(x, y0, x + meterWidth, y0 + height * meterLevel(lv.rms[c]), r, g, b, 1.0f);
+		float yh = y0 + height * meterLevel(lv.peakHold[c]);
+		quad(x, yh - 0.004f, x + meterWidth, yh + 0.004f, 1.0f, 1.0f, 1.0f, 1.0f);
+	}
+	for (int i = 0; i < AudioMeter::bandCount; i++) {
+		float x = spectrumLeft + i * bandWidth;
+		quad(x, y0, x + bandWidth * 0.8f, y0 + height * bandLevel(lv.bands[i]), 0.2f, 0.8f, 1.0f, 0.9f);
+	}
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glUseProgram(overlayProgram);
+	glBindVertexArray(overlayVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, overlayVBO);
+	glBufferData(GL_ARRAY_BUFFER, v.size() * sizeof(float), v.data(), GL_STREAM_DRAW);
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(v.size() / 6));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	glDisable(GL_BLEND);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <QOpenGLFunctions_3_3_Core>
+#include "AudioMeter.h"
+
+//the video quad and the meter overlay, drawn into whatever framebuffer
+//is bound. every call needs the owner's GL context current.
+class GLRenderer final : protected QOpenGLFunctions_3_3_Core
+{
+private:
+	bool ready = false;
+	GLuint VBO = 0;
+	GLuint VAO = 0;
+	GLuint EBO = 0;
+	std::string vsCode, fsCode;
+	GLuint program = 0;
+	//flat colored triangles for the meters
+	std::string overlayVsCode, overlayFsCode;
+	GLuint overlayProgram = 0;
+	GLuint overlayVAO = 0;
+	GLuint overlayVBO = 0;
+	GLuint texture = 0;
+	//allocated texture size, frames of the same size only update it
+	int textureWidth = 0;
+	int textureHeight = 0;
+
+	float vertices[20] = {
+			 1.0f,  1.0f, 0.0f, 1.0f, 0.0f,   // right-top
+			 1.0f, -1.0f, 0.0f, 1.0f, 1.0f,   // right-bottom
+			-1.0f, -1.0f, 0.0f, 0.0f, 1.0f,   // left-bottom
+			-1.0f,  1.0f, 0.0f,  0.0f, 0.0f    // left-top
+	};
+
+	unsigned int indices[6] = { 
+		0, 1, 3,	//first
+		1, 2, 3	//second
+	};
+
+	void initShaderScript(void);
+	bool createProgram(void);
+	//0 on failure
+	GLuint linkProgram(const std::string& vs, const std::string& fs);
+	void paintMeters(const AudioMeter::Levels& lv);
+
+public:
+	GLRenderer() {}
+	GLRenderer(const GLRenderer&) = delete;
+	GLRenderer& operator=(const GLRenderer&) = delete;
+
+	//programs, buffers and the texture. false when a shader fails
+	bool initialize(void);
+	bool isReady(void) const { return ready; }
+	void release(void);
+
+	//packed RGB24
+	void upload(const uint8_t* rgb, int width, int height);
+	//a black texture until the next upload
+	void clear(void);
+	//meters is nullptr without the overlay
+	void paint(const AudioMeter::Levels* meters);
+};
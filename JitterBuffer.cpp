@@ -0,0 +1,278 @@
+#include "JitterBuffer.h"
+#include <cmath>
+
+using namespace std;
+
+JitterBuffer::PresetParam JitterBuffer::param(Preset p)
+{
+	if (p == Preset::PRESET_LOW_LATENCY) {
+		//small buffer, drop to a keyframe instead of drifting behind
+		return {
+			chrono::milliseconds(40), chrono::milliseconds(300), 2.0,
+			chrono::milliseconds(200), chrono::milliseconds(1000), 1.0
+		};
+	}
+	else {
+		//large buffer, catch up with a slight speed-up
+		return {
+			chrono::milliseconds(300), chrono::milliseconds(3000), 4.0,
+			chrono::milliseconds(1000), chrono::milliseconds(6000), 1.03
+		};
+	}
+}
+
+std::chrono::microseconds JitterBuffer::target(void) const
+{
+	auto p = param(preset);
+	if (!live) {
+		//arrival times of a file are bounded by our own backpressure
+		return p.minTarget;
+	}
+
+	auto t = p.minTarget + chrono::microseconds((int64_t)(p.k * sqrt(transitVar)));
+	return min(t, p.maxTarget);
+}
+
+std::chrono::microseconds JitterBuffer::buffered(void) const
+{
+	if (!hasPushed || pushedPts < poppedPts) {
+		return chrono::microseconds(0);
+	}
+	return pushedPts - poppedPts;
+}
+
+void JitterBuffer::catchUp(void)
+{
+	auto p = param(preset);
+	auto excess = buffered() - target();
+
+	if (p.speed > 1.0) {
+		if (excess > p.catchUp) {
+			if (speed == 1.0) {
+				catchUps++;
+			}
+			speed = p.speed;
+		}
+		else if (excess <= chrono::microseconds(0)) {
+			speed = 1.0;
+		}
+
+		//the speed-up cannot keep up, fall back to a drop
+		if (excess > p.catchUp * 4) {
+			dropToKeyframe();
+		}
+	}
+	else if (excess > p.catchUp) {
+		dropToKeyframe();
+	}
+}
+
+void JitterBuffer::dropToKeyframe(void)
+{
+	auto t = target();
+	size_t index = 0;
+
+	//latest keyframe that still leaves the target buffered
+	for (size_t i = 1; i < packetList.size(); i++) {
+		auto& e = packetList[i];
+		bool key = videoStream >= 0 ?
+			(e.packet->stream_index == videoStream && (e.packet->flags & AV_PKT_FLAG_KEY)) :
+			e.packet->stream_index == clockStream;
+		if (!key) {
+			continue;
+		}
+		if (pushedPts - e.pts < t) {
+			break;
+		}
+		index = i;
+	}
+
+	if (index == 0) {
+		return;
+	}
+
+	auto pts = packetList[index].pts;
+	if (pts > poppedPts) {
+		skipped += pts - poppedPts;
+	}
+	poppedPts = pts;
+
+	for (size_t i = 0; i < index; i++) {
+		av_packet_free(&packetList.front().packet);
+		packetList.pop_front();
+	}
+	droppedPackets += index;
+	catchUps++;
+}
+
+void JitterBuffer::clearList(void)
+{
+	while (packetList.size()) {
+		av_packet_free(&packetList.front().packet);
+		packetList.pop_front();
+	}
+}
+
+JitterBuffer::~JitterBuffer()
+{
+	clearList();
+}
+
+void JitterBuffer::reset(Preset p, bool isLive, int clockStreamIndex, int videoStreamIndex)
+{
+	lock_guard<mutex> guard(lock);
+
+	clearList();
+	preset = p;
+	live = isLive;
+	clockStream = clockStreamIndex;
+	videoStream = videoStreamIndex;
+	filling = true;
+	eof = false;
+	hasPushed = false;
+	hasPopped = false;
+	pushedPts = chrono::microseconds(0);
+	poppedPts = chrono::microseconds(0);
+	ptsShift = chrono::microseconds(0);
+	skipped = chrono::microseconds(0);
+	hasTransit = false;
+	transitMean = 0.0;
+	transitVar = 0.0;
+	speed = 1.0;
+	underruns = 0;
+	droppedPackets = 0;
+	catchUps = 0;
+}
+
+void JitterBuffer::clear(void)
+{
+	lock_guard<mutex> guard(lock);
+	clearList();
+}
+
+void JitterBuffer::push(AVPacket* pkt, std::chrono::microseconds pts)
+{
+	auto now = chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now().time_since_epoch());
+
+	lock_guard<mutex> guard(lock);
+
+	pts += ptsShift;
+	if (pkt->stream_index == clockStream && hasPushed && pts < pushedPts - ptsJump) {
+		//else buffered() stays 0: full() never stops the demuxer and the
+		//target and catch-up stop working. the new timeline goes on from
+		//the last packet, the arrival statistics start over
+		ptsShift += pushedPts - pts;
+		pts = pushedPts;
+		hasTransit = false;
+	}
+
+	if (pkt->stream_index == clockStream) {
+		double transit = (double)(now - pts).count();
+		if (!hasTransit) {
+			transitMean = transit;
+			transitVar = 0.0;
+			hasTransit = true;
+		}
+		else {
+			double d = transit - transitMean;
+			transitMean += d / 16.0;
+			transitVar += (d * d - transitVar) / 16.0;
+		}
+
+		if (!hasPushed && !hasPopped) {
+			poppedPts = pts;
+		}
+		hasPushed = true;
+		pushedPts = pts;
+	}
+
+	Entry e;
+	e.packet = av_packet_alloc();
+	if (!e.packet) {
+		return;
+	}
+	av_packet_move_ref(e.packet, pkt);
+	e.pts = pts;
+	packetList.push_back(e);
+}
+
+void JitterBuffer::setEof(void)
+{
+	lock_guard<mutex> guard(lock);
+	eof = true;
+}
+
+int JitterBuffer::pop(AVPacket* pkt)
+{
+	lock_guard<mutex> guard(lock);
+
+	if (packetList.size() == 0) {
+		if (eof) {
+			return AVERROR_EOF;
+		}
+		if (!filling) {
+			filling = true;
+			underruns++;
+		}
+		return AVERROR(EAGAIN);
+	}
+
+	if (filling) {
+		if (!eof && buffered() < target()) {
+			return AVERROR(EAGAIN);
+		}
+		filling = false;
+	}
+
+	if (live) {
+		catchUp();
+	}
+
+	auto e = packetList.front();
+	packetList.pop_front();
+	av_packet_move_ref(pkt, e.packet);
+	av_packet_free(&e.packet);
+
+	if (pkt->stream_index == clockStream) {
+		poppedPts = e.pts;
+		hasPopped = true;
+	}
+
+	return 0;
+}
+
+bool JitterBuffer::full(void)
+{
+	lock_guard<mutex> guard(lock);
+	return buffered() >= param(preset).capacity;
+}
+
+double JitterBuffer::playbackSpeed(void)
+{
+	lock_guard<mutex> guard(lock);
+	return speed;
+}
+
+std::chrono::microseconds JitterBuffer::takeSkipped(void)
+{
+	lock_guard<mutex> guard(lock);
+	auto ret = skipped;
+	skipped = chrono::microseconds(0);
+	return ret;
+}
+
+JitterBuffer::Stats JitterBuffer::stats(void)
+{
+	lock_guard<mutex> guard(lock);
+
+	Stats ret;
+	ret.target = target();
+	ret.buffered = buffered();
+	ret.jitter = chrono::microseconds((int64_t)sqrt(transitVar));
+	ret.underruns = underruns;
+	ret.droppedPackets = droppedPackets;
+	ret.catchUps = catchUps;
+	ret.speed = speed;
+	return ret;
+}
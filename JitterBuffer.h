@@ -0,0 +1,109 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include "FFmpegHeader.h"
+
+//packet queue between the network demuxer and the decoders.
+//the target depth follows the observed variance of packet arrival
+//times, playback starts (and restarts after an underrun) only when the
+//target is buffered. for live sources the buffer also decides how to
+//catch up when latency grows: a slight speed-up or a drop to the next
+//video keyframe, depending on the preset.
+class JitterBuffer final
+{
+public:
+	enum class Preset {
+		PRESET_LOW_LATENCY,
+		PRESET_SMOOTH
+	};
+
+	struct Stats {
+		std::chrono::microseconds target = std::chrono::microseconds(0);
+		std::chrono::microseconds buffered = std::chrono::microseconds(0);
+		std::chrono::microseconds jitter = std::chrono::microseconds(0);
+		int64_t underruns = 0;
+		int64_t droppedPackets = 0;
+		int64_t catchUps = 0;
+		double speed = 1.0;
+	};
+
+private:
+	struct Entry {
+		AVPacket* packet = nullptr;
+		std::chrono::microseconds pts;
+	};
+
+	struct PresetParam {
+		std::chrono::microseconds minTarget;
+		std::chrono::microseconds maxTarget;
+		//target = minTarget + k * arrival jitter
+		double k;
+		//latency above target that starts a catch-up
+		std::chrono::microseconds catchUp;
+		//the demuxer stops reading above this depth
+		std::chrono::microseconds capacity;
+		double speed;
+	};
+
+	std::mutex lock;
+	std::deque<Entry> packetList;
+	Preset preset = Preset::PRESET_SMOOTH;
+	bool live = false;
+	bool filling = true;
+	bool eof = false;
+	//stream whose timestamps measure the depth, video stream for keyframe drops
+	int clockStream = -1;
+	int videoStream = -1;
+	bool hasPushed = false;
+	bool hasPopped = false;
+	std::chrono::microseconds pushedPts = std::chrono::microseconds(0);
+	std::chrono::microseconds poppedPts = std::chrono::microseconds(0);
+	//added to pushed pts since the clock stream last went backwards, a
+	//live source may restart its timestamps on a reconnect
+	std::chrono::microseconds ptsShift = std::chrono::microseconds(0);
+	//further back than reordering takes it
+	static constexpr std::chrono::milliseconds ptsJump{ 1000 };
+	//dropped media time not yet consumed by the player clock
+	std::chrono::microseconds skipped = std::chrono::microseconds(0);
+
+	//arrival time minus media time, running mean and variance in us
+	bool hasTransit = false;
+	double transitMean = 0.0;
+	double transitVar = 0.0;
+
+	double speed = 1.0;
+	int64_t underruns = 0;
+	int64_t droppedPackets = 0;
+	int64_t catchUps = 0;
+
+	static PresetParam param(Preset p);
+	std::chrono::microseconds target(void) const;
+	std::chrono::microseconds buffered(void) const;
+	void catchUp(void);
+	void dropToKeyframe(void);
+	void clearList(void);
+
+public:
+	JitterBuffer() = default;
+	~JitterBuffer();
+	JitterBuffer(const JitterBuffer&) = delete;
+	JitterBuffer& operator=(const JitterBuffer&) = delete;
+
+	void reset(Preset p, bool isLive, int clockStreamIndex, int videoStreamIndex);
+	void clear(void);
+
+	//takes the reference of pkt, pts is the packet time in media time
+	void push(AVPacket* pkt, std::chrono::microseconds pts);
+	void setEof(void);
+	//0 on success, AVERROR(EAGAIN) while filling, AVERROR_EOF when drained
+	int pop(AVPacket* pkt);
+	//demuxer backpressure
+	bool full(void);
+
+	//playback speed requested by the catch-up logic
+	double playbackSpeed(void);
+	//media time dropped since the last call, the player clock has to skip it
+	std::chrono::microseconds takeSkipped(void);
+	Stats stats(void);
+};
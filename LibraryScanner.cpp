@@ -0,0 +1,345 @@
+#include "LibraryScanner.h"
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <QDir>
+#include <QHash>
+#include <QImage>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDataStream>
+#include <QDirIterator>
+#include "NemoThreadPool.h"
+#include "ScalerCache.h"
+
+using namespace std;
+
+bool LibraryScanner::isMediaFile(const QString& path)
+{
+	static const char* suffixList[] = {
+		"mp4", "m4v", "mov", "mkv", "webm", "avi", "flv", "ts", "m2ts", "mpg", "wmv",
+		"mp3", "m4a", "aac", "flac", "wav", "ogg", "opus"
+	};
+
+	QString suffix = QFileInfo(path).suffix().toLower();
+	for (auto s : suffixList) {
+		if (suffix == s) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int LibraryScanner::thumbnail(AVFormatContext* fc, int index, int width, QByteArray* jpeg)
+{
+	AVStream* st = fc->streams[index];
+	const AVCodec* codec = avcodec_find_decoder(st->codecpar->codec_id);
+	if (!codec) {
+		return AVERROR_DECODER_NOT_FOUND;
+	}
+
+	AVCodecContext* cc = avcodec_alloc_context3(codec);
+	AVPacket* packet = av_packet_alloc();
+	AVFrame* frame = av_frame_alloc();
+	int ret = AVERROR(ENOMEM);
+	if (cc && packet && frame) {
+		ret = avcodec_parameters_to_context(cc, st->codecpar);
+	}
+	if (ret >= 0) {
+		//the scan runs one file per worker, and only keyframes are needed
+		cc->thread_count = 1;
+		cc->skip_frame = AVDiscard::AVDISCARD_NONKEY;
+		ret = avcodec_open2(cc, codec, NULL);
+	}
+
+	if (ret >= 0) {
+		//a tenth into the file skips black intros, cover art has no timeline
+		if (!(st->disposition & AV_DISPOSITION_ATTACHED_PIC) && fc->duration > 0) {
+			int64_t ts = min<int64_t>(fc->duration / 10, 10 * (int64_t)AV_TIME_BASE);
+			if (fc->start_time != AV_NOPTS_VALUE) {
+				ts += fc->start_time;
+			}
+			av_seek_frame(fc, -1, ts, AVSEEK_FLAG_BACKWARD);
+		}
+
+		ret = AVERROR(EAGAIN);
+		for (int n = 0; n < 512 && ret == AVERROR(EAGAIN); n++) {
+			if (av_read_frame(fc, packet) < 0) {
+				//drain what the decoder holds
+				avcodec_send_packet(cc, NULL);
+				ret = avcodec_receive_frame(cc, frame);
+				break;
+			}
+			if (packet->stream_index == index && avcodec_send_packet(cc, packet) >= 0) {
+				ret = avcodec_receive_frame(cc, frame);
+			}
+			av_packet_unref(packet);
+		}
+	}
+
+	SwsContext* sws_ctx = nullptr;
+	int w = 0, h = 0;
+	if (ret >= 0) {
+		w = min(width, frame->width);
+		h = max(2, (int)((int64_t)frame->height * w / max(frame->width, 1)) & ~1);
+
+		//workers see the same few formats over and over
+		thread_local ScalerCache scalers(2);
+		sws_ctx = scalers.get(ScalerCache::frameKey(frame, w, h, AVPixelFormat::AV_PIX_FMT_RGB24));
+		if (!sws_ctx) {
+			ret = AVERROR(EINVAL);
+		}
+	}
+
+	if (ret >= 0) {
+		QImage image(w, h, QImage::Format_RGB888);
+		uint8_t* dst[4] = { image.bits(), NULL, NULL, NULL };
+		int dstLinesize[4] = { (int)image.bytesPerLine(), 0, 0, 0 };
+		sws_scale(sws_ctx, (const uint8_t* const*)frame->data, frame->linesize,
+			0, frame->height, dst, dstLinesize);
+
+		QBuffer buffer(jpeg);
+		buffer.open(QIODevice::WriteOnly);
+		ret = image.save(&buffer, "JPEG", 75) ? 0 : -1;
+	}
+
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+	avcodec_free_context(&cc);
+	return ret;
+}
+
+int LibraryScanner::probe(const QString& path, const Options& opt, Entry* entry)
+{
+	AVFormatContext* fc = avformat_alloc_context();
+	if (!fc) {
+		return AVERROR(ENOMEM);
+	}
+
+	//badly muxed files would otherwise read up to the default 5 MB
+	fc->probesize = opt.probeSize;
+	fc->format_probesize = (int)min<int64_t>(opt.probeSize, INT_MAX);
+	fc->max_analyze_duration = opt.analyzeDuration.count();
+
+	int ret = avformat_open_input(&fc, path.toUtf8().constData(), NULL, NULL);
+	if (ret < 0) {
+		return ret;
+	}
+	if ((ret = avformat_find_stream_info(fc, NULL)) < 0) {
+		avformat_close_input(&fc);
+		return ret;
+	}
+
+	//AV_TIME_BASE is us
+	entry->duration = fc->duration == AV_NOPTS_VALUE ? 0 : fc->duration;
+	entry->bitRate = fc->bit_rate;
+	entry->streams.clear();
+	for (unsigned int i = 0; i < fc->nb_streams; i++) {
+		auto par = fc->streams[i]->codecpar;
+		StreamInfo s;
+		s.type = par->codec_type;
+		s.codec = avcodec_get_name(par->codec_id);
+		s.width = par->width;
+		s.height = par->height;
+		s.sampleRate = par->sample_rate;
+		s.channels = par->channels;
+		s.bitRate = par->bit_rate;
+		entry->streams.push_back(s);
+	}
+
+	entry->thumbnail.clear();
+	if (opt.thumbnailWidth > 0) {
+		int index = av_find_best_stream(fc, AVMediaType::AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+		//a file without a poster frame is still in the library
+		if (index >= 0 && thumbnail(fc, index, opt.thumbnailWidth, &entry->thumbnail) < 0) {
+			entry->thumbnail.clear();
+		}
+	}
+
+	avformat_close_input(&fc);
+	return 0;
+}
+
+LibraryScanner::Stats LibraryScanner::scan(const QString& folder, const Options& opt)
+{
+	auto t0 = chrono::steady_clock::now();
+	Stats stats;
+
+	QString root = QFileInfo(folder).absoluteFilePath();
+	QStringList pathList;
+	QDirIterator it(root, QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		QString path = it.next();
+		if (isMediaFile(path)) {
+			pathList << QFileInfo(path).absoluteFilePath();
+		}
+	}
+	stats.files = pathList.size();
+
+	QHash<QString, size_t> known;
+	for (size_t i = 0; i < entryList.size(); i++) {
+		known.insert(entryList[i].path, i);
+	}
+
+	//unchanged files keep their entry, the rest is probed
+	vector<Entry> result(pathList.size());
+	vector<size_t> todo;
+	vector<bool> present(entryList.size(), false);
+	for (qsizetype i = 0; i < pathList.size(); i++) {
+		QFileInfo info(pathList[i]);
+		qint64 size = info.size();
+		qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+
+		auto k = known.find(pathList[i]);
+		if (k != known.end()) {
+			present[k.value()] = true;
+			auto& old = entryList[k.value()];
+			if (old.size == size && old.mtime == mtime && old.error == 0) {
+				result[i] = std::move(old);
+				stats.reused++;
+				continue;
+			}
+		}
+		result[i].path = pathList[i];
+		result[i].size = size;
+		result[i].mtime = mtime;
+		todo.push_back(i);
+	}
+
+	if (todo.size()) {
+		int jobs = opt.jobs > 0 ? opt.jobs : (int)thread::hardware_concurrency();
+		jobs = max(1, min(jobs, (int)todo.size()));
+
+		//a private pool, scanning never competes with playback tasks
+		NemoThreadPool pool(jobs);
+		atomic<size_t> next{ 0 };
+		mutex doneLock;
+		condition_variable doneCV;
+		int running = jobs;
+		for (int j = 0; j < jobs; j++) {
+			pool.post(NemoThreadPool::Priority::PRIORITY_BACKGROUND, [&]() {
+				for (size_t n = next++; n < todo.size(); n = next++) {
+					auto& e = result[todo[n]];
+					e.error = probe(e.path, opt, &e);
+				}
+				lock_guard<mutex> guard(doneLock);
+				running--;
+				doneCV.notify_all();
+			});
+		}
+		unique_lock<mutex> guard(doneLock);
+		doneCV.wait(guard, [&]() {
+			return running == 0;
+		});
+	}
+
+	for (auto i : todo) {
+		if (result[i].error) {
+			stats.failed++;
+		}
+		else {
+			stats.scanned++;
+		}
+	}
+
+	//entries of other folders stay, vanished files under this one go
+	vector<Entry> merged;
+	for (size_t i = 0; i < entryList.size(); i++) {
+		if (present[i]) {
+			//reused or probed again into result
+			continue;
+		}
+		if (entryList[i].path.startsWith(root + "/")) {
+			stats.removed++;
+			continue;
+		}
+		merged.push_back(std::move(entryList[i]));
+	}
+	for (auto& e : result) {
+		merged.push_back(std::move(e));
+	}
+	sort(merged.begin(), merged.end(), [](const Entry& a, const Entry& b) {
+		return a.path < b.path;
+	});
+	entryList = std::move(merged);
+
+	stats.elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0);
+	if (stats.elapsed.count() > 0) {
+		stats.filesPerSecond = (stats.scanned + stats.failed) * 1000000.0 / stats.elapsed.count();
+	}
+	return stats;
+}
+
+int LibraryScanner::load(const QString& indexPath)
+{
+	entryList.clear();
+
+	QFile file(indexPath);
+	if (!file.exists()) {
+		return 0;
+	}
+	if (!file.open(QIODevice::ReadOnly)) {
+		return -1;
+	}
+
+	QDataStream in(&file);
+	quint32 m = 0, v = 0, count = 0;
+	in >> m >> v >> count;
+	if (in.status() != QDataStream::Ok || m != magic || v != version) {
+		//an old or foreign index is rebuilt by the next scan
+		return -1;
+	}
+
+	//counts from a corrupt file must not turn into huge allocations,
+	//every entry and stream takes at least its fixed size
+	if (count > (quint64)(file.size() - file.pos()) / minEntryBytes) {
+		return -1;
+	}
+	entryList.resize(count);
+	for (auto& e : entryList) {
+		quint32 streamCount = 0;
+		in >> e.path >> e.size >> e.mtime >> e.error >> e.duration >> e.bitRate >> streamCount;
+		if (in.status() != QDataStream::Ok) {
+			break;
+		}
+		if (streamCount > (quint64)(file.size() - file.pos()) / minStreamBytes) {
+			in.setStatus(QDataStream::ReadCorruptData);
+			break;
+		}
+		e.streams.resize(streamCount);
+		for (auto& s : e.streams) {
+			in >> s.type >> s.codec >> s.width >> s.height >> s.sampleRate >> s.channels >> s.bitRate;
+		}
+		in >> e.thumbnail;
+	}
+
+	if (in.status() != QDataStream::Ok) {
+		entryList.clear();
+		return -1;
+	}
+	return 0;
+}
+
+int LibraryScanner::save(const QString& indexPath) const
+{
+	QSaveFile file(indexPath);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return -1;
+	}
+
+	QDataStream out(&file);
+	out << magic << version << (quint32)entryList.size();
+	for (auto& e : entryList) {
+		out << e.path << e.size << e.mtime << e.error << e.duration << e.bitRate << (quint32)e.streams.size();
+		for (auto& s : e.streams) {
+			out << s.type << s.codec << s.width << s.height << s.sampleRate << s.channels << s.bitRate;
+		}
+		out << e.thumbnail;
+	}
+
+	return file.commit() ? 0 : -1;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <QString>
+#include <QByteArray>
+#include "FFmpegHeader.h"
+
+//batch probing of media folders into a compact index file.
+//files are probed concurrently on a private NemoThreadPool with bounded
+//probe sizes, each entry keeps duration, bitrate, the streams and a
+//small JPEG poster frame. a rescan reuses the entries of files whose
+//size and mtime are unchanged.
+class LibraryScanner final
+{
+public:
+	struct StreamInfo {
+		qint32 type = AVMediaType::AVMEDIA_TYPE_UNKNOWN;
+		QString codec;
+		qint32 width = 0;
+		qint32 height = 0;
+		qint32 sampleRate = 0;
+		qint32 channels = 0;
+		qint64 bitRate = 0;
+	};
+
+	struct Entry {
+		QString path;
+		qint64 size = 0;
+		qint64 mtime = 0;
+		//0 when the file was probed, the FFmpeg error otherwise
+		qint32 error = 0;
+		//in us
+		qint64 duration = 0;
+		qint64 bitRate = 0;
+		std::vector<StreamInfo> streams;
+		QByteArray thumbnail;
+	};
+
+	struct Options {
+		//0 for one worker per core
+		int jobs = 0;
+		int64_t probeSize = 1 << 20;
+		std::chrono::microseconds analyzeDuration = std::chrono::seconds(2);
+		//0 skips the poster frame
+		int thumbnailWidth = 160;
+	};
+
+	struct Stats {
+		int64_t files = 0;
+		int64_t scanned = 0;
+		int64_t reused = 0;
+		int64_t removed = 0;
+		int64_t failed = 0;
+		std::chrono::microseconds elapsed = std::chrono::microseconds(0);
+		double filesPerSecond = 0.0;
+	};
+
+private:
+	static const quint32 magic = 0x4e50494c;
+	static const quint32 version = 1;
+	//serialized size without the strings and the thumbnail
+	static const qint64 minEntryBytes = 48;
+	static const qint64 minStreamBytes = 32;
+
+	std::vector<Entry> entryList;
+
+	static int thumbnail(AVFormatContext* fc, int index, int width, QByteArray* jpeg);
+
+public:
+	LibraryScanner() = default;
+	LibraryScanner(const LibraryScanner&) = delete;
+	LibraryScanner& operator=(const LibraryScanner&) = delete;
+
+	//0 on success, a missing index is an empty library
+	int load(const QString& indexPath);
+	int save(const QString& indexPath) const;
+	void clear(void) { entryList.clear(); }
+
+	//blocks until every media file under folder is in the index
+	Stats scan(const QString& folder, const Options& opt);
+	const std::vector<Entry>& entries(void) const { return entryList; }
+
+	//thread safe, fills everything but size and mtime
+	static int probe(const QString& path, const Options& opt, Entry* entry);
+	static bool isMediaFile(const QString& path);
+};
@@ -0,0 +1,118 @@
+#include "LoopCache.h"
+#include <cstring>
+
+using namespace std;
+
+LoopCache::~LoopCache()
+{
+	clear();
+}
+
+void LoopCache::reset(size_t budgetBytes)
+{
+	clear();
+	budget = budgetBytes;
+	framesFit = true;
+	packetsFit = true;
+}
+
+void LoopCache::clear(void)
+{
+	dropFrames();
+	dropPackets();
+}
+
+void LoopCache::dropFrames(void)
+{
+	for (auto& f : frameList) {
+		av_freep(&f.data);
+	}
+	for (auto& s : samplesList) {
+		av_freep(&s.data);
+	}
+	frameList.clear();
+	samplesList.clear();
+	frameBytes = 0;
+	framesFit = false;
+}
+
+void LoopCache::dropPackets(void)
+{
+	for (auto& p : packetList) {
+		av_packet_free(&p);
+	}
+	packetList.clear();
+	packetBytes = 0;
+	packetsFit = false;
+}
+
+void LoopCache::addFrame(const uint8_t* data, int linesize, int size, int width, int height,
+	std::chrono::microseconds pts, std::chrono::microseconds duration)
+{
+	if (!framesFit) {
+		return;
+	}
+	if (frameBytes + packetBytes + size > budget) {
+		//the packets are much smaller, keep them as the fallback
+		dropFrames();
+		return;
+	}
+
+	Frame f;
+	f.data = (uint8_t*)av_malloc(size);
+	if (!f.data) {
+		dropFrames();
+		return;
+	}
+	memcpy(f.data, data, size);
+	f.linesize = linesize;
+	f.size = size;
+	f.width = width;
+	f.height = height;
+	f.pts = pts;
+	f.duration = duration;
+	frameList.push_back(f);
+	frameBytes += size;
+}
+
+void LoopCache::addSamples(const uint8_t* data, int size, std::chrono::microseconds pts)
+{
+	if (!framesFit) {
+		return;
+	}
+	if (frameBytes + packetBytes + size > budget) {
+		dropFrames();
+		return;
+	}
+
+	Samples s;
+	s.data = (uint8_t*)av_malloc(size);
+	if (!s.data) {
+		dropFrames();
+		return;
+	}
+	memcpy(s.data, data, size);
+	s.size = size;
+	s.pts = pts;
+	samplesList.push_back(s);
+	frameBytes += size;
+}
+
+void LoopCache::addPacket(const AVPacket* pkt)
+{
+	if (!packetsFit) {
+		return;
+	}
+	if (packetBytes + pkt->size > budget) {
+		dropPackets();
+		return;
+	}
+
+	auto p = av_packet_clone(pkt);
+	if (!p) {
+		dropPackets();
+		return;
+	}
+	packetList.push_back(p);
+	packetBytes += pkt->size;
+}
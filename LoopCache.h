@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include "FFmpegHeader.h"
+
+//memory-budgeted copy of one A-B loop segment.
+//the first pass over the segment stores the converted video frames and
+//audio samples, and the demuxed packets as a fallback. whatever exceeds
+//the budget is dropped as a whole: without frames the segment is
+//replayed by decoding the cached packets, without packets by seeking.
+class LoopCache final
+{
+public:
+	struct Frame {
+		uint8_t* data = nullptr;
+		int linesize = 0;
+		int size = 0;
+		int width = 0;
+		int height = 0;
+		std::chrono::microseconds pts;
+		std::chrono::microseconds duration;
+	};
+
+	struct Samples {
+		uint8_t* data = nullptr;
+		int size = 0;
+		std::chrono::microseconds pts;
+	};
+
+private:
+	size_t budget = 0;
+	size_t frameBytes = 0;
+	size_t packetBytes = 0;
+	bool framesFit = true;
+	bool packetsFit = true;
+	std::vector<Frame> frameList;
+	std::vector<Samples> samplesList;
+	std::vector<AVPacket*> packetList;
+
+public:
+	LoopCache() = default;
+	~LoopCache();
+	LoopCache(const LoopCache&) = delete;
+	LoopCache& operator=(const LoopCache&) = delete;
+
+	void reset(size_t budgetBytes);
+	void clear(void);
+	void dropFrames(void);
+	void dropPackets(void);
+
+	//copy into the cache, ignored once the budget is exceeded
+	void addFrame(const uint8_t* data, int linesize, int size, int width, int height,
+		std::chrono::microseconds pts, std::chrono::microseconds duration);
+	void addSamples(const uint8_t* data, int size, std::chrono::microseconds pts);
+	void addPacket(const AVPacket* pkt);
+
+	//the complete segment is cached
+	bool hasFrames(void) const { return framesFit && (frameList.size() || samplesList.size()); }
+	bool hasPackets(void) const { return packetsFit && packetList.size(); }
+
+	size_t frameCount(void) const { return frameList.size(); }
+	const Frame& frame(size_t i) const { return frameList[i]; }
+	size_t samplesCount(void) const { return samplesList.size(); }
+	const Samples& samples(size_t i) const { return samplesList[i]; }
+	size_t packetCount(void) const { return packetList.size(); }
+	const AVPacket* packet(size_t i) const { return packetList[i]; }
+	size_t memoryUsage(void) const { return frameBytes + packetBytes; }
+};
@@ -0,0 +1,169 @@
+#include "LoopbackAudioSink.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "SyncProbe.h"
+#include "ThreadPolicy.h"
+
+using namespace std;
+
+LoopbackAudioSink::LoopbackAudioSink(int rate, int channelCount, std::chrono::microseconds bufferTime)
+{
+	sampleRate = rate;
+	channels = channelCount;
+	setBufferTime(bufferTime);
+}
+
+LoopbackAudioSink::~LoopbackAudioSink()
+{
+	stop();
+}
+
+void LoopbackAudioSink::setBufferTime(std::chrono::microseconds t)
+{
+	if (t.count() <= 0) {
+		t = chrono::milliseconds(20);
+	}
+	bufferBytes = t.count() * sampleRate / 1000000 * frameBytes();
+	period = t / 4;
+}
+
+void LoopbackAudioSink::start(NemoAudioDevice* dev)
+{
+	stop();
+	device = dev;
+	halt = false;
+	level = 0;
+	playing = false;
+	bytesPerSecond = (double)sampleRate * frameBytes() * (1.0 + skew / 1e6);
+	quietSamples = sampleRate;
+	thread = std::thread(playThread, this);
+}
+
+void LoopbackAudioSink::stop(void)
+{
+	halt = true;
+	if (thread.joinable()) {
+		thread.join();
+	}
+	clock->release(PlaybackClock::Source::SOURCE_AUDIO);
+}
+
+std::chrono::microseconds LoopbackAudioSink::latency(void) const
+{
+	//counted in samples at the nominal rate, as a sound card does
+	auto buffered = chrono::microseconds(level / frameBytes() * 1000000 / sampleRate);
+	if (suspended) {
+		return buffered;
+	}
+
+	//played since the last refill
+	auto now = clock->now().time_since_epoch();
+	auto elapsed = chrono::duration_cast<chrono::microseconds>(now - chrono::steady_clock::duration(levelTime.load()));
+	auto played = chrono::microseconds((int64_t)(elapsed.count() * (1.0 + skew / 1e6)));
+	return max(chrono::microseconds(0), buffered - played);
+}
+
+void LoopbackAudioSink::playThread(LoopbackAudioSink* sink)
+{
+	//stands in for the audio backend thread
+	ThreadPolicy::instance()->apply(NemoThreadPool::Priority::PRIORITY_AUDIO);
+	vector<char> tmp(sink->bufferBytes);
+	double bytesPerSecond = sink->bytesPerSecond;
+	//part of a frame played, carried so a skew is exact
+	double carry = 0.0;
+	PlaybackClock* clock = sink->clock;
+	auto last = clock->now();
+	auto next = last + sink->period;
+	//nothing to play before the first read
+	bool starved = true;
+
+	while (!sink->halt) {
+		if (clock->isVirtual() && sink->level == 0) {
+			//a drained buffer must not stop the clock, wait for data in real time
+			clock->release(PlaybackClock::Source::SOURCE_AUDIO);
+			this_thread::sleep_for(chrono::milliseconds(1));
+			next = clock->now();
+		}
+		else {
+			clock->sleepUntil(next);
+			if (clock->now() < next) {
+				//a virtual clock wakes up early to check halt
+				continue;
+			}
+		}
+		auto now = clock->now();
+		next += sink->period;
+
+		if (sink->suspended) {
+			//paused backends keep their buffer
+			clock->release(PlaybackClock::Source::SOURCE_AUDIO);
+			last = now;
+			continue;
+		}
+
+		auto elapsed = chrono::duration_cast<chrono::microseconds>(now - last);
+		last = now;
+		double exact = elapsed.count() * bytesPerSecond / 1e6 + carry;
+		int64_t played = (int64_t)exact;
+		played -= played % sink->frameBytes();
+		carry = exact - played;
+
+		int64_t level = sink->level;
+		if (played > level) {
+			//count each drained episode once
+			if (!starved) {
+				sink->underrunCount++;
+			}
+			starved = true;
+			if (sink->playing) {
+				sink->write(nullptr, played - level);
+			}
+			level = 0;
+		}
+		else {
+			level -= played;
+		}
+
+		auto n = sink->device->read(tmp.data(), sink->bufferBytes - level);
+		if (n > 0) {
+			starved = false;
+			//new samples play after what is still buffered
+			auto audible = now + chrono::microseconds((int64_t)(level * 1e6 / bytesPerSecond));
+			sink->detectClicks(tmp.data(), n, audible);
+			sink->write(tmp.data(), n);
+			sink->playing = true;
+			level += n;
+		}
+		sink->level = level;
+		sink->levelTime = now.time_since_epoch().count();
+		if (level > 0) {
+			//a virtual clock may run until the buffer drains
+			clock->hold(PlaybackClock::Source::SOURCE_AUDIO,
+				now + chrono::microseconds((int64_t)(level * 1e6 / bytesPerSecond)));
+		}
+	}
+}
+
+void LoopbackAudioSink::detectClicks(const char* data, int64_t size, std::chrono::steady_clock::time_point audible)
+{
+	if (!probe) {
+		return;
+	}
+
+	auto samples = (const float*)data;
+	int64_t count = size / frameBytes();
+	for (int64_t i = 0; i < count; i++) {
+		//first channel, onset after at least 100 ms of silence
+		float v = fabsf(samples[i * channels]);
+		if (v >= 0.3f) {
+			if (quietSamples >= sampleRate / 10) {
+				probe->onClick(audible + chrono::microseconds(i * 1000000 / sampleRate));
+			}
+			quietSamples = 0;
+		}
+		else if (v < 0.05f) {
+			quietSamples++;
+		}
+	}
+}
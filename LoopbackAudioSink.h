@@ -0,0 +1,75 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "NemoAudioDevice.h"
+#include "PlaybackClock.h"
+#include "AudioOutput.h"
+
+//the null audio output, for headless runs and benchmarks.
+//a thread pulls interleaved float samples from a NemoAudioDevice into a
+//fixed buffer once per period and plays them in real time, so it knows
+//when every sample becomes audible. on a virtual clock it holds the
+//clock at the end of its buffer and refills as soon as it drains.
+class LoopbackAudioSink : public AudioOutput
+{
+private:
+	NemoAudioDevice* device = nullptr;
+	int64_t bufferBytes = 0;
+	std::chrono::microseconds period;
+	SyncProbe* probe = nullptr;
+	PlaybackClock* clock = PlaybackClock::steady();
+	//played bytes per second of the clock, off by the skew
+	double bytesPerSecond = 0.0;
+	double skew = 0.0;
+
+	std::thread thread;
+	std::atomic<bool> halt{ false };
+	std::atomic<bool> suspended{ false };
+	//bytes buffered at levelTime, the end of the last refill
+	std::atomic<int64_t> level{ 0 };
+	std::atomic<int64_t> levelTime{ 0 };
+	std::atomic<int64_t> underrunCount{ 0 };
+	//samples since the last loud one, for click detection
+	int64_t quietSamples = 0;
+	//a buffer that ran dry after the first samples plays silence
+	bool playing = false;
+
+	static void playThread(LoopbackAudioSink* sink);
+	int frameBytes(void) const { return channels * (int)sizeof(float); }
+	void detectClicks(const char* data, int64_t size, std::chrono::steady_clock::time_point audible);
+
+protected:
+	int sampleRate = 48000;
+	int channels = 2;
+
+	//play thread, every sample in the order it is played. data is
+	//nullptr for silence played while the buffer was drained
+	virtual void write(const char* data, int64_t size) {}
+
+public:
+	//4 periods per buffer, like most pull backends
+	LoopbackAudioSink(int sampleRate, int channels, std::chrono::microseconds bufferTime);
+	~LoopbackAudioSink();
+	LoopbackAudioSink(const LoopbackAudioSink&) = delete;
+	LoopbackAudioSink& operator=(const LoopbackAudioSink&) = delete;
+
+	Backend backend(void) const override { return Backend::BACKEND_NULL; }
+	int channelCount(void) const override { return channels; }
+	void setProbe(SyncProbe* p) override { probe = p; }
+	void setClock(PlaybackClock* c) override { clock = c; }
+	void setRateSkew(double ppm) override { skew = ppm; }
+	//0 takes 20 ms, there is no backend default
+	void setBufferTime(std::chrono::microseconds t) override;
+
+	void start(NemoAudioDevice* dev) override;
+	void stop(void) override;
+	void suspend(void) override { suspended = true; }
+	void resume(void) override { suspended = false; }
+
+	int64_t bufferSize(void) const override { return bufferBytes; }
+	std::chrono::microseconds latency(void) const override;
+	//periods that found the buffer drained
+	int64_t underruns(void) const override { return underrunCount; }
+};
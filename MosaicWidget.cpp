@@ -0,0 +1,599 @@
+#include "MosaicWidget.h"
+#include "ScreenWidget.h"
+#include <cmath>
+#include <QTimer>
+
+using namespace std;
+
+int MosaicWidget::openTile(Tile* tile)
+{
+	int ret = 0;
+
+	if ((ret = avformat_open_input(&tile->formatContext, tile->path.toStdString().c_str(), NULL, NULL)) < 0) {
+		qDebug("mosaic: cannot open %s", tile->path.toStdString().c_str());
+		return ret;
+	}
+
+	if ((ret = avformat_find_stream_info(tile->formatContext, NULL)) < 0) {
+		qDebug("mosaic: avformat_find_stream_info error");
+		return ret;
+	}
+
+	ret = av_find_best_stream(
+		tile->formatContext, AVMediaType::AVMEDIA_TYPE_VIDEO,
+		-1, -1, NULL, 0);
+	if (ret < 0) {
+		qDebug("mosaic: no video in %s", tile->path.toStdString().c_str());
+		return ret;
+	}
+	tile->streamIndex = ret;
+
+	//tiles are video only, let the demuxer skip everything else
+	for (unsigned int i = 0; i < tile->formatContext->nb_streams; i++) {
+		if ((int)i != tile->streamIndex) {
+			tile->formatContext->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+
+	ret = ScreenWidget::openCodexContext(&tile->codecContext, tile->formatContext, tile->streamIndex);
+	if (ret < 0) {
+		qDebug("mosaic: openCodexContext error");
+		return ret;
+	}
+
+	tile->packet = av_packet_alloc();
+	tile->frame = av_frame_alloc();
+	if (!tile->packet || !tile->frame) {
+		qDebug("mosaic: alloc error");
+		return AVERROR(ENOMEM);
+	}
+
+	return 0;
+}
+
+void MosaicWidget::freeTile(Tile* tile)
+{
+	while (tile->frameList.size()) {
+		auto it = tile->frameList.begin();
+		av_freep(&(it->data[0]));
+		tile->frameList.pop_front();
+	}
+
+	if (tile->frame)
+		av_frame_free(&tile->frame);
+	if (tile->packet)
+		av_packet_free(&tile->packet);
+	tile->scalers.clear();
+	if (tile->codecContext)
+		avcodec_free_context(&tile->codecContext);
+	if (tile->formatContext)
+		avformat_close_input(&tile->formatContext);
+}
+
+void MosaicWidget::updateLayout(void)
+{
+	int count = (int)tiles.size();
+	if (count == 0) {
+		return;
+	}
+
+	columns = (int)ceil(sqrt((double)count));
+	rows = (count + columns - 1) / columns;
+
+	auto ratio = devicePixelRatio();
+	layerWidth = max(1, (int)(width() * ratio) / columns);
+	layerHeight = max(1, (int)(height() * ratio) / rows);
+
+	for (auto& tile : tiles) {
+		tile->dstWidth = layerWidth;
+		tile->dstHeight = layerHeight;
+	}
+}
+
+void MosaicWidget::allocTextureArray(void)
+{
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8,
+		layerWidth, layerHeight, max(1, (int)tiles.size()),
+		0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+	//layer content is undefined until the next upload
+	for (auto& tile : tiles) {
+		tile->uploadWidth = 0;
+		tile->uploadHeight = 0;
+	}
+}
+
+void MosaicWidget::scheduleTile(Tile* tile)
+{
+	if (tile->halt) {
+		return;
+	}
+
+	bool expected = false;
+	if (tile->scheduled.compare_exchange_strong(expected, true)) {
+		NemoThreadPool::instance()->post(NemoThreadPool::Priority::PRIORITY_NORMAL, [this, tile]() {
+			decodeTask(this, tile);
+		});
+	}
+}
+
+void MosaicWidget::presentTile(int index, std::chrono::steady_clock::time_point now)
+{
+	auto tile = tiles[index].get();
+	TileFrame show;
+	bool found = false;
+	size_t depth = 0;
+
+	tile->frameLock.lock();
+	if (tile->frameList.size() && !tile->started) {
+		tile->started = true;
+		tile->startTimeStamp = now;
+		tile->firstPts = tile->frameList.front().pts;
+	}
+	if (tile->started) {
+		auto current = tile->firstPts +
+			chrono::duration_cast<chrono::microseconds>(now - tile->startTimeStamp);
+
+		//show the newest due frame, frames it overtakes are dropped
+		while (tile->frameList.size() && tile->frameList.front().pts <= current) {
+			if (found) {
+				av_freep(&show.data[0]);
+				tile->droppedFrames++;
+			}
+			show = tile->frameList.front();
+			tile->frameList.pop_front();
+			found = true;
+		}
+	}
+	depth = tile->frameList.size();
+	tile->frameLock.unlock();
+
+	if (found) {
+		//frames converted before a resize may not fit the layer
+		if (show.width <= layerWidth && show.height <= layerHeight) {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, index,
+				show.width, show.height, 1, GL_RGB, GL_UNSIGNED_BYTE, show.data[0]);
+			tile->uploadWidth = show.width;
+			tile->uploadHeight = show.height;
+			tile->presentedFrames++;
+		}
+		else {
+			tile->droppedFrames++;
+		}
+		av_freep(&show.data[0]);
+	}
+
+	if ((int)depth < tilePreload) {
+		scheduleTile(tile);
+	}
+}
+
+void MosaicWidget::initShaderScript(void)
+{
+	stringstream vs, fs;
+
+	vs << "#version 330 core" << endl
+		<< "layout(location = 0) in vec2 aPos;" << endl
+		<< "out vec2 optTexCoord;" << endl
+		<< "flat out int optLayer;" << endl
+		<< "uniform int columns;" << endl
+		<< "uniform int rows;" << endl
+		<< "uniform vec2 tileScale[" << maxTiles << "];" << endl
+		<< "void main()" << endl
+		<< "{" << endl
+		<< "int col = gl_InstanceID % columns;" << endl
+		<< "int row = gl_InstanceID / columns;" << endl
+		<< "vec2 cell = vec2(2.0 / float(columns), 2.0 / float(rows));" << endl
+		<< "gl_Position = vec4(-1.0 + (float(col) + aPos.x) * cell.x," << endl
+		<< "	1.0 - (float(row) + aPos.y) * cell.y, 0.0, 1.0);" << endl
+		<< "optTexCoord = aPos * tileScale[gl_InstanceID];" << endl
+		<< "optLayer = gl_InstanceID;" << endl
+		<< "}" << endl;
+	vsCode = vs.str();
+
+	fs << "#version 330 core" << endl
+		<< "in vec2 optTexCoord;" << endl
+		<< "flat in int optLayer;" << endl
+		<< "out vec4 FragColor;" << endl
+		<< "uniform sampler2DArray textures;" << endl
+		<< "void main()" << endl
+		<< "{" << endl
+		<< "FragColor = texture(textures, vec3(optTexCoord, float(optLayer)));" << endl
+		<< "}" << endl;
+	fsCode = fs.str();
+}
+
+bool MosaicWidget::createProgram(void)
+{
+	initShaderScript();
+
+	const char* vertexShaderSource = vsCode.c_str();
+	const char* fragmentShaderSource = fsCode.c_str();
+	int  success = 0;
+	char infoLog[512] = { '\0' };
+
+	auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+	glCompileShader(vertexShader);
+	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+		qDebug("ERROR::mosaic vertexShader::COMPILATION_FAILED");
+		qDebug(infoLog);
+		return false;
+	}
+
+	auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+	glCompileShader(fragmentShader);
+	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+		qDebug("ERROR::mosaic fragmentShader::COMPILATION_FAILED");
+		qDebug(infoLog);
+		return false;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(program, 512, NULL, infoLog);
+		qDebug("ERROR::mosaic shaderProgram::FAILED");
+		qDebug(infoLog);
+		return false;
+	}
+
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	return true;
+}
+
+void MosaicWidget::decodeTask(MosaicWidget* mosaic, Tile* tile)
+{
+	int ret = 0;
+
+	if (!tile->halt) {
+		tile->decodeLock.lock();
+		auto t0 = chrono::steady_clock::now();
+		ret = decodeFrame(tile);
+		if (ret > 0) {
+			tile->decodedFrames++;
+			tile->decodeTime += chrono::duration_cast<chrono::microseconds>(
+				chrono::steady_clock::now() - t0).count();
+		}
+		tile->decodeLock.unlock();
+	}
+
+	if (ret < 0) {
+		qDebug("mosaic: stop decoding %s", tile->path.toStdString().c_str());
+		tile->halt = true;
+	}
+
+	tile->frameLock.lock();
+	int depth = (int)tile->frameList.size();
+	tile->frameLock.unlock();
+
+	//re-post to the back of the queue so every tile gets its turn
+	if (!tile->halt && depth < mosaic->tilePreload) {
+		NemoThreadPool::instance()->post(NemoThreadPool::Priority::PRIORITY_NORMAL, [mosaic, tile]() {
+			decodeTask(mosaic, tile);
+		});
+	}
+	else {
+		//last access to the tile, closeFiles may release it now. notified
+		//under the lock, closeFiles can destroy the widget right after
+		lock_guard<mutex> guard(mosaic->taskLock);
+		tile->scheduled = false;
+		mosaic->taskCV.notify_all();
+	}
+}
+
+int MosaicWidget::decodeFrame(Tile* tile)
+{
+	int ret = 0;
+	auto stream = tile->formatContext->streams[tile->streamIndex];
+	auto frame = tile->frame;
+	int64_t loopFrames = -1;
+
+	for (;;) {
+		ret = avcodec_receive_frame(tile->codecContext, frame);
+		if (ret == 0) {
+			break;
+		}
+		else if (ret == AVERROR_EOF) {
+			//loop the file, pts keep increasing across loops
+			if (loopFrames == tile->decodedFrames) {
+				return AVERROR_EOF;
+			}
+			loopFrames = tile->decodedFrames;
+
+			int64_t start = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+			tile->loopOffset = tile->lastEnd - ScreenWidget::ts_to_microsecond(start, stream->time_base);
+			av_seek_frame(tile->formatContext, tile->streamIndex, start, AVSEEK_FLAG_BACKWARD);
+			avcodec_flush_buffers(tile->codecContext);
+			continue;
+		}
+		else if (ret != AVERROR(EAGAIN)) {
+			qDebug("mosaic: avcodec_receive_frame error");
+			return -1;
+		}
+
+		//decoder wants more input
+		ret = av_read_frame(tile->formatContext, tile->packet);
+		if (ret == AVERROR_EOF) {
+			//drain the decoder
+			avcodec_send_packet(tile->codecContext, NULL);
+			continue;
+		}
+		else if (ret < 0) {
+			return ret;
+		}
+
+		if (tile->packet->stream_index == tile->streamIndex) {
+			ret = avcodec_send_packet(tile->codecContext, tile->packet);
+		}
+		av_packet_unref(tile->packet);
+		if (ret < 0) {
+			qDebug("mosaic: avcodec_send_packet error");
+			return -1;
+		}
+	}
+
+	TileFrame data;
+	data.width = frame->width;
+	data.height = frame->height;
+	if (tile->dstWidth > 0 && tile->dstWidth < data.width) {
+		data.width = tile->dstWidth;
+	}
+	if (tile->dstHeight > 0 && tile->dstHeight < data.height) {
+		data.height = tile->dstHeight;
+	}
+
+	//conversion runs at tile resolution, not source resolution
+	auto sws_ctx = tile->scalers.get(ScalerCache::frameKey(frame,
+		data.width, data.height, AVPixelFormat::AV_PIX_FMT_RGB24));
+	if (!sws_ctx) {
+		av_frame_unref(frame);
+		qDebug("mosaic: sws_getContext error");
+		return -1;
+	}
+
+	if (av_image_alloc(data.data, data.linesize,
+		data.width, data.height, AVPixelFormat::AV_PIX_FMT_RGB24, 1) < 0) {
+		av_frame_unref(frame);
+		qDebug("mosaic: av_image_alloc error");
+		return -1;
+	}
+
+	sws_scale(sws_ctx, (const uint8_t* const*)frame->data,
+		frame->linesize, 0, frame->height, data.data, data.linesize);
+
+	if (frame->best_effort_timestamp == AV_NOPTS_VALUE) {
+		data.pts = tile->lastEnd;
+	}
+	else {
+		data.pts = tile->loopOffset +
+			ScreenWidget::ts_to_microsecond(frame->best_effort_timestamp, stream->time_base);
+	}
+	data.duration = ScreenWidget::ts_to_microsecond(frame->pkt_duration, stream->time_base);
+	tile->lastEnd = data.pts + data.duration;
+
+	av_frame_unref(frame);
+
+	tile->frameLock.lock();
+	tile->frameList.push_back(data);
+	tile->frameLock.unlock();
+
+	return 1;
+}
+
+void MosaicWidget::initializeGL(void)
+{
+	initializeOpenGLFunctions();
+
+	createProgram();
+
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
+
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	// rgb24 rows are packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glGenTextures(1, &textureArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "textures"), 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	updateLayout();
+	allocTextureArray();
+
+	qDebug("MosaicWidget::initializeGL done");
+}
+
+void MosaicWidget::resizeGL(int w, int h)
+{
+	qDebug("mosaic resizeGL: w=%d, h=%d", w, h);
+	updateLayout();
+	allocTextureArray();
+}
+
+void MosaicWidget::paintGL(void)
+{
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	if (tiles.size() == 0) {
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+
+	auto now = chrono::steady_clock::now();
+	float scale[maxTiles * 2] = { 0.0f };
+	for (int i = 0; i < (int)tiles.size(); i++) {
+		presentTile(i, now);
+		scale[i * 2] = (float)tiles[i]->uploadWidth / layerWidth;
+		scale[i * 2 + 1] = (float)tiles[i]->uploadHeight / layerHeight;
+	}
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "columns"), columns);
+	glUniform1i(glGetUniformLocation(program, "rows"), rows);
+	glUniform2fv(glGetUniformLocation(program, "tileScale"), (GLsizei)tiles.size(), scale);
+
+	//every tile in one draw
+	glBindVertexArray(VAO);
+	glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, (GLsizei)tiles.size());
+	glBindVertexArray(0);
+}
+
+MosaicWidget::MosaicWidget(QWidget* parent) : QOpenGLWidget(parent)
+{
+	//repaint on every swap, tiles pick their due frame in paintGL
+	connect(this, &QOpenGLWidget::frameSwapped, this, QOverload<>::of(&QWidget::update));
+
+	auto timer = new QTimer(this);
+	connect(timer, &QTimer::timeout, this, &MosaicWidget::dumpStats);
+	timer->start(5000);
+}
+
+MosaicWidget::~MosaicWidget()
+{
+	closeFiles();
+	if (program) {
+		makeCurrent();
+		glDeleteTextures(1, &textureArray);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		glDeleteProgram(program);
+		doneCurrent();
+	}
+}
+
+std::vector<MosaicWidget::TileStats> MosaicWidget::tileStats(void)
+{
+	vector<TileStats> ret;
+
+	for (auto& tile : tiles) {
+		TileStats s;
+		s.path = tile->path;
+		s.frameWidth = tile->uploadWidth;
+		s.frameHeight = tile->uploadHeight;
+		tile->frameLock.lock();
+		s.queueDepth = (int)tile->frameList.size();
+		tile->frameLock.unlock();
+		s.decodedFrames = tile->decodedFrames;
+		s.presentedFrames = tile->presentedFrames;
+		s.droppedFrames = tile->droppedFrames;
+		if (s.decodedFrames > 0) {
+			s.avgDecodeTime = chrono::microseconds(tile->decodeTime / s.decodedFrames);
+		}
+		ret.push_back(s);
+	}
+
+	return ret;
+}
+
+void MosaicWidget::openFiles(QStringList paths)
+{
+	closeFiles();
+
+	if (paths.size() > maxTiles) {
+		qDebug("mosaic: only the first %d of %d files are shown", maxTiles, (int)paths.size());
+		paths = paths.mid(0, maxTiles);
+	}
+
+	for (auto& path : paths) {
+		auto tile = make_unique<Tile>();
+		tile->path = path;
+		if (openTile(tile.get()) < 0) {
+			freeTile(tile.get());
+			continue;
+		}
+		tiles.push_back(std::move(tile));
+	}
+
+	if (context()) {
+		makeCurrent();
+		updateLayout();
+		allocTextureArray();
+		doneCurrent();
+	}
+
+	for (auto& tile : tiles) {
+		scheduleTile(tile.get());
+	}
+	update();
+}
+
+void MosaicWidget::closeFiles(void)
+{
+	if (tiles.size() == 0) {
+		return;
+	}
+
+	for (auto& tile : tiles) {
+		tile->halt = true;
+	}
+
+	//wait for the decode chains, a halted tile is not re-posted
+	for (auto& tile : tiles) {
+		unique_lock<mutex> guard(taskLock);
+		taskCV.wait(guard, [&tile]() { return !tile->scheduled; });
+		guard.unlock();
+		freeTile(tile.get());
+	}
+	tiles.clear();
+
+	update();
+}
+
+void MosaicWidget::dumpStats(void)
+{
+	auto stats = tileStats();
+	if (stats.size() == 0) {
+		return;
+	}
+
+	auto poolStats = NemoThreadPool::instance()->stats();
+	qDebug("mosaic: %d tiles, %d threads, %d queued decode tasks, %lld steals",
+		(int)stats.size(), poolStats.threadBudget,
+		(int)poolStats.queueDepth[(int)NemoThreadPool::Priority::PRIORITY_NORMAL],
+		(long long)poolStats.stolenTasks);
+	for (auto& s : stats) {
+		qDebug(" %s %dx%d decoded=%lld presented=%lld dropped=%lld queue=%d decode=%lldus",
+			s.path.toStdString().c_str(), s.frameWidth, s.frameHeight,
+			(long long)s.decodedFrames, (long long)s.presentedFrames,
+			(long long)s.droppedFrames, s.queueDepth,
+			(long long)s.avgDecodeTime.count());
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <QWidget>
+#include <QStringList>
+#include <QOpenGLWidget>
+#include <QOpenGLFunctions_3_3_Core>
+#include "NemoThreadPool.h"
+#include "ScalerCache.h"
+#include "FFmpegHeader.h"
+
+//plays many video files in one widget.
+//every stream is decoded and scaled to its tile size on the shared
+//NemoThreadPool, frames are uploaded into one layer of a texture array
+//and all tiles are drawn with a single instanced draw call.
+class MosaicWidget final :
+	public QOpenGLWidget,
+	protected QOpenGLFunctions_3_3_Core
+{
+	Q_OBJECT
+public:
+	//must match the uniform array size in the vertex shader
+	static constexpr int maxTiles = 64;
+
+	struct TileStats {
+		QString path;
+		int frameWidth = 0;
+		int frameHeight = 0;
+		int queueDepth = 0;
+		int64_t decodedFrames = 0;
+		int64_t presentedFrames = 0;
+		int64_t droppedFrames = 0;
+		std::chrono::microseconds avgDecodeTime = std::chrono::microseconds(0);
+	};
+
+private:
+	struct TileFrame {
+		uint8_t* data[4] = { NULL };
+		int linesize[4] = { 0 };
+		int width = 0;
+		int height = 0;
+		std::chrono::microseconds pts;
+		std::chrono::microseconds duration;
+	};
+
+	struct Tile {
+		QString path;
+		//held by the worker which is decoding this tile
+		std::mutex decodeLock;
+		AVFormatContext* formatContext = nullptr;
+		AVCodecContext* codecContext = nullptr;
+		AVPacket* packet = nullptr;
+		AVFrame* frame = nullptr;
+		//a resize changes the target size, keep the previous one around
+		ScalerCache scalers{ 2 };
+		int streamIndex = -1;
+		//added to pts after the file loops
+		std::chrono::microseconds loopOffset = std::chrono::microseconds(0);
+		std::chrono::microseconds lastEnd = std::chrono::microseconds(0);
+
+		//target conversion size, written by the GUI thread on resize
+		std::atomic<int> dstWidth{ 0 };
+		std::atomic<int> dstHeight{ 0 };
+		std::atomic<bool> scheduled{ false };
+		std::atomic<bool> halt{ false };
+
+		std::mutex frameLock;
+		std::list<TileFrame> frameList;
+
+		//presentation clock, GUI thread only
+		bool started = false;
+		std::chrono::steady_clock::time_point startTimeStamp;
+		std::chrono::microseconds firstPts = std::chrono::microseconds(0);
+		int uploadWidth = 0;
+		int uploadHeight = 0;
+
+		std::atomic<int64_t> decodedFrames{ 0 };
+		std::atomic<int64_t> decodeTime{ 0 };
+		int64_t presentedFrames = 0;
+		int64_t droppedFrames = 0;
+	};
+
+	std::vector<std::unique_ptr<Tile>> tiles;
+	//a decode chain clears Tile::scheduled under taskLock, closeFiles waits on taskCV
+	std::mutex taskLock;
+	std::condition_variable taskCV;
+	int tilePreload = 4;
+	int columns = 1;
+	int rows = 1;
+	int layerWidth = 0;
+	int layerHeight = 0;
+
+	GLuint VBO = 0;
+	GLuint VAO = 0;
+	GLuint EBO = 0;
+	std::string vsCode, fsCode;
+	GLuint program = 0;
+	GLuint textureArray = 0;
+
+	//unit quad, tile placement is done in the vertex shader
+	float vertices[8] = {
+		1.0f, 0.0f,	// right-top
+		1.0f, 1.0f,	// right-bottom
+		0.0f, 1.0f,	// left-bottom
+		0.0f, 0.0f	// left-top
+	};
+
+	unsigned int indices[6] = {
+		0, 1, 3,	//first
+		1, 2, 3	//second
+	};
+
+private:
+	int openTile(Tile* tile);
+	static void freeTile(Tile* tile);
+	void updateLayout(void);
+	void allocTextureArray(void);
+	void scheduleTile(Tile* tile);
+	void presentTile(int index, std::chrono::steady_clock::time_point now);
+	void initShaderScript(void);
+	bool createProgram(void);
+
+	//pool task: decode one frame of a tile then re-post itself
+	static void decodeTask(MosaicWidget* mosaic, Tile* tile);
+	static int decodeFrame(Tile* tile);
+
+protected:
+	void initializeGL(void) override;
+	void resizeGL(int w, int h) override;
+	void paintGL(void) override;
+
+public:
+	MosaicWidget() = delete;
+	explicit MosaicWidget(QWidget* parent);
+	~MosaicWidget();
+
+	std::vector<TileStats> tileStats(void);
+
+public slots:
+	void openFiles(QStringList paths);
+	void closeFiles(void);
+	void dumpStats(void);
+};
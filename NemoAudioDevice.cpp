@@ -2,6 +2,7 @@
 
 qint64 NemoAudioDevice::bytesAvailable(void) const
 {
+	std::lock_guard<std::mutex> guard(lock);
 	return buffer.size() + QIODevice::bytesAvailable();
 }
 
@@ -17,14 +18,28 @@ bool NemoAudioDevice::canReadLine(void) const
 
 qint64 NemoAudioDevice::readData(char* data, qint64 maxSize)
 {
+	std::lock_guard<std::mutex> guard(lock);
+
+	qint64 size = maxSize < buffer.size() ? maxSize : buffer.size();
+	if (size == 0) {
+		//count each empty period once
+		if (!starved && maxSize > 0) {
+			starved = true;
+			underrunCount++;
+		}
+		return 0;
+	}
+	starved = false;
+
 	auto ptr = buffer.constData();
-	memcpy_s(data, maxSize, ptr, maxSize);
-	buffer.remove(0, maxSize);
-	return maxSize;
+	memcpy_s(data, maxSize, ptr, size);
+	buffer.remove(0, size);
+	return size;
 }
 
 qint64 NemoAudioDevice::writeData(const char* data, qint64 maxSize)
 {
+	std::lock_guard<std::mutex> guard(lock);
 	buffer.append(data, maxSize);
 	return maxSize;
 }
@@ -42,5 +57,19 @@ NemoAudioDevice::NemoAudioDevice(QObject* parent) : QIODevice(parent)
 
 void NemoAudioDevice::clear(void)
 {
+	std::lock_guard<std::mutex> guard(lock);
 	buffer.clear();
+	starved = false;
+}
+
+qint64 NemoAudioDevice::level(void) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return buffer.size();
+}
+
+int64_t NemoAudioDevice::underruns(void) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return underrunCount;
 }
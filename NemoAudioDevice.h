@@ -1,4 +1,5 @@
 #pragma once
+#include <mutex>
 #include <QIODevice>
 #include <QByteArray>
 
@@ -6,7 +7,11 @@ class NemoAudioDevice final : public QIODevice
 {
 	Q_OBJECT
 private:
+	//written by the GUI thread, read by the audio backend
+	mutable std::mutex lock;
 	QByteArray buffer;
+	bool starved = false;
+	int64_t underrunCount = 0;
 
 public:
 	NemoAudioDevice() = delete;
@@ -23,5 +28,9 @@ public:
 	qint64 writeData(const char* data, qint64 maxSize);
 
 	void clear(void);
+	//bytes waiting for the sink
+	qint64 level(void) const;
+	//times the sink found the buffer empty
+	int64_t underruns(void) const;
 };
 
@@ -0,0 +1,106 @@
+#pragma once
+
+//command line tools and benchmarks, run from main before the GUI starts.
+//each returns the process exit code.
+
+//--bench-audio [seconds]: underruns and latency for a range of sink buffer
+//sizes. a LoopbackAudioSink pulls from NemoAudioDevice in real time
+//while a producer thread feeds it the way readTask does.
+int audioLatencyBench(int seconds);
+
+//--bench-meter [seconds]: cost of the audio meters for stereo and 7.1.
+//a producer thread taps decoder sized chunks the way audioTask does,
+//the analysis runs at 60 Hz. load is analysis time per second of audio.
+int audioMeterBench(int seconds);
+
+//--bench-sync [seconds]: A/V offset and frame pacing of the player itself.
+//a headless ScreenWidget plays a generated clip with a white flash and a
+//1 kHz click once per second, SyncProbe pairs them. fails when the
+//median offset is out of +-45 ms or more than 1% of the frames are skipped.
+//--audio-output null, wav:<path> or raw:<path> and --video-output
+//null or offscreen[:<w>x<h>] pick the outputs, null by default.
+//--audio-skew <ppm> runs the audio output that much fast to check the
+//drift compensation, it then fails when the offset leaves +-5 ms after
+//the first 10 measured seconds, so give it 20 s or more. --no-drift turns
+//the compensation off for comparison.
+int avSyncBench(int argc, char** argv, int seconds);
+
+//--soak <file> [--realtime] [--audio-output <spec>] [--video-output <spec>]:
+//plays a file headless on a virtual clock that advances as fast as frames
+//and audio come out of the pipeline, then reports the speed against real
+//time, late frames and underruns. --realtime runs the same on the real
+//clock for comparison, wav:<path> keeps the audio that was played and
+//offscreen renders every frame as the window would. --audio-skew and
+//--no-drift as for --bench-sync, a virtual clock soak covers a day of
+//drift in far less time and fails on the same offset limit.
+int soakRun(int argc, char** argv);
+
+//--scan <folder> [index] [jobs]: probe every media file under folder into
+//the library index (default <folder>/.nemo-library), unchanged files
+//are taken from the existing index.
+int libraryScan(int argc, char** argv);
+
+//--bench-scan [files]: scanner throughput on a generated corpus of short
+//mpeg4 clips, for 1, 2, 4 ... workers up to the core count, then an
+//incremental rescan.
+int libraryScanBench(int argc, char** argv, int files);
+
+//--frame-client <name> [seconds]: reference reader of the frame server.
+//attaches read-only, follows the newest frame and prints the frame rate,
+//publish-to-read latency, missed and torn frames and a motion score.
+//runs until stopped when seconds is 0.
+int frameClient(int argc, char** argv);
+
+//--bench-frames [seconds]: frame server throughput for 720p, 1080p and
+//4K yuv420p published as fast as possible, with a reader that keeps up
+//and one that holds every frame for 100 ms. the publish time must not
+//depend on the readers.
+int frameServerBench(int seconds);
+
+//--bench-render [seconds]: the window's render path without a window.
+//720p, 1080p and 4K RGB frames with the meter overlay go through an
+//offscreen GL 3.3 context as fast as possible; prints frames per second
+//and the upload and draw times, fails when the rendered picture is wrong
+//or there is no GL. LIBGL_ALWAYS_SOFTWARE=1 runs on Mesa's llvmpipe.
+int renderBench(int argc, char** argv, int seconds);
+
+//--bench-scrub [seconds]: target-to-display latency of slider scrubbing.
+//a headless ScreenWidget gets a synthetic drag over a generated clip with
+//long GOPs, 60 targets a second with a rest every second. prints how many
+//targets were coalesced or canceled and the latency of the keyframe
+//preview and of the exact frame, fails when no rest was refined.
+int scrubBench(int argc, char** argv, int seconds);
+
+//--bench-quality [seconds] [--no-governor]: the quality governor under
+//CPU pressure. a headless ScreenWidget plays a generated 1080p25 H.264
+//clip with B-frames in real time, idle for seconds, then with twice as
+//many spinning threads as cores, then idle again. prints late frames and
+//the quality level every second, fails unless the level drops under the
+//load and is back at full at the end.
+int qualityBench(int argc, char** argv, int seconds);
+
+//--bench-stream [seconds] [--delay ms] [--jitter ms] [--drop-every ms]
+//[--burst ms] [--low-latency]: network playback against an in-process
+//HTTP server. the server plays a generated MPEG-TS clip out in real time
+//as a live source, adds a fixed delay and a random delay of up to jitter
+//to every write, sends the last burst ms at once on the first connection and
+//resets the connection every drop-every ms. a headless ScreenWidget plays
+//it for seconds; fails on underruns beyond the resets, a burst that was
+//not caught up, missing reconnects or too few frames.
+int streamBench(int argc, char** argv, int seconds);
+
+//--bench-export [seconds]: stream-copy clip export of generated 60 s
+//clips with a keyframe every 10 s, mpeg4 and H.264 with B-frames when an
+//encoder is there. exports 15-45 s on the calling thread at each boundary
+//and checks where the clip starts, what it holds and that every packet
+//decodes, an exact start that falls back to the keyframe fails. then
+//exports the whole clip in the background while a headless ScreenWidget
+//plays for seconds. prints the speed of every export and the late frames
+//of the playback, fails on a wrong clip. open GOPs are not generated.
+int exportBench(int argc, char** argv, int seconds);
+
+//--bench-probe: opens generated mkv, mp4 and avi clips with B-frames once
+//probed and twice through a fresh probe cache. fails when a cached open
+//does not give the stream start times, durations and first packet
+//timestamps of the probed one, or when the cache takes the avi.
+int probeCacheBench(int argc, char** argv);
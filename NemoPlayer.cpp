@@ -1,6 +1,9 @@
 #include "NemoPlayer.h"
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QInputDialog>
+#include "MosaicWidget.h"
+#include "TraceRecorder.h"
 
 NemoPlayer::NemoPlayer(QWidget *parent)
     : QMainWindow(parent)
@@ -8,9 +11,35 @@ NemoPlayer::NemoPlayer(QWidget *parent)
     ui.setupUi(this);
 	connect(ui.actionDecodeOption, &QAction::triggered, this, &NemoPlayer::onDecodeOptionAction);
 	connect(ui.actionOpen, &QAction::triggered, this, &NemoPlayer::onOpenFileAction);
+	connect(ui.actionOpenUrl, &QAction::triggered, this, &NemoPlayer::onOpenUrlAction);
+	connect(ui.actionOpenMosaic, &QAction::triggered, this, &NemoPlayer::onOpenMosaicAction);
+	connect(ui.actionLowLatency, &QAction::triggered, this, &NemoPlayer::onLowLatencyAction);
+	connect(ui.actionAudioLatency, &QAction::triggered, this, &NemoPlayer::onAudioLatencyAction);
+	connect(ui.actionAudioOutput, &QAction::triggered, this, &NemoPlayer::onAudioOutputAction);
+	connect(ui.actionVideoOutput, &QAction::triggered, this, &NemoPlayer::onVideoOutputAction);
+	connect(ui.actionSelectTrack, &QAction::triggered, this, &NemoPlayer::onSelectTrackAction);
+	connect(ui.actionVideoFilter, &QAction::triggered, this, &NemoPlayer::onVideoFilterAction);
+	connect(ui.actionFrameServer, &QAction::triggered, this, &NemoPlayer::onFrameServerAction);
+	connect(ui.actionAudioMeters, &QAction::triggered, ui.screen, &ScreenWidget::setAudioMeters);
+	connect(ui.actionMatchRate, &QAction::triggered, ui.screen, &ScreenWidget::setRateMatching);
+	connect(ui.actionDriftCompensation, &QAction::triggered, ui.screen, &ScreenWidget::setDriftCompensation);
+	connect(ui.actionAdaptiveQuality, &QAction::triggered, ui.screen, &ScreenWidget::setAdaptiveQuality);
+	connect(ui.actionRecordTrace, &QAction::triggered, this, &NemoPlayer::onRecordTraceAction);
+	connect(ui.actionDumpTrace, &QAction::triggered, this, &NemoPlayer::onDumpTraceAction);
+	ui.actionRecordTrace->setChecked(TraceRecorder::instance()->isEnabled());
 	connect(ui.actionTest, &QAction::triggered, ui.screen, &ScreenWidget::test);
 	connect(ui.playButton, &QPushButton::clicked, this, &NemoPlayer::onPlayButtonClicked);
+	connect(ui.actionLoop, &QAction::triggered, this, &NemoPlayer::onLoopAction);
+	connect(ui.actionExportClip, &QAction::triggered, this, &NemoPlayer::onExportClipAction);
+	connect(ui.screen, &ScreenWidget::exportFinished, this, &NemoPlayer::onExportFinished);
 	connect(ui.actionClose, &QAction::triggered, this, &NemoPlayer::onCloseAction);
+	//the slider is in ms, dragging it scrubs
+	connect(ui.playerSlider, &QSlider::sliderPressed, ui.screen, &ScreenWidget::beginScrub);
+	connect(ui.playerSlider, &QSlider::sliderMoved, ui.screen, &ScreenWidget::scrubTo);
+	connect(ui.playerSlider, &QSlider::sliderReleased, ui.screen, &ScreenWidget::endScrub);
+	positionTimer = new QTimer(this);
+	connect(positionTimer, &QTimer::timeout, this, &NemoPlayer::onPositionTimer);
+	positionTimer->start(200);
 
 	qDebug("ScreenWidget::ScreenWidget");
 	AVHWDeviceType type = AVHWDeviceType::AV_HWDEVICE_TYPE_NONE;
@@ -45,6 +74,250 @@ void NemoPlayer::onOpenFileAction(bool checked)
 	}
 }
 
+void NemoPlayer::onOpenUrlAction(bool checked)
+{
+	QString url = QInputDialog::getText(this, "open url", "http / hls / rtsp url:");
+	if (url.length() > 0) {
+		ui.screen->openFile(url);
+		this->setWindowTitle("NemoPlayer -> " + url);
+	}
+}
+
+void NemoPlayer::onLowLatencyAction(bool checked)
+{
+	ui.screen->setStreamPreset(checked ?
+		JitterBuffer::Preset::PRESET_LOW_LATENCY : JitterBuffer::Preset::PRESET_SMOOTH);
+}
+
+void NemoPlayer::onAudioLatencyAction(bool checked)
+{
+	bool ok = false;
+	int ms = QInputDialog::getInt(this, "audio latency",
+		"output latency in ms, 0 for the backend default:", audioLatency, 0, 1000, 10, &ok);
+	if (ok) {
+		audioLatency = ms;
+		ui.screen->setAudioLatency(ms);
+	}
+}
+
+void NemoPlayer::setAudioOutput(const QString& spec)
+{
+	audioOutput = spec;
+	ui.screen->setAudioOutput(spec);
+}
+
+void NemoPlayer::onAudioOutputAction(bool checked)
+{
+	QStringList backends = { "qt", "null", "wav", "raw" };
+	int current = qMax(0, (int)backends.indexOf(audioOutput.section(':', 0, 0)));
+	bool ok = false;
+	QString backend = QInputDialog::getItem(this, "audio output",
+		"qt plays on the sound card, null and the files on a timer:", backends, current, false, &ok);
+	if (!ok) {
+		return;
+	}
+	if (backend == "wav" || backend == "raw") {
+		QString path = QFileDialog::getSaveFileName(this, "audio file");
+		if (path.isEmpty()) {
+			return;
+		}
+		backend += ":" + path;
+	}
+	setAudioOutput(backend);
+}
+
+void NemoPlayer::setVideoOutput(const QString& spec)
+{
+	videoOutput = spec;
+	ui.screen->setVideoOutput(spec);
+}
+
+void NemoPlayer::onVideoOutputAction(bool checked)
+{
+	bool ok = false;
+	QString spec = QInputDialog::getText(this, "video output",
+		"widget, null or offscreen[:<w>x<h>], the window is black while it is not widget:",
+		QLineEdit::Normal, videoOutput, &ok);
+	if (ok && spec.trimmed().size()) {
+		setVideoOutput(spec.trimmed());
+	}
+}
+
+void NemoPlayer::onSelectTrackAction(bool checked)
+{
+	auto list = ui.screen->tracks();
+	if (list.empty()) {
+		QMessageBox::information(this, "select track", "no file is open", QMessageBox::StandardButton::Ok);
+		return;
+	}
+
+	QStringList items;
+	int current = 0;
+	for (auto& t : list) {
+		QString item = QString("#%1 %2 %3").arg(t.index)
+			.arg(t.type == AVMediaType::AVMEDIA_TYPE_VIDEO ? "video" : "audio").arg(t.codec);
+		if (t.language.size()) {
+			item += " [" + t.language + "]";
+		}
+		if (t.title.size()) {
+			item += " " + t.title;
+		}
+		if (t.selected) {
+			item += " *";
+			current = items.size();
+		}
+		items.push_back(item);
+	}
+
+	bool ok = false;
+	QString item = QInputDialog::getItem(this, "select track", "track:", items, current, false, &ok);
+	int i = items.indexOf(item);
+	if (ok && i >= 0) {
+		ui.screen->selectTrack(list[i].index);
+	}
+}
+
+void NemoPlayer::onVideoFilterAction(bool checked)
+{
+	bool ok = false;
+	QString chain = QInputDialog::getText(this, "video filter",
+		"filter chain, e.g. bwdif,hqdn3d,crop=iw-16:ih-16. empty to disable:",
+		QLineEdit::Normal, videoFilter, &ok);
+	if (ok) {
+		videoFilter = chain.trimmed();
+		ui.screen->setVideoFilter(videoFilter);
+	}
+}
+
+void NemoPlayer::onFrameServerAction(bool checked)
+{
+	if (!checked) {
+		ui.screen->setFrameServer(QString(), true);
+		return;
+	}
+
+	bool ok = false;
+	QString name = QInputDialog::getText(this, "frame server",
+		"shared memory name, readers attach with --frame-client <name>:",
+		QLineEdit::Normal, frameServerName, &ok);
+	QStringList formats = { "decoded", "rgb24" };
+	QString format;
+	if (ok && name.trimmed().size()) {
+		format = QInputDialog::getItem(this, "frame server", "format:", formats, 0, false, &ok);
+	}
+	if (!ok || name.trimmed().isEmpty()) {
+		ui.actionFrameServer->setChecked(false);
+		return;
+	}
+	frameServerName = name.trimmed();
+	ui.screen->setFrameServer(frameServerName, format == formats[0]);
+}
+
+void NemoPlayer::onRecordTraceAction(bool checked)
+{
+	TraceRecorder::instance()->setEnabled(checked);
+}
+
+void NemoPlayer::onDumpTraceAction(bool checked)
+{
+	QString path = QFileDialog::getSaveFileName(this, "save trace");
+	if (path.length() == 0) {
+		return;
+	}
+	if (TraceRecorder::instance()->dump(path.toStdString()) < 0) {
+		QMessageBox::critical(this, "error", "cannot write trace file", QMessageBox::Ok);
+	}
+}
+
+void NemoPlayer::onOpenMosaicAction(bool checked)
+{
+	QStringList paths = QFileDialog::getOpenFileNames(this);
+	if (paths.size() == 0) {
+		QMessageBox::information(this, "File info", "no file selected.", QMessageBox::StandardButton::Ok);
+		return;
+	}
+
+	auto mosaic = new MosaicWidget(nullptr);
+	mosaic->setAttribute(Qt::WA_DeleteOnClose);
+	mosaic->setWindowTitle("NemoPlayer mosaic -> " + QString::number(paths.size()) + " files");
+	mosaic->resize(1280, 720);
+	mosaic->show();
+	mosaic->openFiles(paths);
+}
+
+void NemoPlayer::onLoopAction(bool checked)
+{
+	QString text = QInputDialog::getText(this, "A-B loop", "start-end in seconds, empty to clear:");
+	QStringList list = text.split('-');
+	if (list.size() != 2) {
+		loopRange.clear();
+		ui.screen->clearLoop();
+		return;
+	}
+
+	bool ok1 = false, ok2 = false;
+	double a = list[0].trimmed().toDouble(&ok1);
+	double b = list[1].trimmed().toDouble(&ok2);
+	if (!ok1 || !ok2 || b <= a || a < 0) {
+		QMessageBox::information(this, "A-B loop", "invalid range", QMessageBox::StandardButton::Ok);
+		return;
+	}
+	loopRange = text.trimmed();
+	ui.screen->setLoop((qint64)(a * 1000), (qint64)(b * 1000));
+}
+
+void NemoPlayer::onExportClipAction(bool checked)
+{
+	QString text = QInputDialog::getText(this, "export clip",
+		"start-end in seconds, -n for the last n seconds:", QLineEdit::Normal,
+		loopRange.isEmpty() ? "-30" : loopRange).trimmed();
+	if (text.isEmpty()) {
+		return;
+	}
+
+	bool ok1 = false, ok2 = false;
+	double a = 0, b = 0;
+	if (text.startsWith("-")) {
+		//up to what is on screen
+		double n = text.mid(1).toDouble(&ok1);
+		b = ui.screen->playbackStats().position.count() / 1e6;
+		a = std::max(0.0, b - n);
+		ok2 = n > 0;
+	}
+	else {
+		QStringList list = text.split('-');
+		if (list.size() == 2) {
+			a = list[0].trimmed().toDouble(&ok1);
+			b = list[1].trimmed().toDouble(&ok2);
+		}
+	}
+	if (!ok1 || !ok2 || b <= a || a < 0) {
+		QMessageBox::information(this, "export clip", "invalid range", QMessageBox::StandardButton::Ok);
+		return;
+	}
+
+	QString path = QFileDialog::getSaveFileName(this, "export clip");
+	if (path.isEmpty()) {
+		return;
+	}
+	ui.screen->exportClip(path, (qint64)(a * 1000), (qint64)(b * 1000), ui.actionExactExport->isChecked());
+}
+
+void NemoPlayer::onExportFinished(QString path, int error)
+{
+	if (error < 0) {
+		QMessageBox::information(this, "export clip", path + " failed: " + QString::number(error),
+			QMessageBox::StandardButton::Ok);
+		return;
+	}
+	auto st = ui.screen->exportStatistics();
+	QMessageBox::information(this, "export clip",
+		QString("%1\n%2 - %3 s, %4x real time").arg(path)
+		.arg(st.clipStart.count() / 1e6, 0, 'f', 2).arg(st.clipEnd.count() / 1e6, 0, 'f', 2)
+		.arg(st.speed, 0, 'f', 1),
+		QMessageBox::StandardButton::Ok);
+}
+
 void NemoPlayer::onCloseAction(bool checked)
 {
 	ui.screen->closeFile();
@@ -76,3 +349,14 @@ void NemoPlayer::onPlayButtonClicked(bool checked)
 		status = PlayerStatus::PLAYER_STATUS_PAUSE;
 	}
 }
+
+void NemoPlayer::onPositionTimer(void)
+{
+	if (ui.playerSlider->isSliderDown()) {
+		//the user holds it
+		return;
+	}
+	auto duration = ui.screen->duration();
+	ui.playerSlider->setRange(0, (int)(duration.count() / 1000));
+	ui.playerSlider->setValue((int)(ui.screen->playbackStats().position.count() / 1000));
+}
@@ -23,6 +23,17 @@ private:
 	std::list<AVHWDeviceType> decodeOptions;
 	AVHWDeviceType deviceType = AVHWDeviceType::AV_HWDEVICE_TYPE_NONE;
 	PlayerStatus status = PlayerStatus::PLAYER_STATUS_PAUSE;
+	int audioLatency = 0;
+	//AudioOutput spec
+	QString audioOutput = "qt";
+	//VideoOutput spec
+	QString videoOutput = "widget";
+	QString videoFilter;
+	QString frameServerName = "nemoplayer-frames";
+	//moves the slider with the playback
+	QTimer* positionTimer = nullptr;
+	//the A-B loop as typed, offered as the clip range
+	QString loopRange;
 	
 
 public:
@@ -37,13 +48,33 @@ public:
 		return deviceType;
 	}
 
+	//"qt", "null", "wav:<path>" or "raw:<path>"
+	void setAudioOutput(const QString& spec);
+	//"widget", "null" or "offscreen[:<w>x<h>]"
+	void setVideoOutput(const QString& spec);
+
 signals:
 	
 
 public slots:
 	void onDecodeOptionAction(bool checked);
 	void onOpenFileAction(bool checked);
+	void onOpenUrlAction(bool checked);
+	void onOpenMosaicAction(bool checked);
+	void onLowLatencyAction(bool checked);
+	void onAudioLatencyAction(bool checked);
+	void onAudioOutputAction(bool checked);
+	void onVideoOutputAction(bool checked);
+	void onSelectTrackAction(bool checked);
+	void onVideoFilterAction(bool checked);
+	void onFrameServerAction(bool checked);
+	void onRecordTraceAction(bool checked);
+	void onDumpTraceAction(bool checked);
+	void onLoopAction(bool checked);
+	void onExportClipAction(bool checked);
+	void onExportFinished(QString path, int error);
 	void onCloseAction(bool checked);
 	void onSetDeviceType(AVHWDeviceType type);
 	void onPlayButtonClicked(bool checked);
+	void onPositionTimer(void);
 };
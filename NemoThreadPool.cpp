@@ -0,0 +1,269 @@
+#include "NemoThreadPool.h"
+#include "TraceRecorder.h"
+#include "ThreadPolicy.h"
+
+using namespace std;
+
+//set for pool worker threads so posts from a task stay on the same worker
+static thread_local NemoThreadPool* currentPool = nullptr;
+static thread_local int currentWorker = -1;
+
+void NemoThreadPool::workerThread(NemoThreadPool* pool, int index)
+{
+	currentPool = pool;
+	currentWorker = index;
+	auto worker = pool->workers[index].get();
+	TraceRecorder::instance()->setThreadName("pool worker " + to_string(index));
+	auto policy = ThreadPolicy::instance();
+
+	for (;;) {
+		if (worker->retired) {
+			break;
+		}
+
+		function<void()> task;
+		Priority p = Priority::PRIORITY_NORMAL;
+		if (pool->popTask(index, &task, &p)) {
+			//OS priority follows the class of the task
+			policy->apply(p);
+			task();
+			pool->executedTasks++;
+			continue;
+		}
+
+		if (pool->halt) {
+			break;
+		}
+
+		unique_lock<mutex> guard(pool->sleepLock);
+		pool->sleepCV.wait(guard, [pool, worker]() {
+			return pool->halt || worker->retired || pool->pendingTasks > 0;
+		});
+	}
+}
+
+void NemoThreadPool::timerThread(NemoThreadPool* pool)
+{
+	//releases the audio and presentation tasks on time
+	ThreadPolicy::instance()->apply(Priority::PRIORITY_AUDIO);
+	unique_lock<mutex> guard(pool->timerLock);
+
+	while (!pool->halt) {
+		if (pool->delayedList.size() == 0) {
+			pool->timerCV.wait(guard);
+			continue;
+		}
+
+		auto it = pool->delayedList.begin();
+		if (it->first <= chrono::steady_clock::now()) {
+			auto p = it->second.priority;
+			auto task = std::move(it->second.task);
+			pool->delayedList.erase(it);
+			guard.unlock();
+			pool->post(p, std::move(task));
+			guard.lock();
+		}
+		else {
+			pool->timerCV.wait_until(guard, it->first);
+		}
+	}
+}
+
+bool NemoThreadPool::popTask(int index, std::function<void()>* task, Priority* priority)
+{
+	int count = (int)workers.size();
+
+	//highest priority first, own queue before the others
+	for (int p = 0; p < priorityCount; p++) {
+		for (int i = 0; i < count; i++) {
+			auto worker = workers[(index + i) % count].get();
+			lock_guard<mutex> guard(worker->lock);
+			if (worker->taskList[p].size()) {
+				*task = std::move(worker->taskList[p].front());
+				worker->taskList[p].pop_front();
+				*priority = (Priority)p;
+				pendingTasks--;
+				if (i > 0) {
+					stolenTasks++;
+				}
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void NemoThreadPool::push(int index, Priority p, std::function<void()> task)
+{
+	auto worker = workers[index].get();
+
+	//counted before it is visible so a thief never drives the count below zero
+	sleepLock.lock();
+	pendingTasks++;
+	sleepLock.unlock();
+
+	worker->lock.lock();
+	worker->taskList[(int)p].push_back(std::move(task));
+	worker->lock.unlock();
+	sleepCV.notify_one();
+}
+
+NemoThreadPool::NemoThreadPool(int threadBudget)
+{
+	int cores = (int)thread::hardware_concurrency();
+	if (cores < 1) {
+		cores = 1;
+	}
+
+	for (int i = 0; i < cores; i++) {
+		workers.push_back(make_unique<Worker>());
+	}
+
+	timer = thread(timerThread, this);
+	setThreadBudget(threadBudget <= 0 ? cores : threadBudget);
+}
+
+NemoThreadPool::~NemoThreadPool()
+{
+	sleepLock.lock();
+	timerLock.lock();
+	halt = true;
+	timerLock.unlock();
+	sleepLock.unlock();
+	sleepCV.notify_all();
+	timerCV.notify_all();
+
+	timer.join();
+	for (auto& worker : workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+	}
+}
+
+NemoThreadPool* NemoThreadPool::instance(void)
+{
+	static NemoThreadPool pool;
+	return &pool;
+}
+
+void NemoThreadPool::post(Priority p, std::function<void()> task)
+{
+	int index = 0;
+
+	if (currentPool == this && currentWorker >= 0) {
+		index = currentWorker;
+	}
+	else {
+		index = (int)(nextWorker++ % (unsigned int)budget);
+	}
+
+	push(index, p, std::move(task));
+}
+
+void NemoThreadPool::postDelayed(Priority p, std::chrono::microseconds delay,
+	std::function<void()> task, const CancelToken* token)
+{
+	if (delay.count() <= 0) {
+		post(p, std::move(task));
+		return;
+	}
+
+	//checked under timerLock, so either expedite sees the task
+	//or the task sees the canceled token
+	timerLock.lock();
+	if (token && token->isCanceled()) {
+		timerLock.unlock();
+		post(p, std::move(task));
+		return;
+	}
+	DelayedTask t = { p, std::move(task), token ? token->id() : nullptr };
+	delayedList.emplace(chrono::steady_clock::now() + delay, std::move(t));
+	timerLock.unlock();
+	timerCV.notify_one();
+}
+
+void NemoThreadPool::expedite(const CancelToken& token)
+{
+	vector<DelayedTask> list;
+
+	timerLock.lock();
+	for (auto it = delayedList.begin(); it != delayedList.end();) {
+		if (it->second.tag == token.id()) {
+			list.push_back(std::move(it->second));
+			it = delayedList.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+	timerLock.unlock();
+
+	for (auto& t : list) {
+		post(t.priority, std::move(t.task));
+	}
+}
+
+void NemoThreadPool::setThreadBudget(int threadBudget)
+{
+	lock_guard<mutex> guard(budgetLock);
+
+	int count = (int)workers.size();
+	if (threadBudget < 1) {
+		threadBudget = 1;
+	}
+	if (threadBudget > count) {
+		threadBudget = count;
+	}
+
+	int old = budget;
+	if (threadBudget < old) {
+		//retired workers leave after their current task,
+		//whatever is left in their queues gets stolen
+		budget = threadBudget;
+		for (int i = threadBudget; i < old; i++) {
+			workers[i]->retired = true;
+		}
+		sleepLock.lock();
+		sleepLock.unlock();
+		sleepCV.notify_all();
+	}
+	else if (threadBudget > old) {
+		for (int i = old; i < threadBudget; i++) {
+			auto worker = workers[i].get();
+			if (worker->thread.joinable()) {
+				worker->thread.join();
+			}
+			worker->retired = false;
+			worker->thread = thread(workerThread, this, i);
+		}
+		budget = threadBudget;
+	}
+}
+
+int NemoThreadPool::threadBudget(void) const
+{
+	return budget;
+}
+
+NemoThreadPool::Stats NemoThreadPool::stats(void)
+{
+	Stats ret;
+	ret.threadBudget = budget;
+	ret.executedTasks = executedTasks;
+	ret.stolenTasks = stolenTasks;
+
+	for (auto& worker : workers) {
+		lock_guard<mutex> guard(worker->lock);
+		for (int p = 0; p < priorityCount; p++) {
+			ret.queueDepth[p] += worker->taskList[p].size();
+		}
+	}
+
+	timerLock.lock();
+	ret.delayedTasks = delayedList.size();
+	timerLock.unlock();
+
+	return ret;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <functional>
+#include <deque>
+#include <map>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+//process-wide work-stealing pool for all player work.
+//every worker owns one queue per priority class. a worker runs the
+//highest priority task it can find, first in its own queues and then
+//by stealing from the other workers, so audio and presentation work
+//overtakes decode and background jobs at the next task boundary.
+//tasks are taken from the front of a queue, so jobs that re-post
+//themselves after each unit of work are scheduled round-robin.
+class NemoThreadPool final
+{
+public:
+	enum class Priority {
+		PRIORITY_AUDIO,
+		PRIORITY_PRESENTATION,
+		//demux, decode, convert
+		PRIORITY_NORMAL,
+		//thumbnailing, probing, scanning
+		PRIORITY_BACKGROUND,
+		PRIORITY_COUNT
+	};
+
+	static constexpr int priorityCount = (int)Priority::PRIORITY_COUNT;
+
+	//shared cancellation flag for the tasks of one owner.
+	//copies share the same flag.
+	class CancelToken {
+	private:
+		std::shared_ptr<std::atomic<bool>> flag;
+
+	public:
+		CancelToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+		void cancel(void) { *flag = true; }
+		bool isCanceled(void) const { return *flag; }
+		const void* id(void) const { return flag.get(); }
+	};
+
+	struct Stats {
+		int threadBudget = 0;
+		size_t queueDepth[priorityCount] = { 0 };
+		size_t delayedTasks = 0;
+		int64_t executedTasks = 0;
+		int64_t stolenTasks = 0;
+	};
+
+private:
+	struct Worker {
+		std::mutex lock;
+		std::deque<std::function<void()>> taskList[priorityCount];
+		std::thread thread;
+		std::atomic<bool> retired{ true };
+	};
+
+	//one slot per core, threads above the budget are retired
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex budgetLock;
+	std::atomic<int> budget{ 0 };
+	std::atomic<unsigned int> nextWorker{ 0 };
+	std::atomic<int64_t> executedTasks{ 0 };
+	std::atomic<int64_t> stolenTasks{ 0 };
+
+	//workers sleep here while every queue is empty
+	std::mutex sleepLock;
+	std::condition_variable sleepCV;
+	std::atomic<size_t> pendingTasks{ 0 };
+	std::atomic<bool> halt{ false };
+
+	//tasks waiting for their start time, moved into the queues by timerThread
+	std::mutex timerLock;
+	std::condition_variable timerCV;
+	struct DelayedTask {
+		Priority priority;
+		std::function<void()> task;
+		//CancelToken::id of the owner, may be null
+		const void* tag;
+	};
+	std::multimap<std::chrono::steady_clock::time_point, DelayedTask> delayedList;
+	std::thread timer;
+
+	static void workerThread(NemoThreadPool* pool, int index);
+	static void timerThread(NemoThreadPool* pool);
+	bool popTask(int index, std::function<void()>* task, Priority* p);
+	void push(int index, Priority p, std::function<void()> task);
+
+public:
+	//threadBudget <= 0 means one thread per core
+	explicit NemoThreadPool(int threadBudget = 0);
+	~NemoThreadPool();
+	NemoThreadPool(const NemoThreadPool&) = delete;
+	NemoThreadPool& operator=(const NemoThreadPool&) = delete;
+
+	static NemoThreadPool* instance(void);
+
+	void post(Priority p, std::function<void()> task);
+	//a task posted with a token runs immediately once the token is canceled
+	void postDelayed(Priority p, std::chrono::microseconds delay,
+		std::function<void()> task, const CancelToken* token = nullptr);
+	//run the delayed tasks of a canceled token now
+	void expedite(const CancelToken& token);
+
+	//number of worker threads, clamped to [1, core count]
+	void setThreadBudget(int threadBudget);
+	int threadBudget(void) const;
+	Stats stats(void);
+};
@@ -0,0 +1,18 @@
+#include "NullVideoOutput.h"
+
+using namespace std;
+
+void NullVideoOutput::present(const Frame& f)
+{
+	if (presentations.size() >= maxPresentations) {
+		presentations.pop_front();
+	}
+	presentations.push_back({ f.pts, f.presentTime });
+	st.frames++;
+	st.bytes += (int64_t)f.width * f.height * 3;
+}
+
+std::vector<NullVideoOutput::Presentation> NullVideoOutput::history(void) const
+{
+	return vector<Presentation>(presentations.begin(), presentations.end());
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include "VideoOutput.h"
+
+//draws nothing, keeps the presentation time of every frame so a run
+//without any GL can still be checked for cadence and drops
+class NullVideoOutput final : public VideoOutput
+{
+public:
+	struct Presentation {
+		int64_t pts;
+		std::chrono::steady_clock::time_point presentTime;
+	};
+
+	//about 5 hours at 60 fps
+	static const size_t maxPresentations = (size_t)1 << 20;
+
+private:
+	std::deque<Presentation> presentations;
+
+public:
+	Backend backend(void) const override { return Backend::BACKEND_NULL; }
+	void present(const Frame& f) override;
+	void clear(void) override {}
+
+	//oldest first, the oldest are dropped beyond maxPresentations
+	std::vector<Presentation> history(void) const;
+};
@@ -0,0 +1,111 @@
+#include "OffscreenVideoOutput.h"
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QSurfaceFormat>
+
+using namespace std;
+
+OffscreenVideoOutput::OffscreenVideoOutput(int w, int h)
+{
+	width = w;
+	height = h;
+}
+
+OffscreenVideoOutput::~OffscreenVideoOutput()
+{
+	if (context && surface && context->makeCurrent(surface)) {
+		renderer.release();
+		delete fbo;
+		fbo = nullptr;
+		context->doneCurrent();
+	}
+	delete context;
+	delete surface;
+}
+
+int OffscreenVideoOutput::create(void)
+{
+	//the shaders of the widget need 3.3 core
+	QSurfaceFormat format;
+	format.setVersion(3, 3);
+	format.setProfile(QSurfaceFormat::CoreProfile);
+
+	context = new QOpenGLContext;
+	context->setFormat(format);
+	if (!context->create()) {
+		qDebug("offscreen output: no GL 3.3 context");
+		return -1;
+	}
+	surface = new QOffscreenSurface;
+	surface->setFormat(context->format());
+	surface->create();
+	if (!surface->isValid() || !context->makeCurrent(surface)) {
+		qDebug("offscreen output: no offscreen surface");
+		return -1;
+	}
+
+	bool ok = renderer.initialize() && m_resize(width > 0 ? width : 16, height > 0 ? height : 16);
+	context->doneCurrent();
+	return ok ? 0 : -1;
+}
+
+bool OffscreenVideoOutput::m_resize(int w, int h)
+{
+	if (fbo && fbo->width() == w && fbo->height() == h) {
+		return true;
+	}
+	delete fbo;
+	fbo = new QOpenGLFramebufferObject(w, h);
+	return fbo->isValid();
+}
+
+void OffscreenVideoOutput::present(const Frame& f)
+{
+	st.frames++;
+	if (!context->makeCurrent(surface)) {
+		return;
+	}
+	auto gl = context->functions();
+	if (!m_resize(width > 0 ? width : f.width, height > 0 ? height : f.height)) {
+		context->doneCurrent();
+		return;
+	}
+	fbo->bind();
+	gl->glViewport(0, 0, fbo->width(), fbo->height());
+
+	//finish after each stage, the times are what the GPU spent
+	auto t0 = chrono::steady_clock::now();
+	renderer.upload(f.data, f.width, f.height);
+	gl->glFinish();
+	auto t1 = chrono::steady_clock::now();
+	renderer.paint(f.meters);
+	gl->glFinish();
+	auto t2 = chrono::steady_clock::now();
+
+	fbo->release();
+	context->doneCurrent();
+	addUpload(chrono::duration_cast<chrono::microseconds>(t1 - t0));
+	addRender(chrono::duration_cast<chrono::microseconds>(t2 - t1));
+	st.bytes += (int64_t)f.width * f.height * 3;
+}
+
+void OffscreenVideoOutput::clear(void)
+{
+	if (!context->makeCurrent(surface)) {
+		return;
+	}
+	renderer.clear();
+	context->doneCurrent();
+}
+
+QImage OffscreenVideoOutput::grab(void)
+{
+	if (!fbo || !context->makeCurrent(surface)) {
+		return QImage();
+	}
+	QImage image = fbo->toImage();
+	context->doneCurrent();
+	return image;
+}
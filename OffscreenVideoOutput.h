@@ -0,0 +1,43 @@
+#pragma once
+#include <QImage>
+#include "VideoOutput.h"
+#include "GLRenderer.h"
+
+class QOpenGLContext;
+class QOffscreenSurface;
+class QOpenGLFramebufferObject;
+
+//the widget's render path without a window: a GL 3.3 context on an
+//offscreen surface draws every frame into a framebuffer object and waits
+//for the GPU, so upload and draw times are real. runs on the offscreen
+//platform plugin, LIBGL_ALWAYS_SOFTWARE=1 uses Mesa's llvmpipe.
+class OffscreenVideoOutput final : public VideoOutput
+{
+private:
+	//0 follows the frame size
+	int width = 0;
+	int height = 0;
+	QOpenGLContext* context = nullptr;
+	QOffscreenSurface* surface = nullptr;
+	QOpenGLFramebufferObject* fbo = nullptr;
+	GLRenderer renderer;
+
+	//the framebuffer for a frame size, context current
+	bool m_resize(int w, int h);
+
+public:
+	OffscreenVideoOutput(int width, int height);
+	~OffscreenVideoOutput();
+	OffscreenVideoOutput(const OffscreenVideoOutput&) = delete;
+	OffscreenVideoOutput& operator=(const OffscreenVideoOutput&) = delete;
+
+	//context, surface and programs. 0 on success, negative without GL
+	int create(void);
+
+	Backend backend(void) const override { return Backend::BACKEND_OFFSCREEN; }
+	void present(const Frame& f) override;
+	void clear(void) override;
+
+	//the last rendered picture, for checks
+	QImage grab(void);
+};
@@ -0,0 +1,77 @@
+#include "PlaybackClock.h"
+#include <thread>
+
+using namespace std;
+
+PlaybackClock* PlaybackClock::steady(void)
+{
+	static SteadyPlaybackClock clock;
+	return &clock;
+}
+
+PlaybackClock::TimePoint SteadyPlaybackClock::now(void)
+{
+	return chrono::steady_clock::now();
+}
+
+void SteadyPlaybackClock::sleepUntil(TimePoint t)
+{
+	this_thread::sleep_until(t);
+}
+
+VirtualPlaybackClock::VirtualPlaybackClock()
+{
+	//starts at the real time so both kinds of time points look alike
+	current = chrono::steady_clock::now();
+}
+
+void VirtualPlaybackClock::m_advance(void)
+{
+	bool any = false;
+	TimePoint target;
+	for (auto& h : holds) {
+		if (h.active && (!any || h.until < target)) {
+			target = h.until;
+			any = true;
+		}
+	}
+	if (any && target > current) {
+		current = target;
+		advanceCount++;
+		cv.notify_all();
+	}
+}
+
+PlaybackClock::TimePoint VirtualPlaybackClock::now(void)
+{
+	lock_guard<mutex> guard(lock);
+	return current;
+}
+
+void VirtualPlaybackClock::hold(Source s, TimePoint until)
+{
+	lock_guard<mutex> guard(lock);
+	auto& h = holds[(int)s];
+	h.active = true;
+	h.until = until;
+	m_advance();
+}
+
+void VirtualPlaybackClock::release(Source s)
+{
+	lock_guard<mutex> guard(lock);
+	holds[(int)s].active = false;
+	m_advance();
+}
+
+void VirtualPlaybackClock::sleepUntil(TimePoint t)
+{
+	unique_lock<mutex> guard(lock);
+	cv.wait_for(guard, chrono::milliseconds(5), [this, t]() { return current >= t; });
+}
+
+int64_t VirtualPlaybackClock::advances(void)
+{
+	lock_guard<mutex> guard(lock);
+	return advanceCount;
+}
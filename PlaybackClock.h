@@ -0,0 +1,78 @@
+#pragma once
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+//time source of the playback pipeline.
+//the media clock, frame scheduling and the loopback audio sink read the
+//time from here instead of steady_clock. the real clock is the default;
+//a virtual clock lets a soak run go through a file faster than real time
+//with the same scheduling decisions.
+class PlaybackClock
+{
+public:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	//outputs that may hold a virtual clock back
+	enum class Source {
+		SOURCE_VIDEO,
+		SOURCE_AUDIO
+	};
+	static const int sourceCount = 2;
+
+	virtual ~PlaybackClock() {}
+
+	virtual TimePoint now(void) = 0;
+	virtual bool isVirtual(void) const { return false; }
+	//an output has data to play until the given time. a virtual clock
+	//never runs past the earliest hold, the real clock ignores them
+	virtual void hold(Source s, TimePoint until) {}
+	//the output has nothing buffered and must not stop the clock
+	virtual void release(Source s) {}
+	//blocks until t or a change of the clock, whichever comes first
+	virtual void sleepUntil(TimePoint t) = 0;
+
+	//shared steady_clock instance
+	static PlaybackClock* steady(void);
+};
+
+class SteadyPlaybackClock final : public PlaybackClock
+{
+public:
+	TimePoint now(void) override;
+	void sleepUntil(TimePoint t) override;
+};
+
+//advances to the earliest time among the active holds on every hold or
+//release, so the pipeline runs as fast as it produces output. an output
+//without a hold does not stop the clock, without any hold it stands still.
+class VirtualPlaybackClock final : public PlaybackClock
+{
+private:
+	struct Hold {
+		bool active = false;
+		TimePoint until;
+	};
+
+	std::mutex lock;
+	std::condition_variable cv;
+	TimePoint current;
+	Hold holds[sourceCount];
+	int64_t advanceCount = 0;
+
+	void m_advance(void);
+
+public:
+	VirtualPlaybackClock();
+
+	TimePoint now(void) override;
+	bool isVirtual(void) const override { return true; }
+	void hold(Source s, TimePoint until) override;
+	void release(Source s) override;
+	//waits at most a few ms of real time, callers loop on their own
+	//halt flags
+	void sleepUntil(TimePoint t) override;
+
+	//jumps made so far
+	int64_t advances(void);
+};
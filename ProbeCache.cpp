@@ -0,0 +1,414 @@
+#include "ProbeCache.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDataStream>
+#include <QStandardPaths>
+
+using namespace std;
+
+namespace {
+
+struct IndexEntry {
+	qint64 pos = 0;
+	qint64 timestamp = 0;
+	qint32 size = 0;
+	qint32 distance = 0;
+};
+
+struct StreamEntry {
+	AVCodecParameters* par = nullptr;
+	AVRational avgFrameRate = { 0, 1 };
+	AVRational realFrameRate = { 0, 1 };
+	qint64 startTime = 0;
+	qint64 duration = 0;
+	qint64 frames = 0;
+	std::vector<IndexEntry> index;
+};
+
+quint64 fnv1a(const QByteArray& data)
+{
+	quint64 h = 14695981039346656037ULL;
+	for (char c : data) {
+		h ^= (quint8)c;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+QDataStream& operator<<(QDataStream& out, AVRational r)
+{
+	return out << (qint32)r.num << (qint32)r.den;
+}
+
+QDataStream& operator>>(QDataStream& in, AVRational& r)
+{
+	qint32 num = 0, den = 1;
+	in >> num >> den;
+	r = { num, den };
+	return in;
+}
+
+void writeParameters(QDataStream& out, const AVCodecParameters* par)
+{
+	out << (qint32)par->codec_type << (qint32)par->codec_id << (quint32)par->codec_tag;
+	out << QByteArray((const char*)par->extradata, par->extradata ? par->extradata_size : 0);
+	out << (qint32)par->format << (qint64)par->bit_rate;
+	out << (qint32)par->bits_per_coded_sample << (qint32)par->bits_per_raw_sample;
+	out << (qint32)par->profile << (qint32)par->level;
+	out << (qint32)par->width << (qint32)par->height << par->sample_aspect_ratio;
+	out << (qint32)par->field_order << (qint32)par->color_range << (qint32)par->color_primaries;
+	out << (qint32)par->color_trc << (qint32)par->color_space << (qint32)par->chroma_location;
+	out << (qint32)par->video_delay;
+	out << (quint64)par->channel_layout << (qint32)par->channels << (qint32)par->sample_rate;
+	out << (qint32)par->block_align << (qint32)par->frame_size;
+	out << (qint32)par->initial_padding << (qint32)par->trailing_padding << (qint32)par->seek_preroll;
+}
+
+int readParameters(QDataStream& in, AVCodecParameters* par)
+{
+	qint32 type, id, format, bitsCoded, bitsRaw, profile, level, width, height;
+	qint32 fieldOrder, range, primaries, trc, space, chroma, delay;
+	qint32 channels, sampleRate, blockAlign, frameSize, initialPadding, trailingPadding, preroll;
+	quint32 tag;
+	qint64 bitRate;
+	quint64 layout;
+	QByteArray extradata;
+	AVRational sar;
+
+	in >> type >> id >> tag >> extradata >> format >> bitRate >> bitsCoded >> bitsRaw;
+	in >> profile >> level >> width >> height >> sar;
+	in >> fieldOrder >> range >> primaries >> trc >> space >> chroma >> delay;
+	in >> layout >> channels >> sampleRate >> blockAlign >> frameSize;
+	in >> initialPadding >> trailingPadding >> preroll;
+	if (in.status() != QDataStream::Ok) {
+		return -1;
+	}
+
+	par->codec_type = (AVMediaType)type;
+	par->codec_id = (AVCodecID)id;
+	par->codec_tag = tag;
+	if (extradata.size()) {
+		par->extradata = (uint8_t*)av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+		if (!par->extradata) {
+			return AVERROR(ENOMEM);
+		}
+		memcpy(par->extradata, extradata.constData(), extradata.size());
+		par->extradata_size = (int)extradata.size();
+	}
+	par->format = format;
+	par->bit_rate = bitRate;
+	par->bits_per_coded_sample = bitsCoded;
+	par->bits_per_raw_sample = bitsRaw;
+	par->profile = profile;
+	par->level = level;
+	par->width = width;
+	par->height = height;
+	par->sample_aspect_ratio = sar;
+	par->field_order = (AVFieldOrder)fieldOrder;
+	par->color_range = (AVColorRange)range;
+	par->color_primaries = (AVColorPrimaries)primaries;
+	par->color_trc = (AVColorTransferCharacteristic)trc;
+	par->color_space = (AVColorSpace)space;
+	par->chroma_location = (AVChromaLocation)chroma;
+	par->video_delay = delay;
+	par->channel_layout = layout;
+	par->channels = channels;
+	par->sample_rate = sampleRate;
+	par->block_align = blockAlign;
+	par->frame_size = frameSize;
+	par->initial_padding = initialPadding;
+	par->trailing_padding = trailingPadding;
+	par->seek_preroll = preroll;
+	return 0;
+}
+
+//keyframe entries only, the rest is rebuilt while reading
+int keyframeCount(AVStream* st)
+{
+	int count = 0;
+	int n = avformat_index_get_entries_count(st);
+	for (int i = 0; i < n; i++) {
+		if (avformat_index_get_entry(st, i)->flags & AVINDEX_KEYFRAME) {
+			count++;
+		}
+	}
+	return count;
+}
+
+qint64 indexTotal(AVFormatContext* fc)
+{
+	qint64 total = 0;
+	for (unsigned int i = 0; i < fc->nb_streams; i++) {
+		total += keyframeCount(fc->streams[i]);
+	}
+	return total;
+}
+
+//restore() skips avformat_find_stream_info, which also sets up the parser
+//and the pts/dts guessing of the internal codec context. only demuxers
+//that take pts and the index from the header read the same without it
+bool cacheable(const AVFormatContext* fc)
+{
+	static const char* const names[] = { "mov,mp4,m4a,3gp,3g2,mj2", "matroska,webm" };
+	for (auto name : names) {
+		if (fc->iformat && strcmp(fc->iformat->name, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+}
+
+ProbeCache::ProbeCache()
+{
+	directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/probe";
+}
+
+ProbeCache* ProbeCache::instance(void)
+{
+	static ProbeCache cache;
+	return &cache;
+}
+
+void ProbeCache::setDirectory(const QString& dir)
+{
+	lock_guard<mutex> guard(lock);
+	directory = dir;
+}
+
+int ProbeCache::makeKey(const QString& path, Key* key)
+{
+	QFileInfo info(path);
+	if (!info.isFile()) {
+		return -1;
+	}
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return -1;
+	}
+
+	key->path = info.absoluteFilePath();
+	key->size = info.size();
+	key->mtime = info.lastModified().toMSecsSinceEpoch();
+	//catches rewrites that keep size and mtime
+	key->headHash = fnv1a(file.read(headSize));
+	return 0;
+}
+
+QString ProbeCache::entryPath(const QString& path)
+{
+	//one entry per media path, a changed file replaces it
+	return directory + "/" + QString::number(fnv1a(path.toUtf8()), 16) + ".probe";
+}
+
+void ProbeCache::remove(const QString& path)
+{
+	QFile::remove(entryPath(path));
+}
+
+bool ProbeCache::readHeader(QDataStream& in, const Key& key, qint64* probeUs, qint64* indexCount)
+{
+	quint32 m = 0, v = 0, lavf = 0, lavc = 0;
+	Key k;
+	in >> m >> v >> lavf >> lavc >> k.path >> k.size >> k.mtime >> k.headHash >> *probeUs >> *indexCount;
+
+	//entries written by another FFmpeg may not describe the same streams
+	return in.status() == QDataStream::Ok &&
+		m == magic && v == version &&
+		lavf == LIBAVFORMAT_VERSION_INT && lavc == LIBAVCODEC_VERSION_INT &&
+		k.path == key.path && k.size == key.size && k.mtime == key.mtime && k.headHash == key.headHash;
+}
+
+int ProbeCache::restore(const QString& path, AVFormatContext* fc)
+{
+	auto t0 = chrono::steady_clock::now();
+
+	Key key;
+	if (!cacheable(fc) || makeKey(path, &key) < 0) {
+		lock_guard<mutex> guard(lock);
+		counters.misses++;
+		return -1;
+	}
+
+	lock_guard<mutex> guard(lock);
+	QFile file(entryPath(key.path));
+	if (!file.open(QIODevice::ReadOnly)) {
+		counters.misses++;
+		return -1;
+	}
+
+	QDataStream in(&file);
+	qint64 probeUs = 0, indexCount = 0;
+	bool valid = readHeader(in, key, &probeUs, &indexCount);
+
+	qint64 startTime = 0, duration = 0, bitRate = 0;
+	quint32 streamCount = 0;
+	if (valid) {
+		in >> startTime >> duration >> bitRate >> streamCount;
+		//formats that add streams while reading have none yet
+		valid = in.status() == QDataStream::Ok && streamCount == fc->nb_streams && streamCount > 0;
+	}
+
+	//parse everything before touching the context
+	vector<StreamEntry> entryList(valid ? streamCount : 0);
+	for (size_t i = 0; valid && i < entryList.size(); i++) {
+		auto& e = entryList[i];
+		e.par = avcodec_parameters_alloc();
+		if (!e.par || readParameters(in, e.par) < 0) {
+			valid = false;
+			break;
+		}
+
+		qint32 indexSize = 0;
+		in >> e.avgFrameRate >> e.realFrameRate >> e.startTime >> e.duration >> e.frames >> indexSize;
+		if (in.status() != QDataStream::Ok || indexSize < 0) {
+			valid = false;
+			break;
+		}
+		e.index.resize(indexSize);
+		for (auto& x : e.index) {
+			in >> x.pos >> x.timestamp >> x.size >> x.distance;
+		}
+
+		//the header already names the codec of most streams
+		auto par = fc->streams[i]->codecpar;
+		if (in.status() != QDataStream::Ok ||
+			(par->codec_type != AVMediaType::AVMEDIA_TYPE_UNKNOWN && par->codec_type != e.par->codec_type) ||
+			(par->codec_id != AVCodecID::AV_CODEC_ID_NONE && par->codec_id != e.par->codec_id)) {
+			valid = false;
+		}
+	}
+
+	if (valid) {
+		fc->start_time = startTime;
+		fc->duration = duration;
+		fc->bit_rate = bitRate;
+		for (size_t i = 0; i < entryList.size(); i++) {
+			auto st = fc->streams[i];
+			auto& e = entryList[i];
+			avcodec_parameters_copy(st->codecpar, e.par);
+			st->avg_frame_rate = e.avgFrameRate;
+			st->r_frame_rate = e.realFrameRate;
+			st->start_time = e.startTime;
+			st->duration = e.duration;
+			st->nb_frames = e.frames;
+			//mp4 and friends have the index in the header already
+			if (keyframeCount(st) < (int)e.index.size()) {
+				for (auto& x : e.index) {
+					av_add_index_entry(st, x.pos, x.timestamp, x.size, x.distance, AVINDEX_KEYFRAME);
+				}
+			}
+		}
+	}
+
+	for (auto& e : entryList) {
+		avcodec_parameters_free(&e.par);
+	}
+
+	if (!valid) {
+		file.close();
+		remove(key.path);
+		counters.invalidations++;
+		counters.misses++;
+		return -1;
+	}
+
+	auto spent = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0);
+	counters.hits++;
+	counters.saved += max(chrono::microseconds(0), chrono::microseconds(probeUs) - spent);
+	return 0;
+}
+
+int ProbeCache::write(const Key& key, AVFormatContext* fc, std::chrono::microseconds probeTime)
+{
+	QDir().mkpath(directory);
+
+	//readers never see a partial entry
+	QSaveFile file(entryPath(key.path));
+	if (!file.open(QIODevice::WriteOnly)) {
+		return -1;
+	}
+
+	QDataStream out(&file);
+	out << magic << version << (quint32)LIBAVFORMAT_VERSION_INT << (quint32)LIBAVCODEC_VERSION_INT;
+	out << key.path << key.size << key.mtime << key.headHash;
+	out << (qint64)probeTime.count() << indexTotal(fc);
+	out << (qint64)fc->start_time << (qint64)fc->duration << (qint64)fc->bit_rate;
+	out << (quint32)fc->nb_streams;
+
+	for (unsigned int i = 0; i < fc->nb_streams; i++) {
+		auto st = fc->streams[i];
+		writeParameters(out, st->codecpar);
+		out << st->avg_frame_rate << st->r_frame_rate;
+		out << (qint64)st->start_time << (qint64)st->duration << (qint64)st->nb_frames;
+
+		out << (qint32)keyframeCount(st);
+		int n = avformat_index_get_entries_count(st);
+		for (int j = 0; j < n; j++) {
+			auto x = avformat_index_get_entry(st, j);
+			if (x->flags & AVINDEX_KEYFRAME) {
+				out << (qint64)x->pos << (qint64)x->timestamp << (qint32)x->size << (qint32)x->min_distance;
+			}
+		}
+	}
+
+	return file.commit() ? 0 : -1;
+}
+
+void ProbeCache::store(const QString& path, AVFormatContext* fc, std::chrono::microseconds probeTime)
+{
+	Key key;
+	if (!cacheable(fc) || makeKey(path, &key) < 0) {
+		return;
+	}
+
+	lock_guard<mutex> guard(lock);
+	if (write(key, fc, probeTime) < 0) {
+		qDebug("probe cache: cannot write %s", entryPath(key.path).toStdString().c_str());
+	}
+}
+
+void ProbeCache::update(const QString& path, AVFormatContext* fc)
+{
+	Key key;
+	if (makeKey(path, &key) < 0) {
+		return;
+	}
+
+	lock_guard<mutex> guard(lock);
+	QFile file(entryPath(key.path));
+	if (!file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+
+	QDataStream in(&file);
+	qint64 probeUs = 0, indexCount = 0;
+	bool valid = readHeader(in, key, &probeUs, &indexCount);
+	file.close();
+
+	//seeking and reading grow the index of files without one in the header
+	if (valid && indexTotal(fc) > indexCount) {
+		write(key, fc, chrono::microseconds(probeUs));
+	}
+}
+
+void ProbeCache::invalidate(const QString& path)
+{
+	lock_guard<mutex> guard(lock);
+	remove(QFileInfo(path).absoluteFilePath());
+	counters.invalidations++;
+}
+
+ProbeCache::Stats ProbeCache::stats(void)
+{
+	lock_guard<mutex> guard(lock);
+	return counters;
+}
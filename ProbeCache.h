@@ -0,0 +1,71 @@
+#pragma once
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <QString>
+#include <QByteArray>
+#include "FFmpegHeader.h"
+
+class QDataStream;
+
+//disk cache of avformat_find_stream_info results.
+//an entry is keyed on path, size, mtime and a hash of the first 64 KiB,
+//and holds the stream layout, codec parameters, durations and the
+//keyframe index. restore() fills a freshly opened AVFormatContext so a
+//reopen skips probing, any mismatch deletes the entry. only mp4/mov and
+//matroska are cached, other demuxers rely on the probe for timestamps.
+class ProbeCache final
+{
+public:
+	struct Stats {
+		int64_t hits = 0;
+		int64_t misses = 0;
+		int64_t invalidations = 0;
+		//probe time of the hits minus the time spent restoring
+		std::chrono::microseconds saved = std::chrono::microseconds(0);
+	};
+
+private:
+	struct Key {
+		QString path;
+		qint64 size = 0;
+		qint64 mtime = 0;
+		quint64 headHash = 0;
+	};
+
+	static const quint32 magic = 0x4e505242;
+	static const quint32 version = 1;
+	static const qint64 headSize = 64 << 10;
+
+	std::mutex lock;
+	QString directory;
+	Stats counters;
+
+	ProbeCache();
+	static int makeKey(const QString& path, Key* key);
+	//true when the entry matches the file and this FFmpeg build
+	static bool readHeader(QDataStream& in, const Key& key, qint64* probeUs, qint64* indexCount);
+	QString entryPath(const QString& path);
+	int write(const Key& key, AVFormatContext* fc, std::chrono::microseconds probeTime);
+	void remove(const QString& path);
+
+public:
+	ProbeCache(const ProbeCache&) = delete;
+	ProbeCache& operator=(const ProbeCache&) = delete;
+
+	static ProbeCache* instance(void);
+
+	//defaults to <cache location>/probe
+	void setDirectory(const QString& dir);
+
+	//after avformat_open_input, instead of avformat_find_stream_info.
+	//0 on a hit, negative when the file has to be probed
+	int restore(const QString& path, AVFormatContext* fc);
+	//after avformat_find_stream_info, probeTime is what it took
+	void store(const QString& path, AVFormatContext* fc, std::chrono::microseconds probeTime);
+	//before closing, saves the keyframe index when playback has grown it
+	void update(const QString& path, AVFormatContext* fc);
+	void invalidate(const QString& path);
+
+	Stats stats(void);
+};
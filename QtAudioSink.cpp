@@ -0,0 +1,78 @@
+#include "QtAudioSink.h"
+#include <algorithm>
+#include "NemoAudioDevice.h"
+
+using namespace std;
+
+QtAudioSink::QtAudioSink(const QAudioFormat& f)
+{
+	format = f;
+	sink = new QAudioSink(format, nullptr);
+}
+
+QtAudioSink::~QtAudioSink()
+{
+	stop();
+	delete sink;
+}
+
+int QtAudioSink::supportedSampleRate(int rate, int channels)
+{
+	QAudioDevice device = QMediaDevices::defaultAudioOutput();
+	if (device.isNull()) {
+		return 48000;
+	}
+	QAudioFormat f;
+	f.setSampleRate(rate);
+	f.setChannelCount(channels);
+	f.setSampleFormat(QAudioFormat::SampleFormat::Float);
+	if (rate > 0 && device.isFormatSupported(f)) {
+		return rate;
+	}
+	int preferred = device.preferredFormat().sampleRate();
+	return preferred > 0 ? preferred : 48000;
+}
+
+void QtAudioSink::start(NemoAudioDevice* dev)
+{
+	device = dev;
+	//QAudioSink only takes a buffer size before start
+	if (bufferTime.count() > 0) {
+		qsizetype bytes = format.bytesForDuration(bufferTime.count());
+		bytes -= bytes % format.bytesPerFrame();
+		sink->setBufferSize(bytes);
+	}
+	sink->start(device);
+}
+
+void QtAudioSink::stop(void)
+{
+	sink->stop();
+}
+
+void QtAudioSink::suspend(void)
+{
+	sink->suspend();
+}
+
+void QtAudioSink::resume(void)
+{
+	sink->resume();
+}
+
+int64_t QtAudioSink::bufferSize(void) const
+{
+	//the backend rounds the request to whole periods
+	return sink->bufferSize();
+}
+
+std::chrono::microseconds QtAudioSink::latency(void) const
+{
+	qsizetype buffered = sink->bufferSize() - sink->bytesFree();
+	return chrono::microseconds(format.durationForBytes((qint32)max<qsizetype>(buffered, 0)));
+}
+
+int64_t QtAudioSink::underruns(void) const
+{
+	return device ? device->underruns() : 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <QtMultimedia>
+#include "AudioOutput.h"
+
+//the default device through QAudioSink, which pulls from the
+//NemoAudioDevice on its own thread. GUI thread only.
+class QtAudioSink final : public AudioOutput
+{
+private:
+	QAudioFormat format;
+	QAudioSink* sink = nullptr;
+	NemoAudioDevice* device = nullptr;
+	std::chrono::microseconds bufferTime = std::chrono::microseconds(0);
+
+public:
+	explicit QtAudioSink(const QAudioFormat& f);
+	//rate for float samples on the default device: the source rate when
+	//the device takes it, else its preferred rate
+	static int supportedSampleRate(int rate, int channels);
+	~QtAudioSink();
+	QtAudioSink(const QtAudioSink&) = delete;
+	QtAudioSink& operator=(const QtAudioSink&) = delete;
+
+	Backend backend(void) const override { return Backend::BACKEND_QT; }
+	int channelCount(void) const override { return format.channelCount(); }
+	void setBufferTime(std::chrono::microseconds t) override { bufferTime = t; }
+
+	void start(NemoAudioDevice* dev) override;
+	void stop(void) override;
+	void suspend(void) override;
+	void resume(void) override;
+
+	int64_t bufferSize(void) const override;
+	std::chrono::microseconds latency(void) const override;
+	//reads that found the device empty
+	int64_t underruns(void) const override;
+};
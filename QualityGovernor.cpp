@@ -0,0 +1,187 @@
+#include "QualityGovernor.h"
+#include <algorithm>
+#include <climits>
+#include <QDebug>
+#include "FFmpegHeader.h"
+#include "TraceRecorder.h"
+
+using namespace std;
+
+QualityGovernor::QualityGovernor()
+{
+	upWindows = minUpWindows;
+}
+
+void QualityGovernor::reset(void)
+{
+	lock_guard<mutex> guard(lock);
+	level = 0;
+	st = Stats();
+	upWindows = minUpWindows;
+	started = false;
+}
+
+void QualityGovernor::setEnabled(bool on)
+{
+	lock_guard<mutex> guard(lock);
+	enabled = on;
+	if (!on && level != 0) {
+		m_step(0, chrono::steady_clock::now(), "governor off");
+	}
+	started = false;
+}
+
+void QualityGovernor::restart(void)
+{
+	lock_guard<mutex> guard(lock);
+	started = false;
+}
+
+void QualityGovernor::m_restart(TimePoint now)
+{
+	windowStart = now;
+	windowFrames = 0;
+	windowCost = 0;
+	windowLate = -1;
+	minDepth = INT_MAX;
+	goodWindows = 0;
+	started = true;
+}
+
+void QualityGovernor::m_step(int to, TimePoint now, const char* reason)
+{
+	int from = level;
+	if (to > from) {
+		st.stepsDown++;
+		//the last step up did not hold, wait longer for the next one
+		if (st.stepsUp && now - lastUp < chrono::seconds(10)) {
+			upWindows = min(upWindows * 2, maxUpWindows);
+		}
+	}
+	else {
+		st.stepsUp++;
+		lastUp = now;
+	}
+	level = to;
+	st.level = (Level)to;
+	st.reason = reason;
+	lastChange = now;
+	qDebug("quality %s -> %s: %s", levelName((Level)from), levelName((Level)to), reason);
+	TraceRecorder::instance()->instant(to > from ? "quality down" : "quality up", TraceRecorder::noPts);
+}
+
+void QualityGovernor::onDecode(std::chrono::microseconds cost, int frames)
+{
+	lock_guard<mutex> guard(lock);
+	if (!started) {
+		return;
+	}
+	windowCost += cost.count();
+	windowFrames += frames;
+	st.frames[level] += frames;
+}
+
+bool QualityGovernor::update(TimePoint now, std::chrono::microseconds frameDuration,
+	int queueDepth, int queueTarget, int64_t lateFrames)
+{
+	lock_guard<mutex> guard(lock);
+	if (!enabled) {
+		return false;
+	}
+	if (!started) {
+		m_restart(now);
+	}
+	if (windowLate < 0) {
+		windowLate = lateFrames;
+	}
+	minDepth = min(minDepth, queueDepth);
+	if (now - windowStart < window) {
+		return false;
+	}
+
+	//a window without frames is a stall somewhere else
+	if (windowFrames == 0 || frameDuration.count() <= 0) {
+		int keep = goodWindows;
+		m_restart(now);
+		goodWindows = keep;
+		return false;
+	}
+	auto cost = chrono::microseconds(windowCost / windowFrames);
+	double load = (double)cost.count() / frameDuration.count();
+	int64_t late = lateFrames - windowLate;
+	st.cost = cost;
+	st.load = load;
+	st.late = late;
+	st.queueDepth = minDepth;
+	bool settled = now - lastChange >= settle;
+	bool drained = minDepth < max(1, queueTarget / 8);
+	int keep = goodWindows;
+	int depth = minDepth;
+	m_restart(now);
+
+	int l = level;
+	const char* reason = nullptr;
+	if (late > windowFrames * lateShare) {
+		reason = "late frames";
+	}
+	else if (load > downLoad) {
+		reason = "decode cost";
+	}
+	else if (drained) {
+		reason = "queue drained";
+	}
+	if (reason) {
+		//one step per settle, the last one may not have shown yet
+		if (settled && l + 1 < levelCount) {
+			m_step(l + 1, now, reason);
+			return true;
+		}
+		return false;
+	}
+
+	if (late == 0 && load < upLoad && depth >= queueTarget / 2) {
+		goodWindows = keep + 1;
+	}
+	if (l > 0 && goodWindows >= upWindows && settled) {
+		m_step(l - 1, now, "headroom");
+		return true;
+	}
+	if (l == 0 && goodWindows >= maxUpWindows) {
+		//long stable at full quality, the next trouble starts fresh
+		upWindows = minUpWindows;
+	}
+	return false;
+}
+
+QualityGovernor::Stats QualityGovernor::stats(void) const
+{
+	lock_guard<mutex> guard(lock);
+	return st;
+}
+
+const char* QualityGovernor::levelName(Level l)
+{
+	switch (l) {
+	case Level::LEVEL_FULL:
+		return "full";
+	case Level::LEVEL_FAST_SCALER:
+		return "fast scaler";
+	case Level::LEVEL_HALF_SIZE:
+		return "half size";
+	case Level::LEVEL_SKIP_LOOP_FILTER:
+		return "no loop filter";
+	case Level::LEVEL_SKIP_NONREF:
+		return "no non-reference frames";
+	}
+	return "unknown";
+}
+
+int QualityGovernor::scalerFlags(Level l)
+{
+	return l == Level::LEVEL_FULL ? SWS_BILINEAR : SWS_FAST_BILINEAR;
+}
+
+int QualityGovernor::sizeDivisor(Level l)
+{
+	return l >= Level::LEVEL_HALF_SIZE ? 2 : 1;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//steps video quality down while the machine cannot keep up and back up
+//when it can. readTask reports the decode and conversion cost of every
+//packet, the queue depth and the late frames; once per window the
+//governor compares them with the frame duration. one bad window steps
+//down, several good ones step up, and a step up that is undone soon
+//doubles the wait before the next one.
+class QualityGovernor final
+{
+public:
+	enum class Level {
+		//bilinear conversion of whole frames, everything decoded
+		LEVEL_FULL,
+		LEVEL_FAST_SCALER,
+		//converted at half width and height, the GPU scales it up
+		LEVEL_HALF_SIZE,
+		//no deblocking
+		LEVEL_SKIP_LOOP_FILTER,
+		//non-reference frames are not decoded
+		LEVEL_SKIP_NONREF
+	};
+	static const int levelCount = 5;
+
+	struct Stats {
+		Level level = Level::LEVEL_FULL;
+		int64_t stepsDown = 0;
+		int64_t stepsUp = 0;
+		//frames decoded at each level
+		int64_t frames[levelCount] = { 0 };
+		//the last window: mean cost per frame and its share of the
+		//frame duration, late frames and the lowest queue depth
+		std::chrono::microseconds cost = std::chrono::microseconds(0);
+		double load = 0.0;
+		int64_t late = 0;
+		int queueDepth = 0;
+		//why the level last changed
+		const char* reason = "";
+	};
+
+private:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	mutable std::mutex lock;
+	std::atomic<int> level{ 0 };
+	std::atomic<bool> enabled{ true };
+
+	bool started = false;
+	TimePoint windowStart;
+	int64_t windowFrames = 0;
+	int64_t windowCost = 0;
+	int64_t windowLate = 0;
+	int minDepth = 0;
+	int goodWindows = 0;
+	//windows of headroom needed to step up, doubled when a step up fails
+	int upWindows = 0;
+	TimePoint lastUp;
+	TimePoint lastChange;
+	Stats st;
+
+	void m_step(int to, TimePoint now, const char* reason);
+	void m_restart(TimePoint now);
+
+public:
+	std::chrono::milliseconds window = std::chrono::milliseconds(1000);
+	//after a change the next window shows its effect
+	std::chrono::milliseconds settle = std::chrono::milliseconds(2000);
+	//share of the frame duration spent decoding and converting
+	double downLoad = 0.85;
+	double upLoad = 0.5;
+	//late frames per decoded frame that count as pressure
+	double lateShare = 0.02;
+	int minUpWindows = 5;
+	int maxUpWindows = 80;
+
+	QualityGovernor();
+
+	//back to full quality, on open
+	void reset(void);
+	//off holds full quality
+	void setEnabled(bool on);
+	bool isEnabled(void) const { return enabled; }
+	Level current(void) const { return (Level)level.load(); }
+
+	//readTask, the cost of decoding a packet into frames and converting them
+	void onDecode(std::chrono::microseconds cost, int frames);
+	//readTask, while playing. lateFrames is the running count of the
+	//player, queueTarget the depth readTask fills to. true on a change
+	bool update(TimePoint now, std::chrono::microseconds frameDuration,
+		int queueDepth, int queueTarget, int64_t lateFrames);
+	//a seek or a pause, the window so far says nothing
+	void restart(void);
+
+	Stats stats(void) const;
+
+	static const char* levelName(Level l);
+	static int scalerFlags(Level l);
+	//conversion size is divided by this
+	static int sizeDivisor(Level l);
+};
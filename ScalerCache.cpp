@@ -0,0 +1,88 @@
+#include "ScalerCache.h"
+
+using namespace std;
+
+bool ScalerCache::Key::operator==(const Key& k) const
+{
+	return srcWidth == k.srcWidth && srcHeight == k.srcHeight &&
+		srcFormat == k.srcFormat && colorspace == k.colorspace && range == k.range &&
+		dstWidth == k.dstWidth && dstHeight == k.dstHeight && dstFormat == k.dstFormat;
+}
+
+ScalerCache::ScalerCache(size_t n, int swsFlags)
+{
+	capacity = n > 0 ? n : 1;
+	flags = swsFlags;
+}
+
+ScalerCache::~ScalerCache()
+{
+	clear();
+}
+
+ScalerCache::Key ScalerCache::frameKey(const AVFrame* frame, int dstWidth, int dstHeight, AVPixelFormat dstFormat)
+{
+	Key key;
+	key.srcWidth = frame->width;
+	key.srcHeight = frame->height;
+	key.srcFormat = (AVPixelFormat)frame->format;
+	key.colorspace = frame->colorspace;
+	key.range = frame->color_range;
+	key.dstWidth = dstWidth;
+	key.dstHeight = dstHeight;
+	key.dstFormat = dstFormat;
+	return key;
+}
+
+SwsContext* ScalerCache::get(const Key& key)
+{
+	for (auto it = entryList.begin(); it != entryList.end(); it++) {
+		if (it->key == key) {
+			//move to the front
+			if (it != entryList.begin()) {
+				entryList.splice(entryList.begin(), entryList, it);
+			}
+			hitCount++;
+			return entryList.front().ctx;
+		}
+	}
+
+	missCount++;
+	SwsContext* ctx = sws_getContext(
+		key.srcWidth, key.srcHeight, key.srcFormat,
+		key.dstWidth, key.dstHeight, key.dstFormat,
+		flags, NULL, NULL, NULL);
+	if (!ctx) {
+		return nullptr;
+	}
+
+	//matrix and range of the source, fails harmlessly for rgb input
+	int srcRange = key.range == AVColorRange::AVCOL_RANGE_JPEG ? 1 : 0;
+	sws_setColorspaceDetails(ctx,
+		sws_getCoefficients(key.colorspace), srcRange,
+		sws_getCoefficients(SWS_CS_DEFAULT), 1,
+		0, 1 << 16, 1 << 16);
+
+	if (entryList.size() >= capacity) {
+		sws_freeContext(entryList.back().ctx);
+		entryList.pop_back();
+	}
+	entryList.push_front({ key, ctx });
+	return ctx;
+}
+
+void ScalerCache::setFlags(int swsFlags)
+{
+	if (swsFlags != flags) {
+		clear();
+		flags = swsFlags;
+	}
+}
+
+void ScalerCache::clear(void)
+{
+	for (auto& e : entryList) {
+		sws_freeContext(e.ctx);
+	}
+	entryList.clear();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <list>
+#include <cstdint>
+#include "FFmpegHeader.h"
+
+//small LRU of conversion contexts.
+//adaptive streams and concatenated files change size or pixel format
+//mid-stream, a single sws_getCachedContext would rebuild the context on
+//every switch. each source/target combination is built once and kept
+//until it falls out of the cache.
+class ScalerCache final
+{
+public:
+	struct Key {
+		int srcWidth = 0;
+		int srcHeight = 0;
+		AVPixelFormat srcFormat = AVPixelFormat::AV_PIX_FMT_NONE;
+		AVColorSpace colorspace = AVColorSpace::AVCOL_SPC_UNSPECIFIED;
+		AVColorRange range = AVColorRange::AVCOL_RANGE_UNSPECIFIED;
+		int dstWidth = 0;
+		int dstHeight = 0;
+		AVPixelFormat dstFormat = AVPixelFormat::AV_PIX_FMT_NONE;
+
+		bool operator==(const Key& k) const;
+	};
+
+private:
+	struct Entry {
+		Key key;
+		SwsContext* ctx = nullptr;
+	};
+
+	size_t capacity = 4;
+	int flags = SWS_BILINEAR;
+	//most recently used first
+	std::list<Entry> entryList;
+	int64_t hitCount = 0;
+	int64_t missCount = 0;
+
+public:
+	explicit ScalerCache(size_t capacity = 4, int flags = SWS_BILINEAR);
+	~ScalerCache();
+	ScalerCache(const ScalerCache&) = delete;
+	ScalerCache& operator=(const ScalerCache&) = delete;
+
+	//source part of the key from a decoded frame
+	static Key frameKey(const AVFrame* frame, int dstWidth, int dstHeight, AVPixelFormat dstFormat);
+
+	//nullptr when the context cannot be built
+	SwsContext* get(const Key& key);
+	void clear(void);
+	//contexts built with other flags are dropped
+	void setFlags(int swsFlags);
+	int currentFlags(void) const { return flags; }
+
+	size_t size(void) const { return entryList.size(); }
+	int64_t hits(void) const { return hitCount; }
+	int64_t misses(void) const { return missCount; }
+};
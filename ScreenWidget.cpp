@@ -1,7 +1,18 @@
 #include "ScreenWidget.h"
+#include "ThreadPolicy.h"
+#include <QFileInfo>
 
 using namespace std;
 
+//media time of a timestamp for the trace recorder
+static int64_t tracePts(int64_t ts, AVRational time_base)
+{
+	if (ts == AV_NOPTS_VALUE || time_base.den == 0) {
+		return TraceRecorder::noPts;
+	}
+	return ScreenWidget::ts_to_microsecond(ts, time_base).count();
+}
+
 int ScreenWidget::openCodexContext(AVCodecContext** pCC, AVFormatContext* pFC, int index)
 {
 	int ret = 0;
@@ -49,13 +60,15 @@ void ScreenWidget::clearOnOpen(void)
 {
 	if (frame)
 		av_frame_free(&frame);
+	if (audioFrame)
+		av_frame_free(&audioFrame);
+	if (scrubFrame)
+		av_frame_free(&scrubFrame);
 	if (packet)
 		av_packet_free(&packet);
-	if (audioSink) {
-		audioSink->stop();
-		delete audioSink;
-		audioSink = nullptr;
-	}
+	if (demuxPacket)
+		av_packet_free(&demuxPacket);
+	closeAudioOutput();
 	if (audioDevice) {
 		delete audioDevice;
 		audioDevice = nullptr;
@@ -68,21 +81,21 @@ void ScreenWidget::clearOnOpen(void)
 		swr_free(&swr_ctx);
 		swr_ctx = nullptr;
 	}
-	if (sws_ctx) {
-		sws_freeContext(sws_ctx);
-		sws_ctx = nullptr;
-	}
 	if (videoCodecContext)
 		avcodec_free_context(&videoCodecContext);
 	if (audioCodecContext)
 		avcodec_free_context(&audioCodecContext);
 	if (formatContext)
 		avformat_close_input(&formatContext);
+	releaseRecycled();
 	videoStreamIndex = -1;
 	audioStreamIndex = -1;
+	lock.lock();
+	trackList.clear();
+	lock.unlock();
 }
 
-void ScreenWidget::clearOnClose(void)
+void ScreenWidget::clearOnClose(bool recycle)
 {
 	if (!formatContext) {
 		return;
@@ -93,9 +106,15 @@ void ScreenWidget::clearOnClose(void)
 	readStatus = ThreadStatus::THREAD_HALT;
 	lock.unlock();
 
-	//wait for all work threads exit
-	while (threadCount > 0) {
-		this_thread::sleep_for(chrono::milliseconds(10));
+	//abort blocking I/O through interruptCallback and wake
+	//task chains sleeping in the pool timer, then join them
+	cancelToken.cancel();
+	NemoThreadPool::instance()->expedite(cancelToken);
+	{
+		unique_lock<mutex> guard(taskLock);
+		taskCV.wait(guard, [this]() {
+			return taskCount == 0;
+		});
 	}
 
 	//clear video frame list
@@ -104,18 +123,50 @@ void ScreenWidget::clearOnClose(void)
 		av_freep(&(it->videoData[0]));
 		videoFrameList.pop_front();
 	}
+	jitterBuffer.clear();
+	videoFilter.reset();
+	m_dropAudio();
+	if (demuxPacket)
+		av_packet_free(&demuxPacket);
+	loopCache.clear();
+	loop = Loop();
+	//only opening a sound card is slow, a timer output reads from
+	//audioDevice, which may be recycled below
+	if (audioOutput && audioOutput->backend() != AudioOutput::Backend::BACKEND_QT) {
+		closeAudioOutput();
+	}
 
-	//todo: flush decoder
+	if (recycle) {
+		//keep the contexts for the next file, m_openFile reuses
+		//them when the codec parameters match
+		releaseRecycled();
+		recycled.videoCodecContext = videoCodecContext;
+		recycled.audioCodecContext = audioCodecContext;
+		recycled.swr_ctx = swr_ctx;
+		recycled.audioFormat = audioFormat;
+		recycled.audioDevice = audioDevice;
+		recycled.audioOutput = audioOutput;
+		videoCodecContext = nullptr;
+		audioCodecContext = nullptr;
+		swr_ctx = nullptr;
+		audioFormat = nullptr;
+		audioDevice = nullptr;
+		audioOutput = nullptr;
+		if (recycled.audioOutput) {
+			recycled.audioOutput->suspend();
+			recycled.audioDevice->clear();
+		}
+	}
 
 	if (frame)
 		av_frame_free(&frame);
+	if (audioFrame)
+		av_frame_free(&audioFrame);
+	if (scrubFrame)
+		av_frame_free(&scrubFrame);
 	if (packet)
 		av_packet_free(&packet);
-	if (audioSink) {
-		audioSink->stop();
-		delete audioSink;
-		audioSink = nullptr;
-	}
+	closeAudioOutput();
 	if (audioDevice) {
 		delete audioDevice;
 		audioDevice = nullptr;
@@ -128,41 +179,110 @@ void ScreenWidget::clearOnClose(void)
 		swr_free(&swr_ctx);
 		swr_ctx = nullptr;
 	}
-	if (sws_ctx) {
-		sws_freeContext(sws_ctx);
-		sws_ctx = nullptr;
-	}
 	if (videoCodecContext)
 		avcodec_free_context(&videoCodecContext);
 	if (audioCodecContext)
 		avcodec_free_context(&audioCodecContext);
-	if (formatContext)
+	if (formatContext) {
+		//keep what playback added to the keyframe index
+		if (cacheProbe) {
+			ProbeCache::instance()->update(filePath, formatContext);
+		}
 		avformat_close_input(&formatContext);
+	}
 
 	videoStreamIndex = -1;
 	audioStreamIndex = -1;
+	lock.lock();
+	trackList.clear();
+	lock.unlock();
 }
 
 int ScreenWidget::m_openFile(const QString& path)
 {
+	auto t0 = chrono::steady_clock::now();
 	if (formatContext) {
-		clearOnClose();
+		clearOnClose(true);
 	}
+	auto t1 = chrono::steady_clock::now();
 
 	int ret = 0;
 
 	readStatus = ThreadStatus::THREAD_NONE;
 	status = ScreenStatus::SCREEN_STATUS_NONE;
+	cancelToken = NemoThreadPool::CancelToken();
+	timeOffset = chrono::microseconds(0);
+	playbackSpeed = 1.0;
+	compensating = false;
+	seekPending = false;
+	loopPending = false;
+	videoTrackRequest = -1;
+	audioTrackRequest = -1;
+	scrubbing = false;
+	scrubEnding = false;
+	scrubResume = false;
+	scrubTaken = true;
+	scrubStats = ScrubStats();
+	scrub = Scrub();
+	//the learned drift belongs to the output and stays
+	audioWritten = false;
+	resetDriftWindow();
+	governor.reset();
+	appliedQuality = -1;
+	skipUntil = chrono::microseconds(0);
+	streaming = isStreamUrl(path);
+	videoFrameDuration = chrono::microseconds(0);
+	//the display may have changed since the last file
+	framePacer.reset(screen() ? screen()->refreshRate() : 0.0);
+
+	formatContext = avformat_alloc_context();
+	if (!formatContext) {
+		releaseRecycled();
+		showError("avformat_alloc_context error");
+		return AVERROR(ENOMEM);
+	}
+	formatContext->interrupt_callback.callback = interruptCallback;
+	formatContext->interrupt_callback.opaque = this;
 
-	if ((ret = avformat_open_input(&formatContext, path.toStdString().c_str(), NULL, NULL)) < 0) {
-		QMessageBox::critical(nullptr, "error", "cannot open file", QMessageBox::Ok);
+	AVDictionary* options = NULL;
+	if (streaming) {
+		setStreamOptions(&options, path, streamPreset);
+	}
+	//"lavfi:<filtergraph>" opens a generated source, used by the sync bench
+	const AVInputFormat* inputFormat = NULL;
+	QString url = path;
+	if (path.startsWith("lavfi:")) {
+		avdevice_register_all();
+		inputFormat = av_find_input_format("lavfi");
+		url = path.mid(6);
+	}
+	ret = avformat_open_input(&formatContext, url.toStdString().c_str(), inputFormat, &options);
+	av_dict_free(&options);
+	if (ret < 0) {
+		releaseRecycled();
+		showError("cannot open file");
 		return ret;
 	}
 
-	if ((ret = avformat_find_stream_info(formatContext, NULL)) < 0) {
-		avformat_close_input(&formatContext);
-		QMessageBox::critical(nullptr, "error", "avformat_find_stream_info error", QMessageBox::Ok);
-		return ret;
+	//local files reopen from the probe cache without reading ahead
+	filePath = path;
+	cacheProbe = !streaming && !inputFormat;
+	if (!cacheProbe || ProbeCache::instance()->restore(path, formatContext) < 0) {
+		auto p0 = chrono::steady_clock::now();
+		if ((ret = avformat_find_stream_info(formatContext, NULL)) < 0) {
+			avformat_close_input(&formatContext);
+			releaseRecycled();
+			showError("avformat_find_stream_info error");
+			return ret;
+		}
+		auto probeTime = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - p0);
+		qDebug("avformat_find_stream_info: %lld us", (long long)probeTime.count());
+		if (cacheProbe) {
+			ProbeCache::instance()->store(path, formatContext, probeTime);
+		}
+	}
+	else {
+		qDebug("probe cache hit");
 	}
 
 	/* find decoder for the video stream */
@@ -172,23 +292,43 @@ int ScreenWidget::m_openFile(const QString& path)
 	if (ret >= 0) {
 		videoStreamIndex = ret;
 
-		ret = openCodexContext(&videoCodecContext, formatContext, videoStreamIndex);
+		if (canRecycle(recycled.videoCodecContext, formatContext->streams[videoStreamIndex]->codecpar)) {
+			videoCodecContext = recycled.videoCodecContext;
+			recycled.videoCodecContext = nullptr;
+			avcodec_flush_buffers(videoCodecContext);
+			ret = 0;
+		}
+		else {
+			ret = openCodexContext(&videoCodecContext, formatContext, videoStreamIndex);
+		}
 		if (ret < 0) {
 			clearOnOpen();
-			QMessageBox::critical(nullptr, "error", "openCodexContext error", QMessageBox::Ok);
+			showError("openCodexContext error");
 			return ret;
 		}
 
 		videoWidth = videoCodecContext->width;
 		videoHeight = videoCodecContext->height;
-
-		sws_ctx = sws_getContext(
-			videoWidth, videoHeight, videoCodecContext->pix_fmt,
-			videoWidth, videoHeight, AVPixelFormat::AV_PIX_FMT_RGB24,
-			SWS_BILINEAR, NULL, NULL, NULL);
-
-		if (!sws_ctx) {
-			QMessageBox::critical(nullptr, "error", "sws_getContext error", QMessageBox::Ok);
+		videoTimeBase = formatContext->streams[videoStreamIndex]->time_base;
+		AVRational frameRate = av_guess_frame_rate(formatContext, formatContext->streams[videoStreamIndex], NULL);
+		if (frameRate.num > 0 && frameRate.den > 0) {
+			videoFrameDuration = ts_to_microsecond(1, av_inv_q(frameRate));
+		}
+		videoFilter.setFrameRate(frameRate);
+
+		//build the scaler for the announced format now, frames that
+		//differ get their own from decodeVideo
+		ScalerCache::Key key;
+		key.srcWidth = videoWidth;
+		key.srcHeight = videoHeight;
+		key.srcFormat = videoCodecContext->pix_fmt;
+		key.colorspace = videoCodecContext->colorspace;
+		key.range = videoCodecContext->color_range;
+		key.dstWidth = videoWidth;
+		key.dstHeight = videoHeight;
+		key.dstFormat = AVPixelFormat::AV_PIX_FMT_RGB24;
+		if (!scalers.get(key)) {
+			showError("sws_getContext error");
 			clearOnOpen();
 			return -1;
 		}
@@ -204,22 +344,45 @@ int ScreenWidget::m_openFile(const QString& path)
 	if (ret >= 0) {
 		audioStreamIndex = ret;
 
-		ret = openCodexContext(&audioCodecContext, formatContext, audioStreamIndex);
+		bool reuseAudio = canRecycle(recycled.audioCodecContext,
+			formatContext->streams[audioStreamIndex]->codecpar);
+		if (reuseAudio) {
+			//the resampler was set up from the same parameters
+			audioCodecContext = recycled.audioCodecContext;
+			swr_ctx = recycled.swr_ctx;
+			recycled.audioCodecContext = nullptr;
+			recycled.swr_ctx = nullptr;
+			avcodec_flush_buffers(audioCodecContext);
+			ret = 0;
+		}
+		else {
+			ret = openCodexContext(&audioCodecContext, formatContext, audioStreamIndex);
+		}
 		if (ret < 0) {
 			clearOnOpen();
-			QMessageBox::critical(nullptr, "error", "openCodexContext error", QMessageBox::Ok);
+			showError("openCodexContext error");
 			return ret;
 		}
 
-		swr_ctx = swr_alloc();
 		if (!swr_ctx) {
-			QMessageBox::critical(nullptr, "error", "Could not allocate resampler context", QMessageBox::Ok);
+			swr_ctx = swr_alloc();
+		}
+		if (!swr_ctx) {
+			showError("Could not allocate resampler context");
 			clearOnOpen();
 			return AVERROR(ENOMEM);
 		}
 
 		audioChannels =
 			av_get_channel_layout_nb_channels(audioCodecContext->channel_layout);
+		audioTimeBase = formatContext->streams[audioStreamIndex]->time_base;
+		//play the source rate where the output takes it
+		audioSampleRate = AudioOutput::negotiateSampleRate(effectiveAudioBackend(),
+			audioCodecContext->sample_rate, audioChannels);
+		audioPath = chooseAudioPath(audioCodecContext, audioSampleRate, audioChannels, audioFromat);
+		qDebug("audio %d Hz %s %d channels to %d Hz float: %s", audioCodecContext->sample_rate,
+			av_get_sample_fmt_name(audioCodecContext->sample_fmt), audioChannels, audioSampleRate,
+			audioPathName(audioPath));
 
 		av_opt_set_int(swr_ctx, "in_channel_layout", audioCodecContext->channel_layout, 0);
 		av_opt_set_int(swr_ctx, "in_sample_rate", audioCodecContext->sample_rate, 0);
@@ -228,370 +391,1894 @@ int ScreenWidget::m_openFile(const QString& path)
 		av_opt_set_int(swr_ctx, "out_channel_layout", audioCodecContext->channel_layout, 0);
 		av_opt_set_int(swr_ctx, "out_sample_rate", audioSampleRate, 0);
 		av_opt_set_sample_fmt(swr_ctx, "out_sample_fmt", audioFromat, 0);
+		//set up on every path, a stretch turns on its resampler. the
+		//other paths hold no samples that this would drop
+		av_opt_set_int(swr_ctx, "flags", 0, 0);
 
+		//also drops samples buffered from the previous file
 		if ((ret = swr_init(swr_ctx)) < 0) {
-			QMessageBox::critical(nullptr, "error", "openCodexContext error", QMessageBox::Ok);
+			showError("openCodexContext error");
 			clearOnOpen();
 			return ret;
 		}
 
-		audioFormat = new QAudioFormat;
-		audioFormat->setSampleRate(audioSampleRate);
-		audioFormat->setChannelCount(audioChannels);
-		audioFormat->setSampleFormat(QAudioFormat::SampleFormat::Float);
-		audioSink = new QAudioSink(*audioFormat, nullptr);
-		audioDevice = new NemoAudioDevice(nullptr);
-		audioSink->start(audioDevice);
-		audioSink->suspend();
+		if (recycled.audioOutput && recycled.audioOutput->channelCount() == audioChannels &&
+			recycled.audioFormat->sampleRate() == audioSampleRate &&
+			recycled.audioOutput->backend() == effectiveAudioBackend()) {
+			//opening an audio device is the slowest part of a switch
+			audioFormat = recycled.audioFormat;
+			audioDevice = recycled.audioDevice;
+			audioOutput = recycled.audioOutput;
+			recycled.audioFormat = nullptr;
+			recycled.audioDevice = nullptr;
+			recycled.audioOutput = nullptr;
+		}
+		else {
+			audioFormat = new QAudioFormat;
+			audioFormat->setSampleRate(audioSampleRate);
+			audioFormat->setChannelCount(audioChannels);
+			audioFormat->setSampleFormat(QAudioFormat::SampleFormat::Float);
+			audioDevice = new NemoAudioDevice(nullptr);
+			openAudioOutput();
+		}
 	}
 	else {
 		qDebug("no audio");
 	}
 
+	//extra audio tracks, subtitles and data are not even read
+	applyDiscard(formatContext);
+	lastStreamDts.assign(formatContext->nb_streams, AV_NOPTS_VALUE);
+	resumeDts.assign(formatContext->nb_streams, AV_NOPTS_VALUE);
+
 	packet = av_packet_alloc();
 	if (!packet) {
-		QMessageBox::critical(nullptr, "error", "av_packet_alloc error", QMessageBox::Ok);
+		showError("av_packet_alloc error");
 		clearOnOpen();
 		ret = AVERROR(ENOMEM);
 		return ret;
 	}
 
 	frame = av_frame_alloc();
-	if (!frame) {
-		QMessageBox::critical(nullptr, "error", "av_frame_alloc error", QMessageBox::Ok);
+	audioFrame = av_frame_alloc();
+	if (!frame || !audioFrame) {
+		showError("av_frame_alloc error");
 		clearOnOpen();
 		ret = AVERROR(ENOMEM);
 		return ret;
 	}
 
-	//start readThread, videoThread, audioThread here
-	std::thread t(readThread, this);
-	t.detach();
+	mediaDuration = chrono::microseconds(
+		formatContext->duration != AV_NOPTS_VALUE ? formatContext->duration : 0);
+
+	if (streaming) {
+		demuxPacket = av_packet_alloc();
+		if (!demuxPacket) {
+			showError("av_packet_alloc error");
+			clearOnOpen();
+			return AVERROR(ENOMEM);
+		}
+
+		//a source without duration is live: it may reconnect
+		//anywhere and catches up when latency grows
+		streamPath = path;
+		liveStream = formatContext->duration == AV_NOPTS_VALUE;
+		reconnectCount = 0;
+		jitterBuffer.reset(streamPreset, liveStream,
+			videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex, videoStreamIndex);
+	}
+
+	//whatever did not match the new file
+	releaseRecycled();
+
+	auto list = listTracks(formatContext);
+	lock.lock();
+	trackList.swap(list);
+	lock.unlock();
+
+	if (audioCodecContext) {
+		audioMeter.reset(audioChannels, audioSampleRate);
+	}
+	presentedFrames = 0;
+	lateFrames = 0;
+
+	//start readTask, videoTask, filterTask, audioTask and meterTask on the shared pool
+	taskLock.lock();
+	taskCount++;
+	if (videoCodecContext) {
+		taskCount += 2;
+	}
+	if (audioCodecContext) {
+		taskCount += 2;
+	}
+	if (streaming) {
+		taskCount++;
+	}
+	taskLock.unlock();
 
+	if (streaming) {
+		postTask(this, NemoThreadPool::Priority::PRIORITY_NORMAL, demuxTask, chrono::microseconds(0));
+	}
+	postTask(this, NemoThreadPool::Priority::PRIORITY_NORMAL, readTask, chrono::microseconds(0));
 	if(videoCodecContext){
-		std::thread t2(videoThread, this);
-		t2.detach();
+		postTask(this, NemoThreadPool::Priority::PRIORITY_NORMAL, filterTask, chrono::microseconds(0));
+		postTask(this, NemoThreadPool::Priority::PRIORITY_PRESENTATION, videoTask, chrono::microseconds(0));
+	}
+	if (audioCodecContext) {
+		postTask(this, NemoThreadPool::Priority::PRIORITY_AUDIO, audioTask, chrono::microseconds(0));
+		postTask(this, NemoThreadPool::Priority::PRIORITY_BACKGROUND, meterTask, chrono::microseconds(0));
 	}
 
-	/*if (audioCodecContext) {
-		std::thread t3(audioThread, this);
-		t3.detach();
-	}*/
+	auto t2 = chrono::steady_clock::now();
+	closeLatency = chrono::duration_cast<chrono::microseconds>(t1 - t0);
+	openLatency = chrono::duration_cast<chrono::microseconds>(t2 - t1);
+	qDebug("m_openFile: close %lld us, open %lld us",
+		(long long)closeLatency.count(), (long long)openLatency.count());
 
 	return 0;
 }
 
-int ScreenWidget::m_openFileHW(const QString& path)
+int ScreenWidget::interruptCallback(void* opaque)
 {
-	return 0;
+	auto screen = (ScreenWidget*)opaque;
+	return screen->cancelToken.isCanceled() ? 1 : 0;
 }
 
-void ScreenWidget::initShaderScript(void)
+const char* ScreenWidget::audioPathName(AudioPath p)
 {
-	stringstream vs, fs;
-
-	vs << "#version 330 core" << endl
-		<< "layout(location = 0) in vec3 aPos;" << endl
-		<< "layout(location = 1) in vec2 aTexCoord;" << endl
-		<< "out vec2 optTexCoord;" << endl
-		<< "void main()" << endl
-		<< "{" << endl
-		<< "gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);" << endl
-		<< "optTexCoord = aTexCoord;" << endl
-		<< "}" << endl;
-	vsCode = vs.str();
-
-	fs << "#version 330 core" << endl
-		<< "in vec2 optTexCoord;" << endl
-		<< "out vec4 FragColor;" << endl
-		<< "uniform sampler2D texture0;" << endl
-		<< "void main()" << endl
-		<< "{" << endl
-		<< "FragColor = texture(texture0, optTexCoord);" << endl
-		<< "}" << endl;
-	fsCode = fs.str();
+	switch (p) {
+	case AudioPath::AUDIO_PASSTHROUGH:
+		return "passthrough";
+	case AudioPath::AUDIO_CONVERT:
+		return "convert";
+	case AudioPath::AUDIO_RESAMPLE:
+		return "resample";
+	}
+	return "?";
 }
 
-bool ScreenWidget::createProgram(void)
+ScreenWidget::AudioPath ScreenWidget::chooseAudioPath(const AVCodecContext* cc, int outRate, int outChannels,
+	AVSampleFormat outFormat)
 {
-	initShaderScript();
-
-	const char* vertexShaderSource = vsCode.c_str();
-	const char* fragmentShaderSource = fsCode.c_str();
-	int  success = 0;
-	char infoLog[512] = { '\0' };
+	if (cc->sample_rate != outRate) {
+		return AudioPath::AUDIO_RESAMPLE;
+	}
+	int channels = cc->channel_layout ? av_get_channel_layout_nb_channels(cc->channel_layout) : cc->channels;
+	if (cc->sample_fmt == outFormat && channels == outChannels) {
+		return AudioPath::AUDIO_PASSTHROUGH;
+	}
+	return AudioPath::AUDIO_CONVERT;
+}
 
-	auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-	glCompileShader(vertexShader);
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-		qDebug("ERROR::vertexShader::COMPILATION_FAILED");
-		qDebug(infoLog);
+bool ScreenWidget::canRecycle(AVCodecContext* pCC, AVCodecParameters* par)
+{
+	if (!pCC || !par) {
 		return false;
 	}
 
-	//fragment shader
-	auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-	glCompileShader(fragmentShader);
-	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-		qDebug("ERROR::fragmentShader::COMPILATION_FAILED");
-		qDebug(infoLog);
+	if (pCC->codec_id != par->codec_id ||
+		pCC->extradata_size != par->extradata_size) {
 		return false;
 	}
-
-	//link shader program
-	program = glCreateProgram();
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
-	glLinkProgram(program);
-	glGetProgramiv(program, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(program, 512, NULL, infoLog);
-		qDebug("ERROR::shaderProgram::FAILED");
-		qDebug(infoLog);
+	if (pCC->extradata_size > 0 &&
+		memcmp(pCC->extradata, par->extradata, pCC->extradata_size) != 0) {
 		return false;
 	}
 
-	//release shaders after link
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+	if (par->codec_type == AVMediaType::AVMEDIA_TYPE_VIDEO) {
+		return pCC->width == par->width &&
+			pCC->height == par->height &&
+			pCC->pix_fmt == (AVPixelFormat)par->format;
+	}
+	else if (par->codec_type == AVMediaType::AVMEDIA_TYPE_AUDIO) {
+		return pCC->sample_rate == par->sample_rate &&
+			pCC->channel_layout == par->channel_layout &&
+			pCC->sample_fmt == (AVSampleFormat)par->format;
+	}
 
-	qDebug("createProgram done");
-	return true;
+	return false;
 }
 
-int ScreenWidget::readThread(ScreenWidget* screen)
+void ScreenWidget::releaseRecycled(void)
 {
-	screen->threadCount++;
-	
-	ThreadStatus status = ThreadStatus::THREAD_NONE;
-	int ret = 0;
+	if (recycled.audioOutput) {
+		recycled.audioOutput->stop();
+		delete recycled.audioOutput;
+		recycled.audioOutput = nullptr;
+	}
+	if (recycled.audioDevice) {
+		delete recycled.audioDevice;
+		recycled.audioDevice = nullptr;
+	}
+	if (recycled.audioFormat) {
+		delete recycled.audioFormat;
+		recycled.audioFormat = nullptr;
+	}
+	if (recycled.swr_ctx)
+		swr_free(&recycled.swr_ctx);
+	if (recycled.videoCodecContext)
+		avcodec_free_context(&recycled.videoCodecContext);
+	if (recycled.audioCodecContext)
+		avcodec_free_context(&recycled.audioCodecContext);
+}
 
-	auto funcFlag = [screen]() {
-		if (screen->audioCodecContext && screen->videoCodecContext) {
-			return (screen->videoFrameList.size() < screen->videoPreload);
-		}
-		else if (screen->audioCodecContext && !screen->videoCodecContext) {
-			return true;
-		}
-		else if (!screen->audioCodecContext && screen->videoCodecContext) {
-			return screen->videoFrameList.size() < screen->videoPreload;
-		}
-		else {
-			return false;
-		}
-	};
+AudioOutput::Backend ScreenWidget::effectiveAudioBackend(void) const
+{
+	if (headless && audioBackend == AudioOutput::Backend::BACKEND_QT) {
+		return AudioOutput::Backend::BACKEND_NULL;
+	}
+	return audioBackend;
+}
 
-	qDebug("readThread start");
+void ScreenWidget::openAudioOutput(void)
+{
+	auto backend = effectiveAudioBackend();
+	audioOutput = AudioOutput::create(backend, audioOutputPath, *audioFormat);
+	if (!audioOutput) {
+		showError("cannot write the audio file, playing to null");
+		backend = AudioOutput::Backend::BACKEND_NULL;
+		audioOutput = AudioOutput::create(backend, audioOutputPath, *audioFormat);
+	}
+	audioOutput->setProbe(syncProbe);
+	audioOutput->setClock(clock);
+	audioOutput->setRateSkew(audioSkew);
+	startAudioOutput();
+	audioOutput->suspend();
+}
 
-	for (;;) {
-		screen->lock.lock();
-		status = screen->readStatus;
-		screen->lock.unlock();
+void ScreenWidget::startAudioOutput(void)
+{
+	audioOutput->setBufferTime(chrono::milliseconds(audioLatencyTarget));
+	audioOutput->start(audioDevice);
+
+	//the backend rounds the request to whole periods
+	qint64 size = audioOutput->bufferSize();
+	//a few sink buffers in our ring ride out decode and scheduling jitter
+	audioWatermark = max<qint64>(size * 4, audioFormat->bytesForDuration(100000));
+	qDebug("audio %s: target %d ms, buffer %lld bytes = %lld us, watermark %lld bytes",
+		AudioOutput::backendName(audioOutput->backend()), audioLatencyTarget, (long long)size,
+		(long long)audioFormat->durationForBytes((qint32)size), (long long)audioWatermark.load());
+}
 
-		if (status == ThreadStatus::THREAD_HALT) {
-			break;
-		}
-		else if (status == ThreadStatus::THREAD_PAUSE) {
-			this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-			continue;
-		}
-		else if (status == ThreadStatus::THREAD_NONE) {
-			this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-			continue;
-		}
-		else if (status == ThreadStatus::THREAD_RUN) {
-			//read frame here
-			if (funcFlag()) {
-				if (av_read_frame(screen->formatContext, screen->packet) == 0) {
-					if (screen->packet->stream_index == screen->videoStreamIndex) {
-						ret = decodeVideo(screen);
-					}
-					else if (screen->packet->stream_index == screen->audioStreamIndex) {
-						ret = decodeAudio(screen);
-					}
-					else {
-						ret = -1;
-					}
-					av_packet_unref(screen->packet);
-					if (ret < 0) {
-						this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-					}
-				}
-				else {
-					emit screen->endOfFile();
-					this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-				}
-			}
-			else {
-				this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-			}
-		}
-		else {
-			qDebug("in readThread: fatel error");
-			ret = -1;
-			break;
-		}
+void ScreenWidget::setHeadless(bool on)
+{
+	headless = on;
+	openVideoOutput();
+}
+
+void ScreenWidget::openVideoOutput(void)
+{
+	closeVideoOutput();
+	auto backend = videoBackend;
+	if (headless && backend == VideoOutput::Backend::BACKEND_WIDGET) {
+		backend = VideoOutput::Backend::BACKEND_NULL;
+	}
+	if (backend == VideoOutput::Backend::BACKEND_WIDGET) {
+		videoOutput = &screenOutput;
+		return;
 	}
 
-	screen->threadCount--;
-	qDebug("readThread done");
-	return ret;
+	//the window stays black meanwhile
+	screenOutput.clear();
+	videoOutput = VideoOutput::create(backend, offscreenWidth, offscreenHeight);
+	if (!videoOutput) {
+		showError("no offscreen GL context, presenting to null");
+		videoOutput = VideoOutput::create(VideoOutput::Backend::BACKEND_NULL, 0, 0);
+	}
+	qDebug("video output: %s", VideoOutput::backendName(videoOutput->backend()));
 }
 
-int ScreenWidget::decodeVideo(ScreenWidget* screen)
+void ScreenWidget::closeVideoOutput(void)
 {
-	int ret = avcodec_send_packet(screen->videoCodecContext, screen->packet);
-	if (ret < 0) {
-		qDebug("video avcodec_send_packet error");
-		//char log[512] = { 0 };
-		//av_strerror(ret, log, 512);
-		//qDebug(log);
-		return -1;
+	if (videoOutput != &screenOutput) {
+		delete videoOutput;
 	}
+	videoOutput = nullptr;
+}
 
-	while (true) {
-		auto frame = screen->frame;
-
-		ret = avcodec_receive_frame(screen->videoCodecContext, frame);
-		if (ret < 0) {
-			// those two return values are special and mean there is no output
-			// frame available, but there were no errors during decoding
-			if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
-				return 0;
-			}
-			else {
-				qDebug("video avcodec_receive_frame error");
-				return -1;
-			}
-		}
+void ScreenWidget::closeAudioOutput(void)
+{
+	if (audioOutput) {
+		audioOutput->stop();
+		delete audioOutput;
+		audioOutput = nullptr;
+	}
+}
 
-		VideoData data;
-		data.bufSize = av_image_alloc(
-			data.videoData, data.videoLinesize,
-			frame->width, frame->height,
-			AVPixelFormat::AV_PIX_FMT_RGB24, 1);
+void ScreenWidget::showError(const char* msg)
+{
+	if (headless) {
+		qDebug("error: %s", msg);
+		return;
+	}
+	QMessageBox::critical(nullptr, "error", msg, QMessageBox::Ok);
+}
 
-		if (data.bufSize < 0) {
-			qDebug("video av_image_alloc error");
-			av_frame_unref(frame);
-			return -1;
-		}
+bool ScreenWidget::isStreamUrl(const QString& path)
+{
+	static const char* schemes[] = {
+		"http", "https", "hls", "rtsp", "rtsps", "rtmp", "rtmps",
+		"rtp", "udp", "tcp", "srt"
+	};
 
-		sws_scale(screen->sws_ctx, (const uint8_t* const*)frame->data,
-			frame->linesize, 0, frame->height, data.videoData, data.videoLinesize);
+	if (path.endsWith(".m3u8", Qt::CaseInsensitive)) {
+		return true;
+	}
 
-		data.pts = chrono::microseconds(
-			ts_to_microsecond(frame->pts,
-				screen->formatContext->streams[screen->videoStreamIndex]->time_base)
-		);
-		data.duration = chrono::microseconds(
-			ts_to_microsecond(frame->pkt_duration,
-				screen->formatContext->streams[screen->videoStreamIndex]->time_base)
-		);
+	auto scheme = QUrl(path).scheme().toLower();
+	for (auto s : schemes) {
+		if (scheme == s) {
+			return true;
+		}
+	}
+	return false;
+}
 
-		av_frame_unref(frame);
+void ScreenWidget::setStreamOptions(AVDictionary** opt, const QString& path, JitterBuffer::Preset p)
+{
+	//fail stalled reads instead of blocking, demuxTask reconnects
+	av_dict_set(opt, "rw_timeout", "5000000", 0);
 
-		screen->videoLock.lock();
-		screen->videoFrameList.push_back(data);
-		screen->videoLock.unlock();
+	if (path.startsWith("http", Qt::CaseInsensitive)) {
+		av_dict_set(opt, "reconnect", "1", 0);
+		av_dict_set(opt, "reconnect_streamed", "1", 0);
+		av_dict_set(opt, "reconnect_delay_max", "4", 0);
+	}
+	else if (path.startsWith("rtsp", Qt::CaseInsensitive)) {
+		av_dict_set(opt, "rtsp_transport", "tcp", 0);
 	}
 
-	return 0;
+	if (p == JitterBuffer::Preset::PRESET_LOW_LATENCY) {
+		av_dict_set(opt, "fflags", "nobuffer", 0);
+		av_dict_set(opt, "probesize", "500000", 0);
+		av_dict_set(opt, "analyzeduration", "500000", 0);
+	}
 }
 
-int ScreenWidget::decodeAudio(ScreenWidget* screen)
+int ScreenWidget::demuxTask(ScreenWidget* screen, std::chrono::microseconds* wait)
 {
-	int ret = avcodec_send_packet(screen->audioCodecContext, screen->packet);
-	if (ret < 0) {
-		qDebug("audio avcodec_send_packet error: %d", ret);
-		return -1;
-	}
+	ThreadStatus status = ThreadStatus::THREAD_NONE;
 
-	while (true) {
-		auto frame = screen->frame;
-		ret = avcodec_receive_frame(screen->audioCodecContext, frame);
-		if (ret < 0) {
-			// those two return values are special and mean there is no output
-			// frame available, but there were no errors during decoding
-			if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
-				return 0;
-			}
-			else {
-				qDebug("audio avcodec_receive_frame error");
-				return -1;
-			}
-		}
+	*wait = chrono::milliseconds(screen->threadInterval);
 
-		uint8_t** dst_data = nullptr;
-		int dst_linesize = 0;
-		auto dst_nb_samples = av_rescale_rnd(
-			frame->nb_samples,
-			//swr_get_delay(screen->swr_ctx, screen->audioCodecContext->sample_rate) + frame->nb_samples,
-			screen->audioSampleRate, frame->sample_rate, AV_ROUND_UP);
-		/*auto dst_nb_channels =
-			av_get_channel_layout_nb_channels(screen->audioCodecContext->channel_layout);*/
+	screen->lock.lock();
+	status = screen->readStatus;
+	screen->lock.unlock();
 
-		ret = av_samples_alloc_array_and_samples(&dst_data, &dst_linesize,
-			screen->audioChannels, dst_nb_samples,
-			screen->audioFromat, 0);
-		if (ret < 0) {
-			av_frame_unref(frame);
-			qDebug("audio av_samples_alloc_array_and_samples error");
-			return -1;
-		}
+	if (status == ThreadStatus::THREAD_HALT) {
+		qDebug("demuxTask done");
+		return 0;
+	}
+	else if (status == ThreadStatus::THREAD_NONE) {
+		return 1;
+	}
 
-		ret = swr_convert(screen->swr_ctx, dst_data, dst_nb_samples,
-			(const uint8_t**)frame->data, frame->nb_samples);
-		if (ret < 0) {
-			av_frame_unref(frame);
-			if (dst_data) {
-				av_freep(&dst_data[0]);
-				av_freep(&dst_data);
-			}
-			qDebug("audio swr_convert error");
-			return -1;
-		}
+	//keep receiving while paused, a live source catches up on resume
+	if (screen->jitterBuffer.full()) {
+		return 1;
+	}
 
-		auto dst_bufsize = av_samples_get_buffer_size(&dst_linesize, 
-			screen->audioChannels,
-			ret, screen->audioFromat, 1);
-		if (dst_bufsize < 0) {
-			av_frame_unref(frame);
-			if (dst_data) {
-				av_freep(&dst_data[0]);
-				av_freep(&dst_data);
-			}
-			qDebug("audio av_samples_get_buffer_size error");
-			return -1;
+	auto pkt = screen->demuxPacket;
+	int ret = 0;
+	{
+		TraceRecorder::Scope trace("demux av_read_frame");
+		ret = av_read_frame(screen->formatContext, pkt);
+		if (ret == 0) {
+			trace.setPts(tracePts(pkt->pts, screen->formatContext->streams[pkt->stream_index]->time_base));
+		}
+	}
+	if (ret == 0) {
+		//packets delivered before a reconnect are read again after the resume seek
+		if (!screen->m_takePacket(pkt)) {
+			av_packet_unref(pkt);
+			*wait = chrono::microseconds(0);
+			return 1;
 		}
 
-		emit screen->writeAudioData(dst_data[0], dst_bufsize);
+		int index = pkt->stream_index;
+		int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+		auto tb = screen->formatContext->streams[index]->time_base;
+		int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : dts;
+		screen->jitterBuffer.push(pkt, ts_to_microsecond(pts == AV_NOPTS_VALUE ? 0 : pts, tb));
+		av_packet_unref(pkt);
 
-		av_frame_unref(frame);
-		//av_freep(&dst_data[0]);
-		av_freep(&dst_data);
+		screen->reconnectCount = 0;
+		*wait = chrono::microseconds(0);
+		return 1;
 	}
 
-	return 0;
-}
+	if (screen->cancelToken.isCanceled()) {
+		return 0;
+	}
 
-std::chrono::milliseconds ScreenWidget::ts_to_millisecond(int64_t ts, AVRational time_base)
-{
-	int64_t arg = 1000 * ts * time_base.num / time_base.den;
-	return std::chrono::milliseconds(arg);
+	if (ret == AVERROR_EOF && !screen->liveStream) {
+		screen->jitterBuffer.setEof();
+		qDebug("demuxTask done: end of stream");
+		return 0;
+	}
+
+	//network error, or a live source went away
+	if (screen->reconnectCount >= 5) {
+		qDebug("demuxTask: giving up after %d reconnects", screen->reconnectCount);
+		screen->jitterBuffer.setEof();
+		return 0;
+	}
+	screen->reconnectCount++;
+	if (screen->reconnectStream() < 0) {
+		*wait = chrono::milliseconds(500 * screen->reconnectCount);
+	}
+	return 1;
 }
 
-std::chrono::milliseconds ScreenWidget::ts_to_millisecond(int64_t ts, int num, int den)
+int ScreenWidget::reconnectStream(void)
 {
-	int64_t arg = 1000 * ts * num / den;
+	int ret = 0;
+	AVFormatContext* fc = avformat_alloc_context();
+	if (!fc) {
+		return AVERROR(ENOMEM);
+	}
+	fc->interrupt_callback = formatContext->interrupt_callback;
+
+	AVDictionary* options = NULL;
+	setStreamOptions(&options, streamPath, streamPreset);
+	ret = avformat_open_input(&fc, streamPath.toStdString().c_str(), NULL, &options);
+	av_dict_free(&options);
+	if (ret < 0) {
+		qDebug("reconnect %d failed", reconnectCount);
+		return ret;
+	}
+
+	if ((ret = avformat_find_stream_info(fc, NULL)) < 0 ||
+		fc->nb_streams != formatContext->nb_streams) {
+		qDebug("reconnect %d: stream layout changed", reconnectCount);
+		avformat_close_input(&fc);
+		return ret < 0 ? ret : AVERROR(EINVAL);
+	}
+
+	if (!liveStream) {
+		//resume where we stopped, duplicates are filtered by dts in demuxTask
+		int index = videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex;
+		resumeDts = lastStreamDts;
+		if (lastStreamDts[index] != AV_NOPTS_VALUE) {
+			av_seek_frame(fc, index, lastStreamDts[index], AVSEEK_FLAG_BACKWARD);
+		}
+	}
+
+	applyDiscard(fc);
+	//only demuxTask touches formatContext while streaming
+	auto old = formatContext;
+	formatContext = fc;
+	avformat_close_input(&old);
+
+	reconnects++;
+	qDebug("reconnected %s", streamPath.toStdString().c_str());
+	return 0;
+}
+
+std::chrono::microseconds ScreenWidget::m_mediaClock(void)
+{
+	if (status != ScreenStatus::SCREEN_STATUS_PLAYING) {
+		return timeOffset;
+	}
+
+	auto dt = chrono::duration_cast<chrono::microseconds>(
+		clock->now() - startTimeStamp);
+	return timeOffset + chrono::microseconds((int64_t)(dt.count() * playbackSpeed));
+}
+
+std::chrono::microseconds ScreenWidget::mediaClock(void)
+{
+	lock_guard<mutex> guard(lock);
+	return m_mediaClock();
+}
+
+ScreenWidget::PlaybackStats ScreenWidget::playbackStats(void)
+{
+	PlaybackStats st;
+	st.position = mediaClock();
+	st.presentedFrames = presentedFrames;
+	st.lateFrames = lateFrames;
+	if (audioOutput) {
+		st.audioUnderruns = audioOutput->underruns();
+	}
+	return st;
+}
+
+ScreenWidget::ScrubStats ScreenWidget::scrubStatistics(void)
+{
+	lock_guard<mutex> guard(lock);
+	return scrubStats;
+}
+
+void ScreenWidget::setPlaybackSpeed(double speed)
+{
+	lock_guard<mutex> guard(lock);
+
+	//rebase so the clock stays continuous
+	timeOffset = m_mediaClock();
+	startTimeStamp = clock->now();
+	playbackSpeed = speed;
+	qDebug("playback speed %.3f", speed);
+}
+
+void ScreenWidget::skipClock(std::chrono::microseconds t)
+{
+	lock_guard<mutex> guard(lock);
+	timeOffset += t;
+}
+
+int ScreenWidget::m_seek(std::chrono::microseconds pos)
+{
+	if (streaming) {
+		qDebug("seek is not supported on network input");
+		return AVERROR(ENOSYS);
+	}
+
+	int index = videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex;
+	auto tb = formatContext->streams[index]->time_base;
+	int64_t ts = av_rescale_q(pos.count(), AVRational{ 1, 1000000 }, tb);
+	int ret = av_seek_frame(formatContext, index, ts, AVSEEK_FLAG_BACKWARD);
+	if (ret < 0) {
+		qDebug("av_seek_frame error: %d", ret);
+		return ret;
+	}
+
+	if (videoCodecContext)
+		avcodec_flush_buffers(videoCodecContext);
+	if (audioCodecContext)
+		avcodec_flush_buffers(audioCodecContext);
+	m_dropAudio();
+
+	//before the list is cleared, filterTask checks it under videoLock
+	videoFilter.flush();
+	audioMeter.flush();
+	videoLock.lock();
+	while (videoFrameList.size()) {
+		auto it = videoFrameList.begin();
+		av_freep(&(it->videoData[0]));
+		videoFrameList.pop_front();
+	}
+	videoLock.unlock();
+	//queued behind the audio written so far
+	emit flushAudio();
+
+	//the seek lands on a keyframe before pos, decode up to pos silently
+	skipUntil = pos;
+	governor.restart();
+	lock.lock();
+	timeOffset = pos;
+	startTimeStamp = clock->now();
+	lock.unlock();
+	return 0;
+}
+
+void ScreenWidget::m_scrubStep(std::chrono::microseconds* wait)
+{
+	lock.lock();
+	uint64_t serial = scrubSerial;
+	bool taken = scrubTaken;
+	auto target = scrubTarget;
+	auto requested = scrubRequestTime;
+	bool ending = scrubEnding;
+	scrubTaken = true;
+	lock.unlock();
+
+	if (!scrub.active) {
+		//leave the playback queue, scrub frames go to the screen directly
+		videoFilter.flush();
+		audioMeter.flush();
+		m_dropAudio();
+		videoLock.lock();
+		while (videoFrameList.size()) {
+			auto it = videoFrameList.begin();
+			av_freep(&(it->videoData[0]));
+			videoFrameList.pop_front();
+		}
+		videoLock.unlock();
+		emit flushAudio();
+		scrub = Scrub();
+		scrub.active = true;
+		//a target sent before this step is still new
+		scrub.serial = taken ? serial : serial - 1;
+	}
+
+	int ret = 0;
+	if (serial != scrub.serial) {
+		scrub.serial = serial;
+		scrub.targeted = true;
+		scrub.exact = false;
+		scrub.target = target;
+		scrub.requested = requested;
+		ret = m_scrubShow(false);
+		*wait = chrono::microseconds(0);
+	}
+	if (ret != AVERROR(EAGAIN) && scrub.targeted && !scrub.exact &&
+		(ending || chrono::steady_clock::now() - scrub.requested >= scrubRest)) {
+		//the cursor rests
+		ret = m_scrubShow(true);
+		*wait = chrono::microseconds(0);
+	}
+	if (ret == AVERROR(EAGAIN)) {
+		lock_guard<mutex> guard(lock);
+		scrubStats.canceled++;
+		return;
+	}
+	if (!ending || (scrub.targeted && !scrub.exact)) {
+		return;
+	}
+
+	lock.lock();
+	if (!scrubEnding) {
+		//dragged again before the end was handled
+		lock.unlock();
+		return;
+	}
+	bool resume = scrubResume;
+	scrubbing = false;
+	scrubEnding = false;
+	scrubResume = false;
+	lock.unlock();
+
+	//playback continues from the frame on screen
+	if (scrub.targeted) {
+		loopCache.clear();
+		loop = Loop();
+		m_seek(scrub.target);
+	}
+	else {
+		m_seek(mediaClock());
+	}
+	scrub = Scrub();
+	if (resume) {
+		emit changeScreenStatus(ScreenStatus::SCREEN_STATUS_PLAYING);
+	}
+}
+
+int64_t ScreenWidget::m_keyframe(int64_t ts, bool nearest)
+{
+	auto st = formatContext->streams[videoStreamIndex];
+	int64_t before = AV_NOPTS_VALUE;
+	int64_t after = AV_NOPTS_VALUE;
+	int i = av_index_search_timestamp(st, ts, AVSEEK_FLAG_BACKWARD);
+	if (i >= 0 && avformat_index_get_entry(st, i)) {
+		before = avformat_index_get_entry(st, i)->timestamp;
+	}
+	if (!nearest) {
+		return before;
+	}
+	i = av_index_search_timestamp(st, ts, 0);
+	if (i >= 0 && avformat_index_get_entry(st, i)) {
+		after = avformat_index_get_entry(st, i)->timestamp;
+	}
+	if (before == AV_NOPTS_VALUE) {
+		return after;
+	}
+	if (after == AV_NOPTS_VALUE) {
+		return before;
+	}
+	return ts - before <= after - ts ? before : after;
+}
+
+int ScreenWidget::m_scrubDecode(std::chrono::microseconds target, bool first)
+{
+	int ret = 0;
+	if (!scrubFrame) {
+		scrubFrame = av_frame_alloc();
+		if (!scrubFrame) {
+			return AVERROR(ENOMEM);
+		}
+	}
+	av_frame_unref(scrubFrame);
+
+	while (true) {
+		ret = avcodec_receive_frame(videoCodecContext, frame);
+		if (ret == 0) {
+			int64_t ts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+			auto pts = ts_to_microsecond(ts, videoTimeBase);
+			auto duration = ts_to_microsecond(frame->pkt_duration, videoTimeBase);
+			if (duration.count() <= 0) {
+				duration = videoFrameDuration;
+			}
+			scrub.decoded = pts;
+			if (first || pts + duration > target) {
+				av_frame_unref(scrubFrame);
+				return 1;
+			}
+			av_frame_unref(scrubFrame);
+			av_frame_move_ref(scrubFrame, frame);
+			continue;
+		}
+		if (ret == AVERROR_EOF) {
+			//the target is past the last frame, show that one
+			scrub.decoderKey = AV_NOPTS_VALUE;
+			if (scrubFrame->buf[0]) {
+				av_frame_move_ref(frame, scrubFrame);
+				return 1;
+			}
+			return 0;
+		}
+		if (ret != AVERROR(EAGAIN)) {
+			qDebug("scrub avcodec_receive_frame error: %d", ret);
+			return ret;
+		}
+
+		//a newer target makes this one pointless, checked per packet
+		if (scrubSerial != scrub.serial) {
+			return AVERROR(EAGAIN);
+		}
+		ret = av_read_frame(formatContext, packet);
+		if (ret == AVERROR_EOF) {
+			avcodec_send_packet(videoCodecContext, NULL);
+			continue;
+		}
+		if (ret < 0) {
+			qDebug("scrub av_read_frame error: %d", ret);
+			return ret;
+		}
+		if (packet->stream_index == videoStreamIndex) {
+			//audio is dropped, the end of the scrub seeks it again
+			ret = avcodec_send_packet(videoCodecContext, packet);
+			if (ret < 0 && ret != AVERROR(EAGAIN)) {
+				qDebug("scrub avcodec_send_packet error: %d", ret);
+			}
+		}
+		av_packet_unref(packet);
+	}
+}
+
+int ScreenWidget::m_scrubShow(bool exact)
+{
+	if (videoStreamIndex < 0) {
+		//nothing to show, the end of the scrub moves the audio
+		scrub.exact = true;
+		return 0;
+	}
+
+	auto tb = formatContext->streams[videoStreamIndex]->time_base;
+	int64_t ts = av_rescale_q(scrub.target.count(), AVRational{ 1, 1000000 }, tb);
+	int64_t key = m_keyframe(ts, !exact);
+	if (!exact && key != AV_NOPTS_VALUE && key == scrub.shownKey) {
+		//that keyframe is on screen already
+		return 0;
+	}
+
+	int ret = 0;
+	//the exact frame follows the keyframe on screen, decoding goes on from there
+	bool resume = exact && key != AV_NOPTS_VALUE && key == scrub.decoderKey &&
+		scrub.decoded < scrub.target;
+	if (!resume) {
+		int64_t seekTs = key != AV_NOPTS_VALUE ? key : ts;
+		ret = av_seek_frame(formatContext, videoStreamIndex, seekTs, AVSEEK_FLAG_BACKWARD);
+		if (ret < 0) {
+			qDebug("scrub av_seek_frame error: %d", ret);
+			scrub.exact = true;
+			return ret;
+		}
+		avcodec_flush_buffers(videoCodecContext);
+		scrub.decoderKey = key;
+		scrub.decoded = chrono::microseconds(-1);
+	}
+
+	ret = m_scrubDecode(scrub.target, !exact);
+	if (ret == AVERROR(EAGAIN)) {
+		//the decoder stays where it is, a refinement in this GOP goes on
+		return ret;
+	}
+	if (ret <= 0) {
+		//nothing more to decode for this target
+		scrub.exact = true;
+		return ret;
+	}
+
+	int64_t fts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+	auto pts = ts_to_microsecond(fts, videoTimeBase);
+	auto duration = ts_to_microsecond(frame->pkt_duration, videoTimeBase);
+	if (duration.count() <= 0) {
+		duration = videoFrameDuration;
+	}
+	//a keyframe on the target is the exact frame too
+	bool covers = pts <= scrub.target && scrub.target < pts + duration;
+
+	VideoData data;
+	data.pts = pts;
+	data.duration = duration;
+	data.scrubRequested = chrono::duration_cast<chrono::microseconds>(
+		scrub.requested.time_since_epoch()).count();
+	data.scrubExact = exact || covers;
+	ret = convertFrame(&scalers, frame, &data);
+	av_frame_unref(frame);
+	if (ret < 0) {
+		scrub.exact = true;
+		return ret;
+	}
+	emit drawVideoFrame(data);
+
+	scrub.exact = data.scrubExact;
+	//an exact frame leaves the GOP start, the next keyframe is drawn again
+	scrub.shownKey = exact ? AV_NOPTS_VALUE : key;
+	return 0;
+}
+
+void ScreenWidget::m_applyQuality(void)
+{
+	auto q = governor.current();
+	if ((int)q == appliedQuality) {
+		return;
+	}
+	//the decoders read these per frame
+	videoCodecContext->skip_loop_filter = q >= QualityGovernor::Level::LEVEL_SKIP_LOOP_FILTER ?
+		AVDiscard::AVDISCARD_ALL : AVDiscard::AVDISCARD_DEFAULT;
+	videoCodecContext->skip_frame = q >= QualityGovernor::Level::LEVEL_SKIP_NONREF ?
+		AVDiscard::AVDISCARD_NONREF : AVDiscard::AVDISCARD_DEFAULT;
+	appliedQuality = (int)q;
+}
+
+bool ScreenWidget::m_takePacket(const AVPacket* pkt)
+{
+	int index = pkt->stream_index;
+	if (index != videoStreamIndex && index != audioStreamIndex) {
+		//the demuxer may deliver a few despite the discard
+		return false;
+	}
+	if (index >= (int)resumeDts.size()) {
+		//a stream that appeared after the open
+		return true;
+	}
+
+	int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+	if (resumeDts[index] != AV_NOPTS_VALUE) {
+		if (dts != AV_NOPTS_VALUE && dts <= resumeDts[index]) {
+			return false;
+		}
+		resumeDts[index] = AV_NOPTS_VALUE;
+	}
+	lastStreamDts[index] = dts;
+	return true;
+}
+
+void ScreenWidget::applyDiscard(AVFormatContext* fc)
+{
+	for (unsigned int i = 0; i < fc->nb_streams; i++) {
+		bool used = (int)i == videoStreamIndex || (int)i == audioStreamIndex;
+		fc->streams[i]->discard = used ? AVDiscard::AVDISCARD_DEFAULT : AVDiscard::AVDISCARD_ALL;
+	}
+}
+
+int ScreenWidget::m_selectTrack(int index)
+{
+	//demuxTask may be replacing formatContext on a reconnect
+	if (streaming) {
+		qDebug("track switch is not supported on network input");
+		return AVERROR(ENOSYS);
+	}
+	if (index < 0 || index >= (int)formatContext->nb_streams) {
+		return AVERROR(EINVAL);
+	}
+	auto st = formatContext->streams[index];
+	bool video = st->codecpar->codec_type == AVMediaType::AVMEDIA_TYPE_VIDEO;
+	if (!video && st->codecpar->codec_type != AVMediaType::AVMEDIA_TYPE_AUDIO) {
+		return AVERROR(EINVAL);
+	}
+	if (index == (video ? videoStreamIndex : audioStreamIndex)) {
+		return 0;
+	}
+	if (video ? !videoCodecContext : !audioCodecContext) {
+		//there is no output for it
+		qDebug("file was opened without %s", video ? "video" : "audio");
+		return AVERROR(EINVAL);
+	}
+
+	AVCodecContext* cc = nullptr;
+	int ret = openCodexContext(&cc, formatContext, index);
+	if (ret < 0) {
+		avcodec_free_context(&cc);
+		return ret;
+	}
+
+	SwrContext* swr = nullptr;
+	if (!video) {
+		int64_t layout = cc->channel_layout ? cc->channel_layout : av_get_default_channel_layout(cc->channels);
+		//the sink keeps its format, another channel count is remixed
+		int64_t outLayout = av_get_channel_layout_nb_channels(layout) == audioChannels ?
+			layout : av_get_default_channel_layout(audioChannels);
+		swr = swr_alloc_set_opts(NULL, outLayout, audioFromat, audioSampleRate,
+			layout, cc->sample_fmt, cc->sample_rate, 0, NULL);
+		if (!swr || (ret = swr_init(swr)) < 0) {
+			qDebug("track %d: cannot set up the resampler", index);
+			swr_free(&swr);
+			avcodec_free_context(&cc);
+			return swr ? ret : AVERROR(ENOMEM);
+		}
+	}
+
+	//a pass of an A-B loop was cached from the old track, leave it like a seek does
+	bool looping = loop.mode != LoopMode::LOOP_NONE;
+	auto pos = mediaClock() - loop.offset;
+	if (looping) {
+		loopCache.clear();
+		loop = Loop();
+	}
+
+	lock.lock();
+	if (video) {
+		avcodec_free_context(&videoCodecContext);
+		videoCodecContext = cc;
+		videoStreamIndex = index;
+	}
+	else {
+		avcodec_free_context(&audioCodecContext);
+		swr_free(&swr_ctx);
+		audioCodecContext = cc;
+		swr_ctx = swr;
+		audioStreamIndex = index;
+	}
+	lock.unlock();
+	applyDiscard(formatContext);
+
+	if (video) {
+		videoWidth = cc->width;
+		videoHeight = cc->height;
+		videoTimeBase = st->time_base;
+		appliedQuality = -1;
+		AVRational frameRate = av_guess_frame_rate(formatContext, st, NULL);
+		if (frameRate.num > 0 && frameRate.den > 0) {
+			videoFrameDuration = ts_to_microsecond(1, av_inv_q(frameRate));
+		}
+		videoFilter.setFrameRate(frameRate);
+	}
+	else {
+		audioTimeBase = st->time_base;
+		compensating = false;
+		audioPath = chooseAudioPath(cc, audioSampleRate, audioChannels, audioFromat);
+		qDebug("track %d: audio %s", index, audioPathName(audioPath));
+	}
+
+	if (looping) {
+		ret = m_seek(pos);
+		qDebug("track %d selected, loop left at %lld ms", index, (long long)pos.count() / 1000);
+		return ret;
+	}
+
+	//rewind to the playback position, the stream that stays skips
+	//the packets it has decoded already
+	int seekIndex = video || videoStreamIndex < 0 ? index : videoStreamIndex;
+	auto tb = formatContext->streams[seekIndex]->time_base;
+	ret = av_seek_frame(formatContext, seekIndex,
+		av_rescale_q(pos.count(), AVRational{ 1, 1000000 }, tb), AVSEEK_FLAG_BACKWARD);
+	if (ret < 0) {
+		//the new track starts where the demuxer is
+		qDebug("track %d: av_seek_frame error %d", index, ret);
+	}
+	else {
+		resumeDts = lastStreamDts;
+		resumeDts[index] = AV_NOPTS_VALUE;
+	}
+	lastStreamDts[index] = AV_NOPTS_VALUE;
+
+	if (video) {
+		//before the list is cleared, filterTask checks it under videoLock
+		videoFilter.flush();
+		videoLock.lock();
+		while (videoFrameList.size()) {
+			auto it = videoFrameList.begin();
+			av_freep(&(it->videoData[0]));
+			videoFrameList.pop_front();
+		}
+		videoLock.unlock();
+		skipUntil = pos;
+	}
+	else {
+		//the sink plays out what it holds, the new track continues after it.
+		//packets of the old track were queued for the old decoder
+		m_dropAudio();
+		audioMeter.flush();
+		emit flushAudio();
+		skipUntil = pos + audioLatency();
+	}
+
+	qDebug("track %d selected at %lld ms", index, (long long)pos.count() / 1000);
+	return 0;
+}
+
+void ScreenWidget::m_setLoop(std::chrono::microseconds a, std::chrono::microseconds b)
+{
+	if (b <= a) {
+		if (loop.mode == LoopMode::LOOP_NONE) {
+			return;
+		}
+
+		//continue from the same file position without the loop
+		auto pos = mediaClock() - loop.offset;
+		pos = max(loop.a, min(pos, loop.b));
+		qDebug("loop cleared after %lld passes", (long long)loop.passes);
+		loopCache.clear();
+		loop = Loop();
+		m_seek(pos);
+		return;
+	}
+
+	if (m_seek(a) < 0) {
+		loopCache.clear();
+		loop = Loop();
+		return;
+	}
+
+	loopCache.reset(loopCacheBudget);
+	loop = Loop();
+	loop.mode = LoopMode::LOOP_FILL;
+	loop.a = a;
+	loop.b = b;
+	loop.videoDone = videoCodecContext == nullptr;
+	loop.audioDone = audioCodecContext == nullptr;
+	qDebug("loop %lld - %lld ms", (long long)a.count() / 1000, (long long)b.count() / 1000);
+}
+
+void ScreenWidget::m_wrapLoop(void)
+{
+	if (loop.mode == LoopMode::LOOP_FILL) {
+		//the file ended before b
+		if (loop.end > loop.a && loop.end < loop.b) {
+			loop.b = loop.end;
+		}
+
+		//first pass done, keep the cheapest complete copy of the segment
+		if (loopCache.hasFrames()) {
+			loopCache.dropPackets();
+			loop.mode = LoopMode::LOOP_FRAMES;
+		}
+		else if (loopCache.hasPackets()) {
+			loop.mode = LoopMode::LOOP_PACKETS;
+		}
+		else {
+			loopCache.clear();
+			loop.mode = LoopMode::LOOP_SEEK;
+		}
+		qDebug("loop cached: mode %d, %d MB", (int)loop.mode, (int)(loopCache.memoryUsage() >> 20));
+	}
+
+	if (loop.mode == LoopMode::LOOP_PACKETS || loop.mode == LoopMode::LOOP_SEEK) {
+		if (videoCodecContext)
+			avcodec_flush_buffers(videoCodecContext);
+		if (audioCodecContext)
+			avcodec_flush_buffers(audioCodecContext);
+	}
+	if (loop.mode == LoopMode::LOOP_SEEK) {
+		int index = videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex;
+		auto tb = formatContext->streams[index]->time_base;
+		av_seek_frame(formatContext, index,
+			av_rescale_q(loop.a.count(), AVRational{ 1, 1000000 }, tb), AVSEEK_FLAG_BACKWARD);
+	}
+
+	loop.offset += loop.b - loop.a;
+	loop.videoDone = videoCodecContext == nullptr;
+	loop.audioDone = audioCodecContext == nullptr;
+	loop.videoCursor = 0;
+	loop.audioCursor = 0;
+	loop.packetCursor = 0;
+	loop.passes++;
+}
+
+bool ScreenWidget::m_videoWindow(std::chrono::microseconds pts)
+{
+	if (loop.mode == LoopMode::LOOP_NONE) {
+		return pts >= skipUntil;
+	}
+
+	if (pts >= loop.b) {
+		loop.videoDone = true;
+		return false;
+	}
+	return pts >= loop.a;
+}
+
+int ScreenWidget::m_loopFunc(ScreenWidget* screen, std::chrono::microseconds* wait)
+{
+	auto& loop = screen->loop;
+	auto& cache = screen->loopCache;
+	int ret = 0;
+
+	*wait = chrono::microseconds(0);
+
+	if (loop.videoDone && loop.audioDone) {
+		//audioTask finishes the pass before the offset moves on
+		screen->audioQueueLock.lock();
+		bool queued = !screen->audioPacketList.empty();
+		screen->audioQueueLock.unlock();
+		if (queued) {
+			*wait = chrono::milliseconds(screen->threadInterval);
+			return 1;
+		}
+
+		//stay less than a second ahead of playback, bounds the audio queue
+		auto ahead = loop.offset + loop.b - chrono::seconds(1) - screen->mediaClock();
+		if (ahead.count() > 0) {
+			*wait = min<chrono::microseconds>(ahead, chrono::milliseconds(10));
+			return 1;
+		}
+		screen->m_wrapLoop();
+		return 1;
+	}
+
+	if (loop.mode == LoopMode::LOOP_FRAMES) {
+		//no decoding, copy the next cached frame or samples in pts order
+		bool video = loop.videoCursor < cache.frameCount();
+		bool audio = loop.audioCursor < cache.samplesCount();
+		if (video && audio) {
+			video = cache.frame(loop.videoCursor).pts <= cache.samples(loop.audioCursor).pts;
+		}
+
+		if (video) {
+			auto& f = cache.frame(loop.videoCursor++);
+			VideoData data;
+			data.videoData[0] = (uint8_t*)av_malloc(f.size);
+			if (data.videoData[0]) {
+				memcpy(data.videoData[0], f.data, f.size);
+				data.videoLinesize[0] = f.linesize;
+				data.bufSize = f.size;
+				data.width = f.width;
+				data.height = f.height;
+				data.pts = f.pts + loop.offset;
+				data.duration = f.duration;
+				screen->serveFrame(data);
+				screen->videoLock.lock();
+				screen->videoFrameList.push_back(data);
+				screen->videoLock.unlock();
+			}
+		}
+		else if (audio) {
+			auto& a = cache.samples(loop.audioCursor++);
+			auto data = (uint8_t*)av_malloc(a.size);
+			if (data) {
+				memcpy(data, a.data, a.size);
+				screen->tapAudio(data, a.size, a.pts + loop.offset);
+				int frameSize = screen->audioChannels * av_get_bytes_per_sample(screen->audioFromat);
+				auto end = a.pts + loop.offset + chrono::microseconds(
+					(int64_t)a.size / frameSize * 1000000 / screen->audioSampleRate);
+				emit screen->writeAudioData(data, a.size, end.count());
+			}
+		}
+		else {
+			loop.videoDone = true;
+			loop.audioDone = true;
+		}
+		return 1;
+	}
+
+	if (loop.mode == LoopMode::LOOP_PACKETS) {
+		if (loop.packetCursor >= cache.packetCount()) {
+			loop.videoDone = true;
+			loop.audioDone = true;
+			return 1;
+		}
+		ret = av_packet_ref(screen->packet, cache.packet(loop.packetCursor++));
+	}
+	else {
+		TraceRecorder::Scope trace("av_read_frame");
+		ret = av_read_frame(screen->formatContext, screen->packet);
+		if (ret == 0 && loop.mode == LoopMode::LOOP_FILL) {
+			cache.addPacket(screen->packet);
+		}
+	}
+
+	if (ret < 0) {
+		//end of file inside the loop
+		loop.videoDone = true;
+		loop.audioDone = true;
+		return 1;
+	}
+
+	if (screen->packet->stream_index == screen->videoStreamIndex) {
+		decodeVideo(screen);
+	}
+	else if (screen->packet->stream_index == screen->audioStreamIndex) {
+		queueAudio(screen);
+	}
+	av_packet_unref(screen->packet);
+	return 1;
+}
+
+int ScreenWidget::m_openFileHW(const QString& path)
+{
+	return 0;
+}
+
+void ScreenWidget::postTask(ScreenWidget* screen, NemoThreadPool::Priority p,
+	StepFunc step, std::chrono::microseconds delay)
+{
+	auto token = screen->cancelToken;
+	NemoThreadPool::instance()->postDelayed(p, delay, [screen, p, step, token]() {
+		chrono::microseconds wait(0);
+		if (!token.isCanceled() && step(screen, &wait) > 0) {
+			postTask(screen, p, step, wait);
+		}
+		else {
+			//last access to screen, clearOnClose may return now
+			screen->taskLock.lock();
+			screen->taskCount--;
+			screen->taskLock.unlock();
+			screen->taskCV.notify_all();
+		}
+	}, &token);
+}
+
+int ScreenWidget::readTask(ScreenWidget* screen, std::chrono::microseconds* wait)
+{
+	ThreadStatus status = ThreadStatus::THREAD_NONE;
+	int ret = 0;
+
+	//frames waiting for the filter count as decoded, else the decoder
+	//bursts into its short queue after a seek and frames are dropped.
+	//audio waiting for audioTask bounds the read too
+	auto funcFlag = [screen]() {
+		screen->audioQueueLock.lock();
+		bool audioRoom = screen->audioPacketList.size() < audioQueueLimit;
+		screen->audioQueueLock.unlock();
+		if (screen->audioCodecContext && screen->videoCodecContext) {
+			return audioRoom &&
+				(screen->videoFrameList.size() + screen->videoFilter.depth() < screen->videoPreload);
+		}
+		else if (screen->audioCodecContext && !screen->videoCodecContext) {
+			return audioRoom && screen->audioDevice->level() < screen->audioWatermark;
+		}
+		else if (!screen->audioCodecContext && screen->videoCodecContext) {
+			return screen->videoFrameList.size() + screen->videoFilter.depth() < screen->videoPreload;
+		}
+		else {
+			return false;
+		}
+	};
+
+	*wait = chrono::milliseconds(screen->threadInterval);
+
+	screen->lock.lock();
+	status = screen->readStatus;
+	bool playing = screen->status == ScreenStatus::SCREEN_STATUS_PLAYING;
+	if (status != ThreadStatus::THREAD_HALT && (screen->scrubbing || screen->scrub.active)) {
+		//other requests wait for the end of the scrub
+		screen->lock.unlock();
+		lock_guard<mutex> guard(screen->audioLock);
+		screen->m_scrubStep(wait);
+		return 1;
+	}
+	bool seekPending = screen->seekPending;
+	auto seekTarget = screen->seekTarget;
+	bool loopPending = screen->loopPending;
+	auto loopA = screen->loopRequestA;
+	auto loopB = screen->loopRequestB;
+	int videoTrack = screen->videoTrackRequest;
+	int audioTrack = screen->audioTrackRequest;
+	screen->seekPending = false;
+	screen->loopPending = false;
+	screen->videoTrackRequest = -1;
+	screen->audioTrackRequest = -1;
+	screen->lock.unlock();
+
+	if (status == ThreadStatus::THREAD_HALT) {
+		qDebug("readTask done");
+		return 0;
+	}
+
+	if (loopPending || seekPending || videoTrack >= 0 || audioTrack >= 0) {
+		//audioTask is between packets
+		lock_guard<mutex> guard(screen->audioLock);
+		if (loopPending) {
+			screen->m_setLoop(loopA, loopB);
+		}
+		else if (seekPending) {
+			//a plain seek leaves the loop
+			screen->loopCache.clear();
+			screen->loop = Loop();
+			screen->m_seek(seekTarget);
+		}
+		if (videoTrack >= 0) {
+			screen->m_selectTrack(videoTrack);
+		}
+		if (audioTrack >= 0) {
+			screen->m_selectTrack(audioTrack);
+		}
+	}
+
+	if (status == ThreadStatus::THREAD_PAUSE) {
+		return 1;
+	}
+	else if (status == ThreadStatus::THREAD_NONE) {
+		return 1;
+	}
+	else if (status == ThreadStatus::THREAD_RUN) {
+		if (screen->videoCodecContext) {
+			if (playing) {
+				screen->governor.update(chrono::steady_clock::now(), screen->videoFrameDuration,
+					(int)screen->videoFrameList.size(), screen->videoPreload, screen->lateFrames);
+			}
+			screen->m_applyQuality();
+		}
+
+		//read frame here
+		if (funcFlag()) {
+			if (screen->loop.mode != LoopMode::LOOP_NONE) {
+				lock_guard<mutex> guard(screen->audioLock);
+				m_loopFunc(screen, wait);
+				return 1;
+			}
+
+			if (screen->streaming) {
+				ret = screen->jitterBuffer.pop(screen->packet);
+
+				//apply the catch-up decided by the jitter buffer
+				auto skipped = screen->jitterBuffer.takeSkipped();
+				if (skipped.count() > 0) {
+					screen->skipClock(skipped);
+				}
+				auto speed = screen->jitterBuffer.playbackSpeed();
+				if (speed != screen->playbackSpeed) {
+					screen->setPlaybackSpeed(speed);
+				}
+			}
+			else {
+				TraceRecorder::Scope trace("av_read_frame");
+				ret = av_read_frame(screen->formatContext, screen->packet);
+				if (ret == 0) {
+					trace.setPts(tracePts(screen->packet->pts,
+						screen->formatContext->streams[screen->packet->stream_index]->time_base));
+				}
+			}
+
+			if (ret == 0) {
+				//demuxTask has filtered network input already
+				if (!screen->streaming && !screen->m_takePacket(screen->packet)) {
+					//another stream, or read before a track switch
+				}
+				else if (screen->packet->stream_index == screen->videoStreamIndex) {
+					ret = decodeVideo(screen);
+				}
+				else if (screen->packet->stream_index == screen->audioStreamIndex) {
+					ret = queueAudio(screen);
+				}
+				av_packet_unref(screen->packet);
+				if (ret >= 0) {
+					*wait = chrono::microseconds(0);
+				}
+			}
+			else if (ret == AVERROR(EAGAIN)) {
+				//jitter buffer is filling
+			}
+			else if (!screen->cancelToken.isCanceled()) {
+				//filterTask outputs what the filters still hold
+				screen->videoFilter.finish();
+				emit screen->endOfFile();
+			}
+		}
+		return 1;
+	}
+	else {
+		qDebug("in readTask: fatel error");
+		return 0;
+	}
+}
+
+int ScreenWidget::decodeVideo(ScreenWidget* screen)
+{
+	int ret = 0;
+	//the governor weighs decode and conversion against the frame duration
+	auto t0 = chrono::steady_clock::now();
+	int frames = 0;
+	auto quality = screen->governor.current();
+	screen->scalers.setFlags(QualityGovernor::scalerFlags(quality));
+	{
+		TraceRecorder::Scope trace("video send_packet", tracePts(screen->packet->pts, screen->videoTimeBase));
+		ret = avcodec_send_packet(screen->videoCodecContext, screen->packet);
+	}
+	if (ret < 0) {
+		qDebug("video avcodec_send_packet error");
+		//char log[512] = { 0 };
+		//av_strerror(ret, log, 512);
+		//qDebug(log);
+		return -1;
+	}
+
+	while (true) {
+		auto frame = screen->frame;
+
+		{
+			TraceRecorder::Scope trace("video receive_frame");
+			ret = avcodec_receive_frame(screen->videoCodecContext, frame);
+			if (ret == 0) {
+				trace.setPts(tracePts(frame->pts, screen->videoTimeBase));
+			}
+		}
+		if (ret < 0) {
+			// those two return values are special and mean there is no output
+			// frame available, but there were no errors during decoding
+			if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
+				screen->governor.onDecode(chrono::duration_cast<chrono::microseconds>(
+					chrono::steady_clock::now() - t0), frames);
+				return 0;
+			}
+			else {
+				qDebug("video avcodec_receive_frame error");
+				return -1;
+			}
+		}
+
+		frames++;
+		auto pts = ts_to_microsecond(frame->pts, screen->videoTimeBase);
+		if (frame->width != screen->videoWidth || frame->height != screen->videoHeight) {
+			qDebug("video size changed: %dx%d to %dx%d, format %s",
+				screen->videoWidth, screen->videoHeight, frame->width, frame->height,
+				av_get_pix_fmt_name((AVPixelFormat)frame->format));
+			screen->videoWidth = frame->width;
+			screen->videoHeight = frame->height;
+		}
+		auto duration = ts_to_microsecond(frame->pkt_duration, screen->videoTimeBase);
+		if (duration.count() <= 0) {
+			//generated sources leave it unset
+			duration = screen->videoFrameDuration;
+		}
+		if (!screen->m_videoWindow(pts)) {
+			//skip the conversion of frames before a seek target
+			av_frame_unref(frame);
+			continue;
+		}
+		if (screen->loop.mode != LoopMode::LOOP_NONE) {
+			if (pts + duration > screen->loop.b) {
+				duration = screen->loop.b - pts;
+			}
+			screen->loop.end = max(screen->loop.end, pts + duration);
+		}
+
+		if (screen->frameServer.isActive() &&
+			screen->frameServer.currentFormat() == FrameServer::Format::FORMAT_NATIVE) {
+			//the decoder output, the loop replays of cached frames are not served
+			TraceRecorder::Scope trace("frame server", (pts + screen->loop.offset).count());
+			screen->frameServer.publish((pts + screen->loop.offset).count(), (AVPixelFormat)frame->format,
+				frame->width, frame->height, frame->data, frame->linesize);
+		}
+
+		if (screen->videoFilter.enabled()) {
+			//filtered output arrives later, a loop replays the
+			//packets through the filter instead of caching frames
+			if (screen->loop.mode == LoopMode::LOOP_FILL) {
+				screen->loopCache.dropFrames();
+			}
+			frame->pts = (pts + screen->loop.offset).count();
+			frame->pkt_duration = duration.count();
+			if (!screen->videoFilter.push(frame)) {
+				TraceRecorder::instance()->instant("video filter drop", frame->pts);
+			}
+			TraceRecorder::instance()->counter("video filter queue", (int64_t)screen->videoFilter.depth());
+			av_frame_unref(frame);
+			continue;
+		}
+
+		VideoData data;
+		data.pts = pts + screen->loop.offset;
+		data.duration = duration;
+		if (convertFrame(&screen->scalers, frame, &data, QualityGovernor::sizeDivisor(quality)) < 0) {
+			av_frame_unref(frame);
+			return -1;
+		}
+		screen->serveFrame(data);
+
+		if (screen->loop.mode == LoopMode::LOOP_FILL) {
+			screen->loopCache.addFrame(data.videoData[0], data.videoLinesize[0],
+				data.bufSize, data.width, data.height, pts, duration);
+		}
+
+		av_frame_unref(frame);
+
+		screen->videoLock.lock();
+		screen->videoFrameList.push_back(data);
+		auto depth = screen->videoFrameList.size();
+		screen->videoLock.unlock();
+		TraceRecorder::instance()->instant("video queue push", data.pts.count());
+		TraceRecorder::instance()->counter("video queue", (int64_t)depth);
+	}
+
+	return 0;
+}
+
+int ScreenWidget::convertFrame(ScalerCache* scalers, const AVFrame* frame, VideoData* data, int divisor)
+{
+	int width = max(1, frame->width / divisor);
+	int height = max(1, frame->height / divisor);
+	//per frame, the size or format may change mid-stream
+	auto sws_ctx = scalers->get(ScalerCache::frameKey(frame,
+		width, height, AVPixelFormat::AV_PIX_FMT_RGB24));
+	if (!sws_ctx) {
+		qDebug("video sws_getContext error");
+		return -1;
+	}
+
+	data->width = width;
+	data->height = height;
+	data->bufSize = av_image_alloc(
+		data->videoData, data->videoLinesize,
+		width, height,
+		AVPixelFormat::AV_PIX_FMT_RGB24, 1);
+
+	if (data->bufSize < 0) {
+		qDebug("video av_image_alloc error");
+		return -1;
+	}
+
+	TraceRecorder::Scope trace("video convert", data->pts.count());
+	sws_scale(sws_ctx, (const uint8_t* const*)frame->data,
+		frame->linesize, 0, frame->height, data->videoData, data->videoLinesize);
+	return 0;
+}
+
+int ScreenWidget::filterTask(ScreenWidget* screen, std::chrono::microseconds* wait)
+{
+	screen->lock.lock();
+	ThreadStatus status = screen->readStatus;
+	screen->lock.unlock();
+
+	if (status == ThreadStatus::THREAD_HALT) {
+		qDebug("filterTask done");
+		return 0;
+	}
+
+	uint64_t gen = 0;
+	vector<AVFrame*> out;
+	AVFrame* in = screen->videoFilter.take(&gen);
+	if (in) {
+		TraceRecorder::Scope trace("video filter", in->pts);
+		screen->videoFilter.process(in, gen, &out);
+		av_frame_free(&in);
+	}
+	else if (screen->videoFilter.takeEnd(&gen)) {
+		TraceRecorder::Scope trace("video filter drain");
+		screen->videoFilter.drain(gen, &out);
+	}
+	else {
+		//idle until a chain is set
+		*wait = screen->videoFilter.enabled() ?
+			chrono::milliseconds(screen->threadInterval) : chrono::milliseconds(10);
+		return 1;
+	}
+
+	for (auto f : out) {
+		VideoData data;
+		data.pts = chrono::microseconds(f->pts);
+		data.duration = chrono::microseconds(f->pkt_duration);
+		auto quality = screen->governor.current();
+		screen->filterScalers.setFlags(QualityGovernor::scalerFlags(quality));
+		if (f->pts != AV_NOPTS_VALUE && convertFrame(&screen->filterScalers, f, &data,
+			QualityGovernor::sizeDivisor(quality)) >= 0) {
+			screen->serveFrame(data);
+			//a seek since take() makes the frame stale
+			screen->videoLock.lock();
+			bool stale = !screen->videoFilter.current(gen);
+			if (!stale) {
+				screen->videoFrameList.push_back(data);
+			}
+			auto depth = screen->videoFrameList.size();
+			screen->videoLock.unlock();
+			if (stale) {
+				av_freep(&data.videoData[0]);
+			}
+			else {
+				TraceRecorder::instance()->instant("video queue push", data.pts.count());
+				TraceRecorder::instance()->counter("video queue", (int64_t)depth);
+			}
+		}
+		av_frame_free(&f);
+	}
+
+	*wait = chrono::microseconds(0);
+	return 1;
+}
+
+void ScreenWidget::serveFrame(const VideoData& data)
+{
+	if (!frameServer.isActive() || frameServer.currentFormat() != FrameServer::Format::FORMAT_RGB24) {
+		return;
+	}
+	TraceRecorder::Scope trace("frame server", data.pts.count());
+	frameServer.publish(data.pts.count(), AVPixelFormat::AV_PIX_FMT_RGB24,
+		data.width, data.height, data.videoData, data.videoLinesize);
+}
+
+void ScreenWidget::tapAudio(const uint8_t* data, int size, std::chrono::microseconds pts)
+{
+	if (!meterEnabled || audioFromat != AVSampleFormat::AV_SAMPLE_FMT_FLT || audioChannels <= 0) {
+		return;
+	}
+	audioMeter.push((const float*)data, size / (audioChannels * (int)sizeof(float)), pts);
+}
+
+int ScreenWidget::meterTask(ScreenWidget* screen, std::chrono::microseconds* wait)
+{
+	screen->lock.lock();
+	ThreadStatus status = screen->readStatus;
+	screen->lock.unlock();
+
+	if (status == ThreadStatus::THREAD_HALT) {
+		qDebug("meterTask done");
+		return 0;
+	}
+	if (!screen->meterEnabled || screen->headless) {
+		*wait = chrono::milliseconds(50);
+		return 1;
+	}
+
+	{
+		TraceRecorder::Scope trace("audio meter");
+		if (screen->audioMeter.process(screen->mediaClock())) {
+			emit screen->updateScreen();
+		}
+	}
+	//about one update per refresh
+	*wait = chrono::microseconds(16667);
+	return 1;
+}
+
+int ScreenWidget::queueAudio(ScreenWidget* screen)
+{
+	auto pkt = av_packet_alloc();
+	if (!pkt) {
+		qDebug("audio av_packet_alloc error");
+		return AVERROR(ENOMEM);
+	}
+	av_packet_move_ref(pkt, screen->packet);
+	screen->audioQueueLock.lock();
+	screen->audioPacketList.push_back(pkt);
+	screen->audioQueueLock.unlock();
+	return 0;
+}
+
+void ScreenWidget::m_dropAudio(void)
+{
+	audioQueueLock.lock();
+	for (auto pkt : audioPacketList) {
+		av_packet_free(&pkt);
+	}
+	audioPacketList.clear();
+	audioQueueLock.unlock();
+}
+
+int ScreenWidget::audioTask(ScreenWidget* screen, std::chrono::microseconds* wait)
+{
+	screen->lock.lock();
+	ThreadStatus status = screen->readStatus;
+	screen->lock.unlock();
+
+	if (status == ThreadStatus::THREAD_HALT) {
+		qDebug("audioTask done");
+		return 0;
+	}
+
+	//taken before the packet, a seek drops the queue and flushes the
+	//decoder in one go
+	lock_guard<mutex> guard(screen->audioLock);
+	AVPacket* pkt = nullptr;
+	screen->audioQueueLock.lock();
+	if (!screen->audioPacketList.empty()) {
+		pkt = screen->audioPacketList.front();
+		screen->audioPacketList.pop_front();
+	}
+	screen->audioQueueLock.unlock();
+
+	if (!pkt) {
+		//the sink holds 100 ms at least, polling less often saves the
+		//worker's switches to the audio class
+		*wait = chrono::milliseconds(5);
+		return 1;
+	}
+	m_decodeAudio(screen, pkt);
+	av_packet_free(&pkt);
+	*wait = chrono::microseconds(0);
+	return 1;
+}
+
+int ScreenWidget::m_decodeAudio(ScreenWidget* screen, AVPacket* pkt)
+{
+	int ret = 0;
+	{
+		TraceRecorder::Scope trace("audio send_packet", tracePts(pkt->pts, screen->audioTimeBase));
+		ret = avcodec_send_packet(screen->audioCodecContext, pkt);
+	}
+	if (ret < 0) {
+		qDebug("audio avcodec_send_packet error: %d", ret);
+		return -1;
+	}
+
+	while (true) {
+		auto frame = screen->audioFrame;
+		{
+			TraceRecorder::Scope trace("audio receive_frame");
+			ret = avcodec_receive_frame(screen->audioCodecContext, frame);
+			if (ret == 0) {
+				trace.setPts(tracePts(frame->pts, screen->audioTimeBase));
+			}
+		}
+		if (ret < 0) {
+			// those two return values are special and mean there is no output
+			// frame available, but there were no errors during decoding
+			if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
+				return 0;
+			}
+			else {
+				qDebug("audio avcodec_receive_frame error");
+				return -1;
+			}
+		}
+
+		//the stream may change its format after open, TS does between
+		//programmes. a frame that is not the output format is converted
+		if (screen->audioPath == AudioPath::AUDIO_PASSTHROUGH &&
+			(frame->format != AVSampleFormat::AV_SAMPLE_FMT_FLT || frame->channels != screen->audioChannels ||
+			frame->sample_rate != screen->audioSampleRate)) {
+			screen->audioPath = frame->sample_rate == screen->audioSampleRate ?
+				AudioPath::AUDIO_CONVERT : AudioPath::AUDIO_RESAMPLE;
+			qDebug("audio input changed -> %s", audioPathName(screen->audioPath));
+		}
+		if (screen->audioPath != AudioPath::AUDIO_PASSTHROUGH && screen->m_matchResampler(frame) < 0) {
+			av_frame_unref(frame);
+			qDebug("audio resampler cannot take the new input");
+			return -1;
+		}
+
+		//catch-up speed shortens the output so audio keeps pace with video,
+		//drift compensation stretches it by a few hundred ppm at most
+		double speed = screen->playbackSpeed;
+		double stretch = (1.0 + screen->driftCorrection) / speed;
+		if (stretch != 1.0 && screen->audioPath != AudioPath::AUDIO_RESAMPLE) {
+			//swr holds nothing on the other paths, its resampler starts clean
+			qDebug("audio %s -> resample for a stretch", audioPathName(screen->audioPath));
+			screen->audioPath = AudioPath::AUDIO_RESAMPLE;
+		}
+		if (stretch != 1.0 || screen->compensating) {
+			//a rate over a long distance, every frame sets it again
+			int distance = screen->audioSampleRate * 10;
+			int delta = (int)lrint(distance * (stretch - 1.0));
+			swr_set_compensation(screen->swr_ctx, delta, delta ? distance : 0);
+			screen->compensating = delta != 0;
+		}
+
+		uint8_t** dst_data = nullptr;
+		int dst_linesize = 0;
+		//room for what the resampler holds, or a lasting stretch piles up in it
+		auto dst_nb_samples = av_rescale_rnd(
+			swr_get_delay(screen->swr_ctx, frame->sample_rate) + frame->nb_samples,
+			screen->audioSampleRate, frame->sample_rate, AV_ROUND_UP);
+		dst_nb_samples = (int64_t)ceil(dst_nb_samples * max(1.0, stretch)) + 1;
+
+		ret = av_samples_alloc_array_and_samples(&dst_data, &dst_linesize,
+			screen->audioChannels, dst_nb_samples,
+			screen->audioFromat, 0);
+		if (ret < 0) {
+			av_frame_unref(frame);
+			qDebug("audio av_samples_alloc_array_and_samples error");
+			return -1;
+		}
+
+		if (screen->audioPath == AudioPath::AUDIO_PASSTHROUGH) {
+			//already interleaved float at the output rate
+			memcpy(dst_data[0], frame->data[0],
+				(size_t)frame->nb_samples * screen->audioChannels * sizeof(float));
+			ret = frame->nb_samples;
+		}
+		else {
+			TraceRecorder::Scope trace("audio convert", tracePts(frame->pts, screen->audioTimeBase));
+			ret = swr_convert(screen->swr_ctx, dst_data, dst_nb_samples,
+				(const uint8_t**)frame->data, frame->nb_samples);
+		}
+		if (ret < 0) {
+			av_frame_unref(frame);
+			if (dst_data) {
+				av_freep(&dst_data[0]);
+				av_freep(&dst_data);
+			}
+			qDebug("audio swr_convert error");
+			return -1;
+		}
+
+		auto dst_bufsize = av_samples_get_buffer_size(&dst_linesize, 
+			screen->audioChannels,
+			ret, screen->audioFromat, 1);
+		if (dst_bufsize < 0) {
+			av_frame_unref(frame);
+			if (dst_data) {
+				av_freep(&dst_data[0]);
+				av_freep(&dst_data);
+			}
+			qDebug("audio av_samples_get_buffer_size error");
+			return -1;
+		}
+
+		//cut the samples outside the seek target and the loop
+		int frameSize = screen->audioChannels * av_get_bytes_per_sample(screen->audioFromat);
+		int begin = 0;
+		int end = ret;
+		qint64 writtenEnd = -1;
+		if (frame->pts != AV_NOPTS_VALUE && frameSize > 0) {
+			auto pts = ts_to_microsecond(frame->pts, screen->audioTimeBase);
+			bool looping = screen->loop.mode != LoopMode::LOOP_NONE;
+			auto lo = looping ? screen->loop.a : screen->skipUntil;
+			if (pts < lo) {
+				begin = (int)min<int64_t>(ret, (lo - pts).count() * screen->audioSampleRate / 1000000);
+			}
+			if (looping) {
+				auto hi = screen->loop.b;
+				if (pts + chrono::microseconds((int64_t)ret * 1000000 / screen->audioSampleRate) >= hi) {
+					end = (int)max<int64_t>(begin, (hi - pts).count() * screen->audioSampleRate / 1000000);
+					screen->loop.audioDone = true;
+				}
+				screen->loop.end = max(screen->loop.end,
+					pts + chrono::microseconds((int64_t)end * 1000000 / screen->audioSampleRate));
+			}
+			if (begin > 0 && end > begin) {
+				memmove(dst_data[0], dst_data[0] + begin * frameSize, (end - begin) * frameSize);
+			}
+			if (screen->loop.mode == LoopMode::LOOP_FILL && end > begin) {
+				screen->loopCache.addSamples(dst_data[0], (end - begin) * frameSize,
+					pts + chrono::microseconds((int64_t)begin * 1000000 / screen->audioSampleRate));
+			}
+			dst_bufsize = (end - begin) * frameSize;
+			if (dst_bufsize > 0) {
+				screen->tapAudio(dst_data[0], dst_bufsize, pts + screen->loop.offset +
+					chrono::microseconds((int64_t)begin * 1000000 / screen->audioSampleRate));
+			}
+			//the input duration, the output is stretched
+			auto played = end < ret ? (int64_t)end * 1000000 / screen->audioSampleRate :
+				(int64_t)frame->nb_samples * 1000000 / frame->sample_rate;
+			writtenEnd = (pts + screen->loop.offset).count() + played;
+		}
+
+		if (dst_bufsize > 0) {
+			emit screen->writeAudioData(dst_data[0], dst_bufsize, writtenEnd);
+		}
+		else {
+			av_freep(&dst_data[0]);
+		}
+
+		av_frame_unref(frame);
+		//av_freep(&dst_data[0]);
+		av_freep(&dst_data);
+	}
+
+	return 0;
+}
+
+int ScreenWidget::m_matchResampler(const AVFrame* frame)
+{
+	int64_t layout = 0;
+	int64_t rate = 0;
+	AVSampleFormat format = AVSampleFormat::AV_SAMPLE_FMT_NONE;
+	av_opt_get_int(swr_ctx, "in_channel_layout", 0, &layout);
+	av_opt_get_int(swr_ctx, "in_sample_rate", 0, &rate);
+	av_opt_get_sample_fmt(swr_ctx, "in_sample_fmt", 0, &format);
+	int64_t frameLayout = frame->channel_layout ? frame->channel_layout :
+		av_get_default_channel_layout(frame->channels);
+	if (av_get_channel_layout_nb_channels(layout) == frame->channels &&
+		rate == frame->sample_rate && format == frame->format) {
+		return 0;
+	}
+
+	qDebug("audio input now %d Hz %s %d channels", frame->sample_rate,
+		av_get_sample_fmt_name((AVSampleFormat)frame->format), frame->channels);
+	//the sink keeps its format, another channel count is remixed
+	int64_t outLayout = frame->channels == audioChannels ?
+		frameLayout : av_get_default_channel_layout(audioChannels);
+	av_opt_set_int(swr_ctx, "in_channel_layout", frameLayout, 0);
+	av_opt_set_int(swr_ctx, "in_sample_rate", frame->sample_rate, 0);
+	av_opt_set_sample_fmt(swr_ctx, "in_sample_fmt", (AVSampleFormat)frame->format, 0);
+	av_opt_set_int(swr_ctx, "out_channel_layout", outLayout, 0);
+	//drops what the resampler held of the old format
+	compensating = false;
+	return swr_init(swr_ctx);
+}
+
+std::chrono::milliseconds ScreenWidget::ts_to_millisecond(int64_t ts, AVRational time_base)
+{
+	int64_t arg = 1000 * ts * time_base.num / time_base.den;
+	return std::chrono::milliseconds(arg);
+}
+
+std::chrono::milliseconds ScreenWidget::ts_to_millisecond(int64_t ts, int num, int den)
+{
+	int64_t arg = 1000 * ts * num / den;
 	return std::chrono::milliseconds(arg);
 }
 
@@ -607,57 +2294,59 @@ std::chrono::microseconds ScreenWidget::ts_to_microsecond(int64_t ts, int num, i
 	return std::chrono::microseconds(arg);
 }
 
-int ScreenWidget::videoThread(ScreenWidget* screen)
+int ScreenWidget::videoTask(ScreenWidget* screen, std::chrono::microseconds* wait)
 {
-	screen->threadCount++;
-	qDebug("videoThread start");
-
-	int ret = 0;
 	int flag = 0;
 	ScreenStatus status = ScreenStatus::SCREEN_STATUS_NONE;
-	chrono::microseconds tmp_time(0);
 
-	for (;;) {
-		screen->lock.lock();
-		status = screen->status;
-		screen->lock.unlock();
+	*wait = chrono::milliseconds(screen->threadInterval);
 
-		if (status == ScreenStatus::SCREEN_STATUS_HALT) {
-			break;
-		}
-		else if (status == ScreenStatus::SCREEN_STATUS_PAUSE) {
-			this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-			continue;
-		}
-		else if (status == ScreenStatus::SCREEN_STATUS_NONE) {
-			this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-			continue;
-		}
-		else if (status == ScreenStatus::SCREEN_STATUS_PLAYING) {
-			if (screen->videoFrameList.size() == 0) {
-				this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-				continue;
+	screen->lock.lock();
+	status = screen->status;
+	screen->lock.unlock();
+
+	if (status == ScreenStatus::SCREEN_STATUS_HALT) {
+		screen->clock->release(PlaybackClock::Source::SOURCE_VIDEO);
+		qDebug("videoTask done");
+		return 0;
+	}
+	else if (status == ScreenStatus::SCREEN_STATUS_PAUSE) {
+		return 1;
+	}
+	else if (status == ScreenStatus::SCREEN_STATUS_NONE) {
+		return 1;
+	}
+	else if (status == ScreenStatus::SCREEN_STATUS_PLAYING) {
+		//the jitter buffer owns the speed of network input
+		if (!screen->streaming) {
+			double speed = screen->rateMatching ?
+				screen->framePacer.matchSpeed(screen->videoFrameDuration, screen->rateMatchTolerance) : 1.0;
+			if (fabs(speed - screen->playbackSpeed) > 0.0002) {
+				screen->setPlaybackSpeed(speed);
 			}
-			else {
-				flag = m_videoFunc(screen, &tmp_time);
-				if (flag == 1) {
-					this_thread::sleep_for(tmp_time);
-				}
-				else {
-					this_thread::sleep_for(chrono::milliseconds(screen->threadInterval));
-				}
+		}
+
+		if (screen->videoFrameList.size() > 0) {
+			chrono::microseconds tmp_time(0);
+			flag = m_videoFunc(screen, &tmp_time);
+			if (flag == 1) {
+				*wait = tmp_time;
 			}
 		}
 		else {
-			qDebug("in videoThread: fatel error");
-			ret = -1;
-			break;
+			//a virtual clock waits for the decoder
+			screen->clock->hold(PlaybackClock::Source::SOURCE_VIDEO, screen->clock->now());
+		}
+		if (screen->clock->isVirtual()) {
+			//the wait is virtual time, the clock may get there any moment
+			*wait = min(*wait, chrono::microseconds(chrono::milliseconds(screen->threadInterval)));
 		}
+		return 1;
+	}
+	else {
+		qDebug("in videoTask: fatel error");
+		return 0;
 	}
-
-	screen->threadCount--;
-	qDebug("videoThread done");
-	return ret;
 }
 
 int ScreenWidget::m_videoFunc(ScreenWidget* screen, std::chrono::microseconds* time)
@@ -667,25 +2356,43 @@ int ScreenWidget::m_videoFunc(ScreenWidget* screen, std::chrono::microseconds* t
 	screen->videoLock.lock();
 	while (screen->videoFrameList.size()) {
 		auto it = screen->videoFrameList.begin();
-		auto dt = chrono::duration_cast<chrono::microseconds>(
-			chrono::steady_clock::now() - screen->startTimeStamp);
-		auto current = screen->timeOffset + dt;
+		auto current = screen->mediaClock();
 		auto t1 = it->pts;
 		auto t2 = t1 + it->duration;
 
-		if (current >= t1 && current < t2) {
+		if (current < t2) {
+			//hand the frame over half a refresh before its vsync
+			auto now = screen->clock->now();
+			auto due = now + chrono::microseconds((int64_t)((t1 - current).count() / screen->playbackSpeed));
+			auto at = screen->framePacer.schedule(t1.count(), due);
+			if (at > now) {
+				//a virtual clock moves on to the frame unless the audio holds it
+				screen->clock->hold(PlaybackClock::Source::SOURCE_VIDEO, at);
+				now = screen->clock->now();
+			}
+			if (at > now) {
+				*time = chrono::duration_cast<chrono::microseconds>(at - now);
+				ret = 1;
+				break;
+			}
+
+			TraceRecorder::instance()->instant("video queue pop", t1.count());
+			screen->presentedFrames++;
 			emit screen->drawVideoFrame(*it);
 			screen->videoFrameList.pop_front();
+			//the next frame sets the wait, if there is one
 			*time = t2 - current;
 			ret = 1;
-			break;
-		}
-		else if (current < t1) {
-			*time = t1 - current;
-			ret = 1;
-			break;
+			continue;
 		}
 		else {
+			//late, shown immediately
+			TraceRecorder::instance()->instant("video queue pop late", t1.count());
+			if (current - t2 > chrono::milliseconds(100)) {
+				TraceRecorder::instance()->stall("stall: video frame late");
+			}
+			screen->presentedFrames++;
+			screen->lateFrames++;
 			emit screen->drawVideoFrame(*it);
 			screen->videoFrameList.pop_front();
 			continue;
@@ -698,43 +2405,7 @@ int ScreenWidget::m_videoFunc(ScreenWidget* screen, std::chrono::microseconds* t
 
 void ScreenWidget::initializeGL(void)
 {
-	initializeOpenGLFunctions();
-
-	//compile and link program
-	createProgram();
-
-	glClearColor(0, 0, 0, 1);
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
-
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
-
-	glGenBuffers(1, &EBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_DYNAMIC_DRAW);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
-	// texture
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glUniform1i(glGetUniformLocation(program, "texture0"), 0);
-	glActiveTexture(GL_TEXTURE0);
-
+	screenOutput.initialize();
 	qDebug("ScreenWidget::initializeGL done");
 }
 
@@ -745,32 +2416,63 @@ void ScreenWidget::resizeGL(int w, int h)
 
 void ScreenWidget::paintGL(void)
 {
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	// bind textures on corresponding texture units
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glUseProgram(program);
-
-	// render container
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	TraceRecorder::Scope trace("paintGL");
+	AudioMeter::Levels lv;
+	if (meterEnabled) {
+		lv = audioMeter.levels();
+	}
+	screenOutput.paint(meterEnabled ? &lv : nullptr);
 }
 
 void ScreenWidget::onDrawFrame(VideoData data)
 {
-	makeCurrent();
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-		videoWidth, videoHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, data.videoData[0]);
-	// paintGL();
+	TraceRecorder::Scope trace("upload", data.pts.count());
+	if (syncProbe) {
+		syncProbe->onPresent(data.pts.count(), data.videoData[0], data.videoLinesize[0],
+			data.width, data.height);
+	}
+	if (videoOutput) {
+		VideoOutput::Frame f;
+		f.pts = data.pts.count();
+		f.presentTime = clock->now();
+		f.data = data.videoData[0];
+		f.width = data.width;
+		f.height = data.height;
+		AudioMeter::Levels lv;
+		if (meterEnabled) {
+			lv = audioMeter.levels();
+			f.meters = &lv;
+		}
+		videoOutput->present(f);
+		//the pacer learns the vsync from this widget's swaps
+		framePending = videoOutput == &screenOutput;
+	}
+	if (data.scrubRequested) {
+		auto dt = chrono::duration_cast<chrono::microseconds>(
+			chrono::steady_clock::now().time_since_epoch()) - chrono::microseconds(data.scrubRequested);
+		lock_guard<mutex> guard(lock);
+		if (data.scrubExact) {
+			scrubStats.exactShown++;
+			scrubStats.exactLatency += dt;
+			scrubStats.exactLatencyMax = max(scrubStats.exactLatencyMax, dt);
+		}
+		else {
+			scrubStats.keyframesShown++;
+			scrubStats.keyframeLatency += dt;
+			scrubStats.keyframeLatencyMax = max(scrubStats.keyframeLatencyMax, dt);
+		}
+	}
 	av_freep(&data.videoData[0]);
-	update();
 }
 
-void ScreenWidget::onWriteAudioData(void* data, int size)
+void ScreenWidget::onWriteAudioData(void* data, int size, qint64 end)
 {
 	audioDevice->write((char*)data, size);
 	av_free(data);
+	if (end >= 0) {
+		audioWrittenEnd = chrono::microseconds(end);
+		audioWritten = true;
+	}
 }
 
 void ScreenWidget::onUpdateScreen(void)
@@ -778,8 +2480,93 @@ void ScreenWidget::onUpdateScreen(void)
 	update();
 }
 
+void ScreenWidget::onFrameSwapped(void)
+{
+	framePacer.onSwap(chrono::steady_clock::now(), framePending);
+	framePending = false;
+}
+
+void ScreenWidget::onSampleAudioLatency(void)
+{
+	audioLatencyUs = audioOutput ? audioOutput->latency().count() : 0;
+	measureDrift();
+}
+
+void ScreenWidget::resetDriftWindow(void)
+{
+	drift.sum = 0;
+	drift.count = 0;
+	drift.windowStart = clock->now();
+	drift.underruns = audioOutput ? audioOutput->underruns() : 0;
+	drift.hasLast = false;
+}
+
+void ScreenWidget::measureDrift(void)
+{
+	//catch-up and live input have the jitter buffer in charge
+	bool valid = driftCompensation && audioOutput && audioDevice && audioWritten && !liveStream &&
+		status == ScreenStatus::SCREEN_STATUS_PLAYING && playbackSpeed == 1.0;
+	if (!valid || audioOutput->underruns() != drift.underruns) {
+		//an underrun is a jump, not drift
+		resetDriftWindow();
+		return;
+	}
+
+	auto buffered = chrono::microseconds(audioFormat->durationForBytes((qint32)audioDevice->level()) +
+		audioLatencyUs.load());
+	auto offset = audioWrittenEnd - buffered - mediaClock();
+	drift.sum += offset.count();
+	drift.count++;
+	auto now = clock->now();
+	double span = chrono::duration<double>(now - drift.windowStart).count();
+	if (span < 1.0) {
+		return;
+	}
+	double mean = (double)drift.sum / drift.count / 1e6;
+	drift.sum = 0;
+	drift.count = 0;
+	drift.windowStart = now;
+
+	//what the offset did beyond the correction is the output's own drift
+	double correction = driftCorrection;
+	if (drift.hasLast) {
+		double d = (mean - drift.lastOffset) / span + correction;
+		driftStats.driftPpm += (d * 1e6 - driftStats.driftPpm) * min(1.0, span / driftIntegral);
+	}
+	drift.lastOffset = mean;
+	drift.hasLast = true;
+
+	//stretch the audio while it is ahead, the integral learns the drift.
+	//it holds still while the correction is at its limit
+	if (correction != 0.0 || fabs(mean) >= driftDeadband) {
+		double p = mean / driftResponse;
+		if (fabs(p + drift.integral) < driftMaxCorrection) {
+			drift.integral += p * span / driftIntegral;
+		}
+		correction = max(-driftMaxCorrection, min(driftMaxCorrection, p + drift.integral));
+		driftCorrection = correction;
+	}
+
+	driftStats.seconds++;
+	driftStats.offset = chrono::microseconds((int64_t)(mean * 1e6));
+	if (driftStats.seconds > driftSettle) {
+		driftStats.offsetMax = max(driftStats.offsetMax, chrono::abs(driftStats.offset));
+	}
+	driftStats.correctionPpm = correction * 1e6;
+}
+
+void ScreenWidget::onFlushAudio(void)
+{
+	if (audioDevice) {
+		audioDevice->clear();
+	}
+	audioWritten = false;
+	resetDriftWindow();
+}
+
 ScreenWidget::ScreenWidget(QWidget* parent) : QOpenGLWidget(parent)
 {
+	TraceRecorder::instance()->setThreadName("gui");
 	timeOffset = chrono::microseconds(0);
 	startTimeStamp = chrono::steady_clock::now();
 
@@ -788,14 +2575,24 @@ ScreenWidget::ScreenWidget(QWidget* parent) : QOpenGLWidget(parent)
 	connect(this, &ScreenWidget::writeAudioData, this, &ScreenWidget::onWriteAudioData);
 	connect(this, &ScreenWidget::changeScreenStatus, this, &ScreenWidget::setScreenStatus);
 	connect(this, &ScreenWidget::endOfFile, this, &ScreenWidget::onEndOfFile);
+	connect(this, &ScreenWidget::flushAudio, this, &ScreenWidget::onFlushAudio);
+	connect(this, &QOpenGLWidget::frameSwapped, this, &ScreenWidget::onFrameSwapped);
+
+	latencyTimer = new QTimer(this);
+	connect(latencyTimer, &QTimer::timeout, this, &ScreenWidget::onSampleAudioLatency);
+	latencyTimer->start(50);
 }
 
 ScreenWidget::~ScreenWidget()
 {
+	//its callback signals this
+	if (exporter) {
+		exporter->cancel();
+		exporter->wait();
+	}
 	clearOnClose();
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &EBO);
+	releaseRecycled();
+	closeVideoOutput();
 }
 
 void ScreenWidget::openFile(QString path)
@@ -827,6 +2624,7 @@ void ScreenWidget::openFile(QString path)
 void ScreenWidget::closeFile(void)
 {
 	clearOnClose();
+	releaseRecycled();
 	clearScreen();
 }
 
@@ -835,9 +2633,229 @@ void ScreenWidget::setHWDeviceType(AVHWDeviceType type)
 	deviceType = type;
 }
 
+void ScreenWidget::setRateMatching(bool on)
+{
+	rateMatching = on;
+}
+
+void ScreenWidget::setAdaptiveQuality(bool on)
+{
+	governor.setEnabled(on);
+	qDebug("adaptive quality %s", on ? "on" : "off");
+}
+
+void ScreenWidget::setDriftCompensation(bool on)
+{
+	driftCompensation = on;
+	if (!on) {
+		driftCorrection = 0.0;
+		drift.integral = 0.0;
+	}
+	resetDriftWindow();
+	qDebug("drift compensation %s", on ? "on" : "off");
+}
+
+void ScreenWidget::setVideoFilter(QString chain)
+{
+	videoFilter.setChain(chain);
+	qDebug("video filter: %s", chain.size() ? chain.toUtf8().constData() : "off");
+}
+
+void ScreenWidget::setAudioMeters(bool on)
+{
+	meterEnabled = on;
+	update();
+}
+
+void ScreenWidget::setFrameServer(QString name, bool native)
+{
+	if (name.isEmpty()) {
+		frameServer.stop();
+		return;
+	}
+	frameServer.start(name.toStdString(),
+		native ? FrameServer::Format::FORMAT_NATIVE : FrameServer::Format::FORMAT_RGB24);
+	qDebug("serving %s frames as %s", native ? "decoded" : "rgb24", name.toUtf8().constData());
+}
+
+void ScreenWidget::setStreamPreset(JitterBuffer::Preset p)
+{
+	streamPreset = p;
+}
+
+void ScreenWidget::setAudioLatency(int ms)
+{
+	audioLatencyTarget = ms > 0 ? ms : 0;
+	if (!audioOutput) {
+		return;
+	}
+
+	//restart the sink with the new buffer, queued samples stay in audioDevice
+	audioOutput->stop();
+	startAudioOutput();
+	if (status != ScreenStatus::SCREEN_STATUS_PLAYING) {
+		audioOutput->suspend();
+	}
+}
+
+void ScreenWidget::setVideoOutput(QString spec)
+{
+	VideoOutput::Backend backend;
+	int w = 0, h = 0;
+	if (!VideoOutput::parse(spec.toStdString(), &backend, &w, &h)) {
+		showError("invalid video output");
+		return;
+	}
+	videoBackend = backend;
+	offscreenWidth = w;
+	offscreenHeight = h;
+	openVideoOutput();
+}
+
+void ScreenWidget::setAudioOutput(QString spec)
+{
+	AudioOutput::Backend backend;
+	std::string path;
+	if (!AudioOutput::parse(spec.toStdString(), &backend, &path)) {
+		showError("invalid audio output");
+		return;
+	}
+	audioBackend = backend;
+	audioOutputPath = path;
+	releaseRecycled();
+	if (!audioOutput) {
+		return;
+	}
+
+	if (audioCodecContext && AudioOutput::negotiateSampleRate(effectiveAudioBackend(),
+		audioCodecContext->sample_rate, audioChannels) != audioFormat->sampleRate()) {
+		qDebug("audio: %d Hz kept until the next open", audioFormat->sampleRate());
+	}
+	//same device and samples, only the consumer changes
+	closeAudioOutput();
+	openAudioOutput();
+	if (status == ScreenStatus::SCREEN_STATUS_PLAYING) {
+		audioOutput->resume();
+	}
+}
+
 void ScreenWidget::test(bool checked)
 {
 	qDebug("test triggered");
+
+	auto stats = NemoThreadPool::instance()->stats();
+	qDebug("pool: threads=%d executed=%lld stolen=%lld delayed=%d",
+		stats.threadBudget, (long long)stats.executedTasks,
+		(long long)stats.stolenTasks, (int)stats.delayedTasks);
+	for (int p = 0; p < NemoThreadPool::priorityCount; p++) {
+		qDebug(" priority %d queue depth=%d", p, (int)stats.queueDepth[p]);
+	}
+	for (auto& r : ThreadPolicy::instance()->report()) {
+		qDebug(" %s thread: requested %s, applied %s, affinity=%llx switches=%lld failures=%lld",
+			r.name.c_str(), r.requested.c_str(), r.applied.c_str(), (unsigned long long)r.affinity,
+			(long long)r.switches, (long long)r.failures);
+	}
+
+	if (streaming) {
+		auto js = jitterBuffer.stats();
+		qDebug("jitter buffer: target=%lldms buffered=%lldms jitter=%lldms underruns=%lld dropped=%lld catchups=%lld speed=%.3f reconnects=%lld",
+			(long long)js.target.count() / 1000, (long long)js.buffered.count() / 1000,
+			(long long)js.jitter.count() / 1000, (long long)js.underruns,
+			(long long)js.droppedPackets, (long long)js.catchUps, js.speed,
+			(long long)reconnects);
+	}
+	if (audioOutput) {
+		qDebug("audio %s: target=%dms buffer=%lldus latency=%lldus ring=%lldus underruns=%lld",
+			AudioOutput::backendName(audioOutput->backend()), audioLatencyTarget,
+			(long long)audioFormat->durationForBytes((qint32)audioOutput->bufferSize()),
+			(long long)audioLatencyUs.load(),
+			(long long)audioFormat->durationForBytes((qint32)audioDevice->level()),
+			(long long)audioOutput->underruns());
+	}
+	if (videoOutput) {
+		auto& vs = videoOutput->stats();
+		qDebug("video %s: frames=%lld upload mean=%lldus max=%lldus render mean=%lldus max=%lldus",
+			VideoOutput::backendName(videoOutput->backend()), (long long)vs.frames,
+			(long long)(vs.frames ? vs.uploadTime.count() / vs.frames : 0), (long long)vs.uploadMax.count(),
+			(long long)(vs.renders ? vs.renderTime.count() / vs.renders : 0), (long long)vs.renderMax.count());
+	}
+	auto cs = ProbeCache::instance()->stats();
+	qDebug("probe cache: hits=%lld misses=%lld hit rate=%.1f%% invalidations=%lld saved=%lldms",
+		(long long)cs.hits, (long long)cs.misses,
+		cs.hits + cs.misses ? 100.0 * cs.hits / (cs.hits + cs.misses) : 0.0,
+		(long long)cs.invalidations, (long long)cs.saved.count() / 1000);
+	auto ps = framePacer.stats();
+	qDebug("pacing: refresh=%lldus presents=%lld interval mean=%lldus stddev=%lldus speed=%.4f",
+		(long long)ps.refresh.count(), (long long)ps.presents,
+		(long long)ps.intervalMean, (long long)ps.intervalStdDev, playbackSpeed.load());
+	qDebug("scalers: cached=%d hits=%lld misses=%lld",
+		(int)scalers.size(), (long long)scalers.hits(), (long long)scalers.misses());
+	if (frameServer.isActive()) {
+		auto st = frameServer.stats();
+		qDebug("frame server: published=%lld skipped=%lld bytes=%lld publish mean=%lldus max=%lldus",
+			(long long)st.published, (long long)st.skipped, (long long)st.bytes,
+			(long long)(st.published ? st.publishTime.count() / st.published : 0),
+			(long long)st.publishMax.count());
+	}
+	if (meterEnabled && audioCodecContext) {
+		auto ms = audioMeter.stats();
+		qDebug("audio meter: channels=%d analyzed=%lld dropped=%lld spectra=%lld cpu=%lldus load=%.3f%%",
+			audioMeter.levels().channels, (long long)ms.analyzedFrames, (long long)ms.droppedFrames,
+			(long long)ms.spectra, (long long)ms.cpuTime.count(), ms.load * 100.0);
+	}
+	if (videoFilter.enabled()) {
+		auto fs = videoFilter.stats();
+		qDebug("video filter: %s queued=%lld dropped=%lld output=%lld rebuilds=%lld depth=%d",
+			videoFilter.currentChain().toUtf8().constData(), (long long)fs.queued,
+			(long long)fs.dropped, (long long)fs.output, (long long)fs.rebuilds, (int)videoFilter.depth());
+		for (auto& f : fs.filters) {
+			qDebug(" %s frames=%lld mean=%lldus", f.name.toUtf8().constData(), (long long)f.frames,
+				f.frames ? (long long)f.time.count() / f.frames : 0LL);
+		}
+	}
+	if (videoCodecContext) {
+		auto gs = governor.stats();
+		qDebug("quality: %s, down=%lld up=%lld last=%s cost=%lldus load=%.2f late=%lld queue min=%d",
+			QualityGovernor::levelName(gs.level), (long long)gs.stepsDown, (long long)gs.stepsUp,
+			gs.reason, (long long)gs.cost.count(), gs.load, (long long)gs.late, gs.queueDepth);
+		for (int l = 0; l < QualityGovernor::levelCount; l++) {
+			qDebug(" %s frames=%lld", QualityGovernor::levelName((QualityGovernor::Level)l),
+				(long long)gs.frames[l]);
+		}
+	}
+	if (audioCodecContext) {
+		qDebug("audio path: %d Hz %s to %d Hz float, %s", audioCodecContext->sample_rate,
+			av_get_sample_fmt_name(audioCodecContext->sample_fmt), audioSampleRate,
+			audioPathName(audioPath));
+	}
+	if (driftStats.seconds) {
+		qDebug("drift: %lld s measured, offset=%lldus max=%lldus drift=%.1fppm (%.1f ms/day) correction=%.1fppm",
+			(long long)driftStats.seconds, (long long)driftStats.offset.count(),
+			(long long)driftStats.offsetMax.count(), driftStats.driftPpm,
+			driftStats.driftPpm * 86.4, driftStats.correctionPpm);
+	}
+	if (scrubStats.requests) {
+		auto ss = scrubStatistics();
+		qDebug("scrub: requests=%lld coalesced=%lld canceled=%lld keyframe=%lld mean=%lldus max=%lldus exact=%lld mean=%lldus max=%lldus",
+			(long long)ss.requests, (long long)ss.coalesced, (long long)ss.canceled,
+			(long long)ss.keyframesShown,
+			(long long)(ss.keyframesShown ? ss.keyframeLatency.count() / ss.keyframesShown : 0),
+			(long long)ss.keyframeLatencyMax.count(), (long long)ss.exactShown,
+			(long long)(ss.exactShown ? ss.exactLatency.count() / ss.exactShown : 0),
+			(long long)ss.exactLatencyMax.count());
+	}
+	if (exporter) {
+		auto es = exporter->stats();
+		qDebug("export: %s %.0f%% %lld - %lldms packets=%lld bytes=%lld reencoded=%lld speed=%.1fx",
+			exporter->target().toUtf8().constData(), exporter->progress() * 100.0,
+			(long long)es.clipStart.count() / 1000, (long long)es.clipEnd.count() / 1000,
+			(long long)es.packets, (long long)es.bytes, (long long)es.reencodedFrames, es.speed);
+	}
+	if (loop.mode != LoopMode::LOOP_NONE) {
+		qDebug("loop: mode=%d passes=%lld cache=%dMB frames=%d samples=%d packets=%d",
+			(int)loop.mode, (long long)loop.passes, (int)(loopCache.memoryUsage() >> 20),
+			(int)loopCache.frameCount(), (int)loopCache.samplesCount(), (int)loopCache.packetCount());
+	}
 	//QFile* sourceFile = new QFile;   // class member.
 	//QAudioSink* audio; // class member.
 	//sourceFile->setFileName("D:/mov/audioTest");
@@ -867,13 +2885,184 @@ void ScreenWidget::pause(void)
 	}
 }
 
+void ScreenWidget::seek(qint64 pos)
+{
+	if (!formatContext) {
+		return;
+	}
+
+	lock.lock();
+	seekPending = true;
+	seekTarget = chrono::milliseconds(pos);
+	lock.unlock();
+}
+
+void ScreenWidget::beginScrub(void)
+{
+	if (!formatContext || streaming) {
+		return;
+	}
+
+	bool playing = status == ScreenStatus::SCREEN_STATUS_PLAYING;
+	if (playing) {
+		setScreenStatus(ScreenStatus::SCREEN_STATUS_PAUSE);
+	}
+	lock.lock();
+	//pressed again before readTask finished the last scrub
+	scrubResume = (scrubbing && scrubResume) || playing;
+	scrubbing = true;
+	scrubEnding = false;
+	lock.unlock();
+}
+
+void ScreenWidget::scrubTo(qint64 pos)
+{
+	if (!formatContext || streaming) {
+		return;
+	}
+
+	lock.lock();
+	if (!scrubbing) {
+		lock.unlock();
+		seek(pos);
+		return;
+	}
+	scrubStats.requests++;
+	if (!scrubTaken) {
+		scrubStats.coalesced++;
+	}
+	scrubTaken = false;
+	scrubTarget = chrono::milliseconds(max<qint64>(pos, 0));
+	scrubRequestTime = chrono::steady_clock::now();
+	scrubSerial++;
+	lock.unlock();
+}
+
+void ScreenWidget::endScrub(void)
+{
+	lock_guard<mutex> guard(lock);
+	if (scrubbing) {
+		scrubEnding = true;
+	}
+}
+
+void ScreenWidget::setLoop(qint64 a, qint64 b)
+{
+	if (!formatContext) {
+		return;
+	}
+	if (streaming) {
+		QMessageBox::information(this, "A-B loop", "not supported on network input", QMessageBox::Ok);
+		return;
+	}
+
+	lock.lock();
+	loopPending = true;
+	loopRequestA = chrono::milliseconds(a);
+	loopRequestB = chrono::milliseconds(b);
+	lock.unlock();
+}
+
+void ScreenWidget::clearLoop(void)
+{
+	setLoop(0, 0);
+}
+
+void ScreenWidget::exportClip(QString path, qint64 a, qint64 b, bool exact)
+{
+	if (!formatContext || path.isEmpty()) {
+		return;
+	}
+	if (streaming || !QFileInfo(filePath).isFile()) {
+		QMessageBox::information(this, "export clip", "only local files can be exported", QMessageBox::Ok);
+		return;
+	}
+	if (exporter && !exporter->isFinished()) {
+		QMessageBox::information(this, "export clip", "an export is running", QMessageBox::Ok);
+		return;
+	}
+
+	ClipExporter::Options opt;
+	opt.start = chrono::milliseconds(max<qint64>(a, 0));
+	opt.end = chrono::milliseconds(b);
+	opt.boundary = exact ? ClipExporter::Boundary::BOUNDARY_REENCODE :
+		ClipExporter::Boundary::BOUNDARY_KEYFRAME;
+	//the tracks that are playing
+	for (int index : { videoStreamIndex, audioStreamIndex }) {
+		if (index >= 0) {
+			opt.streams.push_back(index);
+		}
+	}
+	exporter = ClipExporter::start(filePath, path, opt, [this, path](int ret, const ClipExporter::Stats& st) {
+		emit exportFinished(path, ret);
+	});
+}
+
+void ScreenWidget::selectTrack(int index)
+{
+	lock_guard<mutex> guard(lock);
+	for (auto& t : trackList) {
+		if (t.index != index) {
+			continue;
+		}
+		if (t.type == AVMediaType::AVMEDIA_TYPE_VIDEO) {
+			videoTrackRequest = index;
+		}
+		else if (t.type == AVMediaType::AVMEDIA_TYPE_AUDIO) {
+			audioTrackRequest = index;
+		}
+		break;
+	}
+}
+
+std::vector<ScreenWidget::TrackInfo> ScreenWidget::tracks(void)
+{
+	lock.lock();
+	vector<TrackInfo> list = trackList;
+	int video = videoStreamIndex;
+	int audio = audioStreamIndex;
+	lock.unlock();
+
+	for (auto& t : list) {
+		t.selected = t.index == video || t.index == audio;
+	}
+	return list;
+}
+
+std::vector<ScreenWidget::TrackInfo> ScreenWidget::listTracks(AVFormatContext* fc)
+{
+	vector<TrackInfo> list;
+	for (unsigned int i = 0; i < fc->nb_streams; i++) {
+		auto st = fc->streams[i];
+		auto type = st->codecpar->codec_type;
+		//cover art is a video stream of one picture
+		if ((type != AVMediaType::AVMEDIA_TYPE_VIDEO && type != AVMediaType::AVMEDIA_TYPE_AUDIO) ||
+			(st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+			continue;
+		}
+
+		TrackInfo t;
+		t.index = i;
+		t.type = type;
+		t.codec = avcodec_get_name(st->codecpar->codec_id);
+		auto e = av_dict_get(st->metadata, "language", NULL, 0);
+		if (e) {
+			t.language = e->value;
+		}
+		e = av_dict_get(st->metadata, "title", NULL, 0);
+		if (e) {
+			t.title = e->value;
+		}
+		list.push_back(t);
+	}
+	return list;
+}
+
 void ScreenWidget::clearScreen(void)
 {
-	makeCurrent();
-	uint8_t arr[3] = { 0 };
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-		1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, arr);
-	update();
+	if (videoOutput) {
+		videoOutput->clear();
+	}
 }
 
 void ScreenWidget::onEndOfFile(void)
@@ -893,13 +3082,13 @@ void ScreenWidget::setScreenStatus(ScreenStatus s)
 
 	if (s == ScreenStatus::SCREEN_STATUS_PAUSE) {
 		lock.lock();
+		timeOffset = m_mediaClock();
 		readStatus = ThreadStatus::THREAD_PAUSE;
 		status = ScreenStatus::SCREEN_STATUS_PAUSE;
-		if (audioSink) {
-			audioSink->suspend();
+		governor.restart();
+		if (audioOutput) {
+			audioOutput->suspend();
 		}
-		timeOffset = chrono::duration_cast<chrono::microseconds>
-			(chrono::steady_clock::now() - startTimeStamp);
 		lock.unlock();
 	}
 
@@ -918,8 +3107,10 @@ void ScreenWidget::setScreenStatus(ScreenStatus s)
 
 		lock.lock();
 		status = ScreenStatus::SCREEN_STATUS_PLAYING;
-		startTimeStamp = chrono::steady_clock::now();
-		audioSink->resume();
+		startTimeStamp = clock->now();
+		if (audioOutput) {
+			audioOutput->resume();
+		}
 		lock.unlock();
 	}
 	
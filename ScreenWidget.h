@@ -3,20 +3,42 @@
 #include <sstream>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <chrono>
+#include <cmath>
 #include <list>
+#include <vector>
 #include <fstream>
 #include <QWidget>
+#include <QUrl>
+#include <QTimer>
 #include <QtMultimedia>
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions_3_3_Core>
+#include <QScreen>
 #include <QMEssageBox>
 #include "NemoAudioDevice.h"
+#include "NemoThreadPool.h"
+#include "JitterBuffer.h"
+#include "LoopCache.h"
+#include "ScalerCache.h"
+#include "VideoFilter.h"
+#include "AudioMeter.h"
+#include "FramePacer.h"
+#include "ProbeCache.h"
+#include "TraceRecorder.h"
+#include "SyncProbe.h"
+#include "AudioOutput.h"
+#include "QualityGovernor.h"
+#include "ClipExporter.h"
+#include "VideoOutput.h"
+#include "WidgetVideoOutput.h"
+#include "PlaybackClock.h"
+#include "FrameServer.h"
 #include "FFmpegHeader.h"
 
 class ScreenWidget final : 
-	public QOpenGLWidget, 
-	protected QOpenGLFunctions_3_3_Core
+	public QOpenGLWidget
 {
 	Q_OBJECT
 public:
@@ -24,8 +46,14 @@ public:
 		uint8_t* videoData[4] = { NULL };
 		int videoLinesize[4] = { 0 };
 		int bufSize = 0;
+		int width = 0;
+		int height = 0;
 		std::chrono::microseconds pts;
 		std::chrono::microseconds duration;
+		//steady clock time in us of the scrub target this frame shows,
+		//0 for playback
+		int64_t scrubRequested = 0;
+		bool scrubExact = false;
 	};
 
 	enum class ThreadStatus {
@@ -42,76 +70,414 @@ public:
 		SCREEN_STATUS_HALT
 	};
 
+	//a selectable audio or video stream of the open file
+	struct TrackInfo {
+		int index = -1;
+		AVMediaType type = AVMediaType::AVMEDIA_TYPE_UNKNOWN;
+		QString codec;
+		QString language;
+		QString title;
+		bool selected = false;
+	};
+
+	//presentation counters of the current file
+	struct PlaybackStats {
+		std::chrono::microseconds position = std::chrono::microseconds(0);
+		int64_t presentedFrames = 0;
+		int64_t lateFrames = 0;
+		int64_t audioUnderruns = 0;
+	};
+
+	enum class AudioPath {
+		//the decoder output is the output format, copied as it is
+		AUDIO_PASSTHROUGH,
+		//same rate, swr only repacks, converts samples or remixes
+		AUDIO_CONVERT,
+		AUDIO_RESAMPLE
+	};
+
+	struct DriftStats {
+		//seconds measured, catch-up, pauses and underruns are left out
+		int64_t seconds = 0;
+		//audible audio minus the video clock, mean of the last second and
+		//the largest after the first settle seconds
+		std::chrono::microseconds offset = std::chrono::microseconds(0);
+		std::chrono::microseconds offsetMax = std::chrono::microseconds(0);
+		//how much faster the audio output runs than the system clock, and
+		//how much the resampler stretches the audio against it
+		double driftPpm = 0.0;
+		double correctionPpm = 0.0;
+	};
+
+	struct ScrubStats {
+		int64_t requests = 0;
+		//replaced by a newer target before readTask took them
+		int64_t coalesced = 0;
+		//decodes abandoned for a newer target
+		int64_t canceled = 0;
+		int64_t keyframesShown = 0;
+		int64_t exactShown = 0;
+		//from the target to the frame on screen
+		std::chrono::microseconds keyframeLatency = std::chrono::microseconds(0);
+		std::chrono::microseconds keyframeLatencyMax = std::chrono::microseconds(0);
+		std::chrono::microseconds exactLatency = std::chrono::microseconds(0);
+		std::chrono::microseconds exactLatencyMax = std::chrono::microseconds(0);
+	};
+
+	enum class LoopMode {
+		LOOP_NONE,
+		//first pass, decoding from the file into the cache
+		LOOP_FILL,
+		//replay converted frames and samples from the cache
+		LOOP_FRAMES,
+		//replay by decoding the cached packets
+		LOOP_PACKETS,
+		//nothing fits the cache, seek back on every pass
+		LOOP_SEEK
+	};
+
 private:
 	std::mutex lock;
 	ThreadStatus readStatus = ThreadStatus::THREAD_NONE;
 	ScreenStatus status = ScreenStatus::SCREEN_STATUS_NONE;
 	//time in ms
 	int threadInterval = 1;
-	int threadCount = 0;
+	//number of running task chains on the shared pool, guarded by taskLock
+	int taskCount = 0;
+	std::mutex taskLock;
+	std::condition_variable taskCV;
+	//canceled on close, stops the task chains and blocking FFmpeg I/O
+	NemoThreadPool::CancelToken cancelToken;
+	std::chrono::microseconds closeLatency = std::chrono::microseconds(0);
+	std::chrono::microseconds openLatency = std::chrono::microseconds(0);
 	int videoWidth = 0;
 	int videoHeight = 0;
+	//negotiated with the output on open, samples are always float
 	int audioSampleRate = 48000;
 	int audioChannels = 0;
 	AVSampleFormat audioFromat = AVSampleFormat::AV_SAMPLE_FMT_FLT;
+	//how audioTask gets the decoder output into that format. a stretch
+	//for catch-up or drift moves it to the resampler until the next open
+	std::atomic<AudioPath> audioPath{ AudioPath::AUDIO_RESAMPLE };
 	//time offset from beginning of media file.
 	std::chrono::microseconds timeOffset;
 	//startTimeStamp will be set with current time
 	// when the player start playing or resume playing
 	std::chrono::steady_clock::time_point startTimeStamp;
+	//time source of the media clock and the frame schedule
+	PlaybackClock* clock = PlaybackClock::steady();
+	//media time per wall time, above 1.0 while catching up a live stream
+	std::atomic<double> playbackSpeed{ 1.0 };
+	//swr_ctx has a compensation applied, audioLock held
+	bool compensating = false;
 	AVHWDeviceType deviceType = AVHWDeviceType::AV_HWDEVICE_TYPE_NONE;
 	AVFormatContext* formatContext = nullptr;
 	AVCodecContext* videoCodecContext = nullptr;
 	AVCodecContext* audioCodecContext = nullptr;
 	AVPacket* packet = nullptr;
 	AVFrame* frame = nullptr;
-	SwsContext* sws_ctx = nullptr;
+	//audio packets readTask has read, decoded by audioTask. audioLock is
+	//held for a whole decode, readTask takes it to seek, loop, scrub or
+	//switch the audio track. the list itself is guarded by audioQueueLock
+	std::mutex audioLock;
+	std::mutex audioQueueLock;
+	std::list<AVPacket*> audioPacketList;
+	//audioTask only
+	AVFrame* audioFrame = nullptr;
+	//readTask stops reading while this many audio packets wait
+	static const size_t audioQueueLimit = 16;
+	AVRational videoTimeBase = { 0, 1 };
+	AVRational audioTimeBase = { 0, 1 };
+	//for frames without pkt_duration, from the guessed frame rate
+	std::chrono::microseconds videoFrameDuration = std::chrono::microseconds(0);
+	//conversion contexts by source size and format, readTask only.
+	//kept across files, a switch back to a known format costs nothing
+	ScalerCache scalers;
+	//optional deinterlace, denoise and crop stage between decodeVideo
+	//and the conversion, filterTask drains it
+	VideoFilter videoFilter;
+	//filterTask only
+	ScalerCache filterScalers{ 2 };
 	SwrContext* swr_ctx = nullptr;
 	QAudioFormat* audioFormat = nullptr;
 	NemoAudioDevice* audioDevice = nullptr;
-	QAudioSink* audioSink;
+	AudioOutput* audioOutput = nullptr;
+	//chosen by setAudioOutput, a headless widget plays qt on the null output
+	AudioOutput::Backend audioBackend = AudioOutput::Backend::BACKEND_QT;
+	std::string audioOutputPath;
+	//output latency target in ms, 0 keeps the backend default
+	int audioLatencyTarget = 0;
+	//readTask stops decoding audio-only input above this many buffered bytes
+	std::atomic<qint64> audioWatermark{ 0 };
+	//audio written to the sink but not played yet, sampled by latencyTimer
+	std::atomic<int64_t> audioLatencyUs{ 0 };
+	QTimer* latencyTimer = nullptr;
+	//no window and no audio device: frames are dropped after the probe
+	//sees them and the audio goes to a timer driven output
+	bool headless = false;
+	SyncProbe* syncProbe = nullptr;
+	//peak/RMS meters and spectrum, fed by audioTask, analyzed by meterTask
+	//and drawn over the video by paintGL
+	AudioMeter audioMeter;
+	std::atomic<bool> meterEnabled{ false };
+	//decoded or converted frames for other processes, off by default
+	FrameServer frameServer;
+	std::atomic<int64_t> presentedFrames{ 0 };
+	std::atomic<int64_t> lateFrames{ 0 };
 	int videoPreload = 60;
 	std::mutex videoLock;
 	std::list<VideoData> videoFrameList;
 	
 	int videoStreamIndex = -1;
 	int audioStreamIndex = -1;
+	//streams the track menu offers, listed at open under lock. a reconnect
+	//replaces formatContext on demuxTask, the GUI thread must not read it
+	std::vector<TrackInfo> trackList;
+	//local file, stream info comes from and goes to the ProbeCache
+	QString filePath;
+	bool cacheProbe = false;
+
+	//network input: demuxTask fills the jitter buffer, readTask decodes from it
+	bool streaming = false;
+	bool liveStream = false;
+	std::chrono::microseconds mediaDuration = std::chrono::microseconds(0);
+	QString streamPath;
+	AVPacket* demuxPacket = nullptr;
+	JitterBuffer jitterBuffer;
+	JitterBuffer::Preset streamPreset = JitterBuffer::Preset::PRESET_SMOOTH;
+	int reconnectCount = 0;
+	std::atomic<int64_t> reconnects{ 0 };
+
+	//seek and loop requests, guarded by lock and applied by readTask
+	bool seekPending = false;
+	std::chrono::microseconds seekTarget = std::chrono::microseconds(0);
+	bool loopPending = false;
+	std::chrono::microseconds loopRequestA = std::chrono::microseconds(0);
+	std::chrono::microseconds loopRequestB = std::chrono::microseconds(0);
+	//stream indexes to switch to, -1 for none
+	int videoTrackRequest = -1;
+	int audioTrackRequest = -1;
+	//scrub requests. only the newest target is kept, a new one bumps
+	//scrubSerial, which also stops the decode of an older target
+	bool scrubbing = false;
+	bool scrubEnding = false;
+	//playing when the scrub began, resumed at the end
+	bool scrubResume = false;
+	//readTask has seen the newest target
+	bool scrubTaken = true;
+	std::chrono::microseconds scrubTarget = std::chrono::microseconds(0);
+	std::chrono::steady_clock::time_point scrubRequestTime;
+	std::atomic<uint64_t> scrubSerial{ 0 };
+	ScrubStats scrubStats;
+	//decoded output before this time is dropped after a seek
+	std::chrono::microseconds skipUntil = std::chrono::microseconds(0);
+	//dts of the latest packet per stream, and the packets already read
+	//before a reconnect or a track switch rewound the demuxer.
+	//demuxTask while streaming, readTask otherwise
+	std::vector<int64_t> lastStreamDts;
+	std::vector<int64_t> resumeDts;
+
+	//A-B loop state, changed by readTask under audioLock. audioTask reads
+	//it and sets audioDone and end under the same lock
+	struct Loop {
+		LoopMode mode = LoopMode::LOOP_NONE;
+		std::chrono::microseconds a = std::chrono::microseconds(0);
+		std::chrono::microseconds b = std::chrono::microseconds(0);
+		//added to output timestamps, grows by b - a on every pass
+		//so the media clock runs on across the wraparound
+		std::chrono::microseconds offset = std::chrono::microseconds(0);
+		//end of the latest output, shortens b when the file ends first
+		std::chrono::microseconds end = std::chrono::microseconds(0);
+		bool videoDone = false;
+		bool audioDone = false;
+		size_t videoCursor = 0;
+		size_t audioCursor = 0;
+		size_t packetCursor = 0;
+		int64_t passes = 0;
+	} loop;
+	LoopCache loopCache;
+	size_t loopCacheBudget = (size_t)512 << 20;
+
+	//contexts of the previous file, reused by m_openFile when the next file matches
+	struct Recycled {
+		AVCodecContext* videoCodecContext = nullptr;
+		AVCodecContext* audioCodecContext = nullptr;
+		SwrContext* swr_ctx = nullptr;
+		QAudioFormat* audioFormat = nullptr;
+		NemoAudioDevice* audioDevice = nullptr;
+		AudioOutput* audioOutput = nullptr;
+	} recycled;
 	
-	GLuint VBO = 0;
-	GLuint VAO = 0;
-	GLuint EBO = 0;
-	std::string vsCode, fsCode;
-	GLuint program = 0;
-	GLuint texture = 0;
-
-	float vertices[20] = {
-			 1.0f,  1.0f, 0.0f, 1.0f, 0.0f,   // right-top
-			 1.0f, -1.0f, 0.0f, 1.0f, 1.0f,   // right-bottom
-			-1.0f, -1.0f, 0.0f, 0.0f, 1.0f,   // left-bottom
-			-1.0f,  1.0f, 0.0f,  0.0f, 0.0f    // left-top
-	};
+	//vsync estimate from frameSwapped and the cadence of presented frames
+	FramePacer framePacer;
+	//a new frame was uploaded since the last swap, GUI thread only
+	bool framePending = false;
+	//retime playback so frames last whole refreshes, audio is resampled
+	std::atomic<bool> rateMatching{ false };
+	double rateMatchTolerance = 0.005;
+	//cheaper conversion and decoding while frames are late
+	QualityGovernor governor;
+	//level set on videoCodecContext, readTask only
+	int appliedQuality = -1;
+	void m_applyQuality(void);
+	//the latest clip export, runs on its own demuxer. GUI thread
+	std::shared_ptr<ClipExporter> exporter;
 
-	unsigned int indices[6] = { 
-		0, 1, 3,	//first
-		1, 2, 3	//second
-	};
+	//the audio output and the system clock drift apart by a few ppm. the
+	//offset of the audible audio to the video clock is measured on the
+	//GUI thread, a PI controller turns it into a stretch of the resampler
+	//output that audioTask applies. stays across files, the output does.
+	std::atomic<bool> driftCompensation{ true };
+	//simulated error of the timer outputs' clock in ppm
+	double audioSkew = 0.0;
+	//output samples added per sample, read by audioTask
+	std::atomic<double> driftCorrection{ 0.0 };
+	//media time just after the last sample written to audioDevice, GUI thread
+	std::chrono::microseconds audioWrittenEnd = std::chrono::microseconds(0);
+	bool audioWritten = false;
+	struct Drift {
+		//offsets sampled in the current window
+		int64_t sum = 0;
+		int count = 0;
+		std::chrono::steady_clock::time_point windowStart;
+		int64_t underruns = 0;
+		//mean of the previous window, for the drift estimate
+		bool hasLast = false;
+		double lastOffset = 0.0;
+		double integral = 0.0;
+	} drift;
+	DriftStats driftStats;
+	//1 s windows, 1 ms of offset is gone in about 10 s, corrections stay
+	//far below an audible pitch change
+	static constexpr double driftResponse = 10.0;
+	static constexpr double driftIntegral = 60.0;
+	static constexpr double driftMaxCorrection = 0.001;
+	static constexpr int driftSettle = 10;
+	//an offset below this is left alone until the first correction, so
+	//an output that keeps time never leaves the passthrough path
+	static constexpr double driftDeadband = 0.001;
+	void measureDrift(void);
+	void resetDriftWindow(void);
+
+	//the window's own output lives as long as the widget, videoOutput
+	//points to it or to an offscreen or null output owned here
+	WidgetVideoOutput screenOutput{ this };
+	VideoOutput* videoOutput = &screenOutput;
+	//chosen by setVideoOutput, a headless widget presents widget to null
+	VideoOutput::Backend videoBackend = VideoOutput::Backend::BACKEND_WIDGET;
+	int offscreenWidth = 0;
+	int offscreenHeight = 0;
 
 private:
-	int openCodexContext(AVCodecContext** pCC, AVFormatContext* pFC, int index);
 	int m_openFile(const QString& path);
 	int m_openFileHW(const QString& path);
 	void clearOnOpen(void);
-	void clearOnClose(void);
-	void initShaderScript(void);
-	bool createProgram(void);
+	void clearOnClose(bool recycle = false);
+	void releaseRecycled(void);
+	//audioFormat and audioDevice must exist. creates the selected output
+	//suspended, falls back to null when the file cannot be written
+	void openAudioOutput(void);
+	void startAudioOutput(void);
+	void closeAudioOutput(void);
+	AudioOutput::Backend effectiveAudioBackend(void) const;
+	//replaces videoOutput with the selected one, null when it has no GL
+	void openVideoOutput(void);
+	void closeVideoOutput(void);
+	//message box, or only the log when headless
+	void showError(const char* msg);
+	static bool canRecycle(AVCodecContext* pCC, AVCodecParameters* par);
+	static int interruptCallback(void* opaque);
+	static bool isStreamUrl(const QString& path);
+	static void setStreamOptions(AVDictionary** opt, const QString& path, JitterBuffer::Preset p);
+	int reconnectStream(void);
+	//unselected streams are skipped by the demuxer
+	void applyDiscard(AVFormatContext* fc);
+
+	//scrub state, readTask only. keyframe timestamps are in the video
+	//time base, AV_NOPTS_VALUE when the demuxer index does not know them
+	struct Scrub {
+		bool active = false;
+		//target on screen, as a keyframe until exact
+		uint64_t serial = 0;
+		bool targeted = false;
+		bool exact = true;
+		std::chrono::microseconds target = std::chrono::microseconds(0);
+		std::chrono::steady_clock::time_point requested;
+		//keyframe the decoder started from and the GOP on screen
+		int64_t decoderKey = AV_NOPTS_VALUE;
+		int64_t shownKey = AV_NOPTS_VALUE;
+		//last frame out of the decoder
+		std::chrono::microseconds decoded = std::chrono::microseconds(-1);
+	} scrub;
+	//the last frame before the target, shown when the file ends first
+	AVFrame* scrubFrame = nullptr;
+	//the cursor rests this long before the exact frame is decoded
+	std::chrono::milliseconds scrubRest = std::chrono::milliseconds(120);
+
+	//readTask only
+	int m_seek(std::chrono::microseconds pos);
+	//one readTask step while scrubbing
+	void m_scrubStep(std::chrono::microseconds* wait);
+	//keyframe nearest to the target, or the exact frame. 0 when shown,
+	//AVERROR(EAGAIN) when a newer target came in
+	int m_scrubShow(bool exact);
+	//decodes video only, leaves the first frame covering target (or the
+	//first frame at all when first) in frame. 1 with a frame, 0 at the end
+	int m_scrubDecode(std::chrono::microseconds target, bool first);
+	int64_t m_keyframe(int64_t ts, bool nearest);
+	void m_setLoop(std::chrono::microseconds a, std::chrono::microseconds b);
+	void m_wrapLoop(void);
+	//swaps the decoder of one stream type at the playback position
+	int m_selectTrack(int index);
+	static std::vector<TrackInfo> listTracks(AVFormatContext* fc);
+	//false for packets already read before the last rewind
+	bool m_takePacket(const AVPacket* pkt);
+	//false for video output before a seek target or outside the loop
+	bool m_videoWindow(std::chrono::microseconds pts);
 
+	//position of the playback clock in media time
+	std::chrono::microseconds mediaClock(void);
+	std::chrono::microseconds m_mediaClock(void);
+	void setPlaybackSpeed(double speed);
+	void skipClock(std::chrono::microseconds t);
+	//copy for the meters, never blocks
+	void tapAudio(const uint8_t* data, int size, std::chrono::microseconds pts);
+	//to the frame server when it serves RGB24, never blocks
+	void serveFrame(const VideoData& data);
+
+	//one step of a task chain. returns 1 and the delay before the next
+	//step in wait, or 0 when the chain is finished.
+	typedef int (*StepFunc)(ScreenWidget* screen, std::chrono::microseconds* wait);
+	static void postTask(ScreenWidget* screen, NemoThreadPool::Priority p,
+		StepFunc step, std::chrono::microseconds delay);
+
+	//read packets from a network source into the jitter buffer
+	static int demuxTask(ScreenWidget* screen, std::chrono::microseconds* wait);
 	//read frame from file.
-	static int readThread(ScreenWidget* screen);
+	static int readTask(ScreenWidget* screen, std::chrono::microseconds* wait);
 	static int decodeVideo(ScreenWidget* screen);
-	static int decodeAudio(ScreenWidget* screen);
+	//hands the audio packet to audioTask
+	static int queueAudio(ScreenWidget* screen);
+	//decodes queued audio packets into the sink, at audio priority so the
+	//feed does not wait behind video decode for the CPU
+	static int audioTask(ScreenWidget* screen, std::chrono::microseconds* wait);
+	static int m_decodeAudio(ScreenWidget* screen, AVPacket* pkt);
+	//frees the queued audio packets, audioLock held
+	void m_dropAudio(void);
+	//sets the resampler's input to a frame whose format changed, 0 when it takes it
+	int m_matchResampler(const AVFrame* frame);
+	//to rgb24 for the texture, divided in size by divisor.
+	//data->pts is only used for the trace
+	static int convertFrame(ScalerCache* scalers, const AVFrame* frame, VideoData* data, int divisor = 1);
+	//runs queued frames through videoFilter and queues the result for display
+	static int filterTask(ScreenWidget* screen, std::chrono::microseconds* wait);
+	//meter analysis, follows the media clock
+	static int meterTask(ScreenWidget* screen, std::chrono::microseconds* wait);
+	//one step of the A-B loop, replaces the plain read while a loop is set
+	static int m_loopFunc(ScreenWidget* screen, std::chrono::microseconds* wait);
 
-	//video display thread
-	static int videoThread(ScreenWidget* screen);
+	//video display task
+	static int videoTask(ScreenWidget* screen, std::chrono::microseconds* wait);
 	static int m_videoFunc(ScreenWidget* screen, std::chrono::microseconds* time);
 	
 protected:
@@ -124,31 +490,108 @@ public:
 	explicit ScreenWidget(QWidget* parent);
 	~ScreenWidget();
 
+	static int openCodexContext(AVCodecContext** pCC, AVFormatContext* pFC, int index);
 	static std::chrono::milliseconds ts_to_millisecond(int64_t ts, AVRational time_base);
 	static std::chrono::milliseconds ts_to_millisecond(int64_t ts, int num, int den);
 	static std::chrono::microseconds ts_to_microsecond(int64_t ts, AVRational time_base);
 	static std::chrono::microseconds ts_to_microsecond(int64_t ts, int num, int den);
 
+	//before the first openFile
+	void setHeadless(bool on);
+	void setSyncProbe(SyncProbe* probe) { syncProbe = probe; }
+	//a virtual clock runs as fast as the pipeline, headless only
+	void setClock(PlaybackClock* c) { clock = c; }
+	//the null and file outputs play this many ppm fast, from the next open
+	void setAudioSkew(double ppm) { audioSkew = ppm; }
+
+	PlaybackStats playbackStats(void);
+	ScrubStats scrubStatistics(void);
+	//GUI thread
+	DriftStats driftStatistics(void) const { return driftStats; }
+	//measured seconds before offsetMax counts
+	static int driftSettleSeconds(void) { return driftSettle; }
+	QualityGovernor::Stats qualityStats(void) const { return governor.stats(); }
+	AudioPath audioConversion(void) const { return audioPath; }
+	static const char* audioPathName(AudioPath p);
+	//the cheapest way from the decoder to the output format
+	static AudioPath chooseAudioPath(const AVCodecContext* cc, int outRate, int outChannels,
+		AVSampleFormat outFormat);
+	//0 for live input
+	std::chrono::microseconds duration(void) const { return mediaDuration; }
+	//audio and video streams of the open file, GUI thread
+	std::vector<TrackInfo> tracks(void);
+
+	//network input: the packet queue and how often demuxTask reopened the url
+	JitterBuffer::Stats jitterStatistics(void) { return jitterBuffer.stats(); }
+	int64_t reconnections(void) const { return reconnects; }
+
+	//the latest clip export, 0 to 1
+	double exportProgress(void) const { return exporter ? exporter->progress() : 0.0; }
+	ClipExporter::Stats exportStatistics(void) const {
+		return exporter ? exporter->stats() : ClipExporter::Stats();
+	}
+
+	//effective output latency of the audio sink
+	std::chrono::microseconds audioLatency(void) const {
+		return std::chrono::microseconds(audioLatencyUs.load());
+	}
+
 signals:
 	void drawVideoFrame(VideoData data);
-	void writeAudioData(void* data, int size);
+	//end is the media time just after the data, negative when unknown
+	void writeAudioData(void* data, int size, qint64 end);
 	void updateScreen(void);
 	void changeScreenStatus(ScreenStatus s);
 	void endOfFile(void);
+	void flushAudio(void);
+	//error is negative when the export failed or was canceled
+	void exportFinished(QString path, int error);
 
 private slots:
 	void setScreenStatus(ScreenStatus s);
 	void onDrawFrame(VideoData data);
-	void onWriteAudioData(void* data, int size);
+	void onWriteAudioData(void* data, int size, qint64 end);
 	void onUpdateScreen(void);
+	void onFlushAudio(void);
+	void onSampleAudioLatency(void);
+	void onFrameSwapped(void);
 
 public slots:
 	void openFile(QString path);
 	void closeFile(void);
 	void setHWDeviceType(AVHWDeviceType type);
+	void setStreamPreset(JitterBuffer::Preset p);
+	void setRateMatching(bool on);
+	void setDriftCompensation(bool on);
+	void setAdaptiveQuality(bool on);
+	//libavfilter chain, empty to disable. applies without reopening
+	void setVideoFilter(QString chain);
+	void setAudioMeters(bool on);
+	//shared memory name, empty to stop. native serves the decoder output
+	void setFrameServer(QString name, bool native);
+	//0 restores the backend default
+	void setAudioLatency(int ms);
+	//AudioOutput::parse spec, switches the open file's output in place
+	void setAudioOutput(QString spec);
+	//VideoOutput::parse spec, applies from the next frame
+	void setVideoOutput(QString spec);
 	void test(bool checked);
 	void play(void);
 	void pause(void);
 	void clearScreen(void);
+	//positions in ms
+	void seek(qint64 pos);
+	//slider drag: begin pauses, every target replaces the previous one,
+	//end decodes the exact frame and resumes playback if it was playing
+	void beginScrub(void);
+	void scrubTo(qint64 pos);
+	void endScrub(void);
+	void setLoop(qint64 a, qint64 b);
+	void clearLoop(void);
+	//copies a to b in ms of the playing tracks into path without
+	//transcoding. exact encodes the frames before the first keyframe again
+	void exportClip(QString path, qint64 a, qint64 b, bool exact);
+	//stream index from tracks(), switches its type at the current position
+	void selectTrack(int index);
 	void onEndOfFile(void);
 };
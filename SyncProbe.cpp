@@ -0,0 +1,109 @@
+#include "SyncProbe.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+SyncProbe::SyncProbe()
+{
+	origin = chrono::steady_clock::now();
+}
+
+int64_t SyncProbe::toUs(std::chrono::steady_clock::time_point t) const
+{
+	return chrono::duration_cast<chrono::microseconds>(t - origin).count();
+}
+
+void SyncProbe::onPresent(int64_t pts, const uint8_t* rgb, int linesize, int width, int height)
+{
+	int64_t wall = toUs(chrono::steady_clock::now());
+
+	//the flash is a full white frame, the center pixel is enough
+	bool flash = false;
+	if (rgb && width > 0 && height > 0) {
+		flash = rgb[(height / 2) * linesize + (width / 2) * 3] > 128;
+	}
+
+	lock_guard<mutex> guard(lock);
+	presentList.push_back({ wall, pts });
+	if (flash && !flashOn) {
+		flashList.push_back(wall);
+	}
+	flashOn = flash;
+}
+
+void SyncProbe::onClick(std::chrono::steady_clock::time_point t)
+{
+	lock_guard<mutex> guard(lock);
+	clickList.push_back(toUs(t));
+}
+
+SyncProbe::Report SyncProbe::report(std::chrono::microseconds frameInterval)
+{
+	lock_guard<mutex> guard(lock);
+	Report ret;
+
+	//pair every flash with the nearest click, both repeat once per second
+	vector<int64_t> offsetList;
+	for (auto flash : flashList) {
+		int64_t best = INT64_MAX;
+		for (auto click : clickList) {
+			if (abs(flash - click) < abs(best)) {
+				best = flash - click;
+			}
+		}
+		if (abs(best) < 500000) {
+			offsetList.push_back(best);
+		}
+	}
+
+	ret.pairs = (int)offsetList.size();
+	if (offsetList.size()) {
+		int64_t sum = 0;
+		for (auto o : offsetList) {
+			sum += o;
+		}
+		ret.offsetMean = sum / (int64_t)offsetList.size();
+
+		sort(offsetList.begin(), offsetList.end());
+		ret.offsetMin = offsetList.front();
+		ret.offsetMax = offsetList.back();
+		ret.offsetMedian = offsetList[offsetList.size() / 2];
+
+		vector<int64_t> absList;
+		for (auto o : offsetList) {
+			absList.push_back(abs(o));
+		}
+		sort(absList.begin(), absList.end());
+		ret.offsetP95 = absList[min(absList.size() - 1, absList.size() * 95 / 100)];
+	}
+
+	//frame accounting from the presented pts sequence
+	ret.presentedFrames = (int64_t)presentList.size();
+	int64_t interval = frameInterval.count();
+	double sum = 0.0, sum2 = 0.0;
+	int64_t count = 0;
+	for (size_t i = 1; i < presentList.size(); i++) {
+		auto dpts = presentList[i].pts - presentList[i - 1].pts;
+		if (dpts == 0) {
+			ret.duplicatedFrames++;
+		}
+		else if (interval > 0 && dpts > interval * 3 / 2) {
+			ret.skippedFrames += (dpts + interval / 2) / interval - 1;
+		}
+
+		double d = (double)(presentList[i].wall - presentList[i - 1].wall);
+		sum += d;
+		sum2 += d * d;
+		count++;
+		ret.intervalMaxError = max(ret.intervalMaxError, abs((int64_t)d - interval));
+	}
+	if (count) {
+		double mean = sum / count;
+		ret.intervalMean = (int64_t)mean;
+		ret.intervalStdDev = (int64_t)sqrt(max(0.0, sum2 / count - mean * mean));
+	}
+
+	return ret;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+//measures A/V sync and frame pacing on a test clip with a white flash
+//frame and an audio click at the same media time.
+//the render path reports every presented frame and the loopback audio
+//sink reports when each click becomes audible, report() pairs flashes
+//with clicks and checks the presented timestamps.
+class SyncProbe final
+{
+public:
+	struct Report {
+		int pairs = 0;
+		//flash minus click in us, positive when video is late
+		int64_t offsetMin = 0;
+		int64_t offsetMax = 0;
+		int64_t offsetMean = 0;
+		int64_t offsetMedian = 0;
+		int64_t offsetP95 = 0;
+		int64_t presentedFrames = 0;
+		int64_t duplicatedFrames = 0;
+		int64_t skippedFrames = 0;
+		//wall time between presents against the nominal frame interval
+		int64_t intervalMean = 0;
+		int64_t intervalStdDev = 0;
+		int64_t intervalMaxError = 0;
+	};
+
+private:
+	struct Present {
+		int64_t wall;
+		int64_t pts;
+	};
+
+	std::mutex lock;
+	std::chrono::steady_clock::time_point origin;
+	std::vector<Present> presentList;
+	std::vector<int64_t> flashList;
+	std::vector<int64_t> clickList;
+	bool flashOn = false;
+
+	int64_t toUs(std::chrono::steady_clock::time_point t) const;
+
+public:
+	SyncProbe();
+	SyncProbe(const SyncProbe&) = delete;
+	SyncProbe& operator=(const SyncProbe&) = delete;
+
+	//GUI thread, rgb is the packed RGB24 frame being uploaded
+	void onPresent(int64_t pts, const uint8_t* rgb, int linesize, int width, int height);
+	//audio thread, t is when the first loud sample leaves the sink
+	void onClick(std::chrono::steady_clock::time_point t);
+
+	Report report(std::chrono::microseconds frameInterval);
+};
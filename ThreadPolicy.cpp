@@ -0,0 +1,260 @@
+#include "ThreadPolicy.h"
+#include <cerrno>
+#include <cstdlib>
+#include <QDebug>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+//role and cpu mask the calling thread runs with, -1 before the first apply
+static thread_local int currentRole = -1;
+static thread_local uint64_t currentMask = 0;
+
+#ifdef _WIN32
+//thread priorities inside the normal priority class, no privilege needed
+static const int roleLevels[NemoThreadPool::priorityCount] = {
+	THREAD_PRIORITY_TIME_CRITICAL,
+	THREAD_PRIORITY_HIGHEST,
+	THREAD_PRIORITY_NORMAL,
+	THREAD_PRIORITY_LOWEST
+};
+#else
+//nice values, raising needs CAP_SYS_NICE or RLIMIT_NICE
+static const int roleLevels[NemoThreadPool::priorityCount] = { -10, -5, 0, 10 };
+#endif
+
+int ThreadPolicy::setThreadLevel(int level)
+{
+#ifdef _WIN32
+	return SetThreadPriority(GetCurrentThread(), level) ? 0 : -1;
+#elif defined(__linux__)
+	//nice is per thread on linux
+	return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), level);
+#else
+	return level == 0 ? 0 : -1;
+#endif
+}
+
+int ThreadPolicy::setThreadAffinity(uint64_t mask)
+{
+	if (mask == 0) {
+		return 0;
+	}
+#ifdef _WIN32
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) ? 0 : -1;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < 64; i++) {
+		if (mask & ((uint64_t)1 << i)) {
+			CPU_SET(i, &set);
+		}
+	}
+	return sched_setaffinity(0, sizeof(set), &set);
+#else
+	return -1;
+#endif
+}
+
+std::string ThreadPolicy::levelName(int level)
+{
+#ifdef _WIN32
+	switch (level) {
+	case THREAD_PRIORITY_TIME_CRITICAL:
+		return "time critical";
+	case THREAD_PRIORITY_HIGHEST:
+		return "highest";
+	case THREAD_PRIORITY_ABOVE_NORMAL:
+		return "above normal";
+	case THREAD_PRIORITY_NORMAL:
+		return "normal";
+	case THREAD_PRIORITY_BELOW_NORMAL:
+		return "below normal";
+	case THREAD_PRIORITY_LOWEST:
+		return "lowest";
+	case THREAD_PRIORITY_IDLE:
+		return "idle";
+	default:
+		return to_string(level);
+	}
+#else
+	return "nice " + to_string(level);
+#endif
+}
+
+ThreadPolicy::ThreadPolicy()
+{
+	for (int i = 0; i < NemoThreadPool::priorityCount; i++) {
+		roles[i].level = roleLevels[i];
+	}
+
+#ifdef _WIN32
+	DWORD_PTR processMask = 0, systemMask = 0;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+		processAffinity = processMask;
+	}
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (int i = 0; i < 64; i++) {
+			if (CPU_ISSET(i, &set)) {
+				processAffinity |= (uint64_t)1 << i;
+			}
+		}
+	}
+
+	//probe on this thread whether a lowered nice value can be raised again
+	id_t tid = (id_t)syscall(SYS_gettid);
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, tid);
+	if (errno == 0 && setpriority(PRIO_PROCESS, tid, nice - 1) == 0) {
+		setpriority(PRIO_PROCESS, tid, nice);
+	}
+	else {
+		canRaise = false;
+	}
+#endif
+}
+
+ThreadPolicy* ThreadPolicy::instance(void)
+{
+	static ThreadPolicy policy;
+	return &policy;
+}
+
+const char* ThreadPolicy::roleName(Role r)
+{
+	static const char* names[NemoThreadPool::priorityCount] = {
+		"audio", "presentation", "decode", "background"
+	};
+	int i = (int)r;
+	return i >= 0 && i < NemoThreadPool::priorityCount ? names[i] : "unknown";
+}
+
+void ThreadPolicy::setEnabled(bool on)
+{
+	enabled = on;
+}
+
+void ThreadPolicy::setAffinity(Role r, uint64_t mask)
+{
+	//picked up by the next switch into the role
+	roles[(int)r].affinity = mask;
+}
+
+bool ThreadPolicy::parseAffinity(const std::string& spec)
+{
+	size_t begin = 0;
+	while (begin < spec.size()) {
+		size_t end = spec.find(',', begin);
+		if (end == string::npos) {
+			end = spec.size();
+		}
+		string item = spec.substr(begin, end - begin);
+		begin = end + 1;
+
+		size_t eq = item.find('=');
+		if (eq == string::npos) {
+			return false;
+		}
+		string name = item.substr(0, eq);
+		char* tail = nullptr;
+		uint64_t mask = strtoull(item.c_str() + eq + 1, &tail, 16);
+		if (!tail || *tail != '\0') {
+			return false;
+		}
+
+		int i = 0;
+		while (i < NemoThreadPool::priorityCount && name != roleName((Role)i)) {
+			i++;
+		}
+		if (i == NemoThreadPool::priorityCount) {
+			return false;
+		}
+		setAffinity((Role)i, mask);
+	}
+	return true;
+}
+
+void ThreadPolicy::apply(Role r)
+{
+	int i = (int)r;
+	if (!enabled || i < 0 || i >= NemoThreadPool::priorityCount || currentRole == i) {
+		return;
+	}
+	auto& role = roles[i];
+	uint64_t mask = role.affinity;
+
+	if (!role.tried) {
+		//the first thread in a role finds the level the OS accepts,
+		//stepping towards normal
+		lock_guard<mutex> guard(lock);
+		if (!role.tried) {
+			int level = role.level;
+			if (level > 0 && !canRaise) {
+				//the worker could not serve a higher role afterwards
+				level = 0;
+			}
+			while (setThreadLevel(level) < 0 && level != 0) {
+				level += level > 0 ? -1 : 1;
+			}
+			role.appliedLevel = level;
+			role.tried = true;
+			qDebug("thread policy: %s requested %s, applied %s", roleName(r),
+				levelName(role.level).c_str(), levelName(level).c_str());
+		}
+		else if (setThreadLevel(role.appliedLevel) < 0) {
+			role.failures++;
+		}
+	}
+	else if (setThreadLevel(role.appliedLevel) < 0) {
+		role.failures++;
+	}
+
+	if (mask != currentMask) {
+		//a role without a mask goes back to the whole process
+		if (setThreadAffinity(mask ? mask : processAffinity) < 0) {
+			role.failures++;
+		}
+		currentMask = mask;
+	}
+
+	currentRole = i;
+	role.switches++;
+}
+
+std::vector<ThreadPolicy::RoleReport> ThreadPolicy::report(void)
+{
+	vector<RoleReport> list;
+	lock_guard<mutex> guard(lock);
+	for (int i = 0; i < NemoThreadPool::priorityCount; i++) {
+		auto& role = roles[i];
+		RoleReport r;
+		r.name = roleName((Role)i);
+		r.requested = levelName(role.level);
+		if (!enabled) {
+			r.applied = "disabled";
+		}
+		else if (role.tried) {
+			r.applied = levelName(role.appliedLevel);
+		}
+		else {
+			r.applied = "not used yet";
+		}
+		r.affinity = role.affinity;
+		r.switches = role.switches;
+		r.failures = role.failures;
+		list.push_back(r);
+	}
+	return list;
+}
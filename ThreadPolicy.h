@@ -0,0 +1,76 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "NemoThreadPool.h"
+
+//OS scheduling of the playback threads by role.
+//the roles are the pool priority classes: audio feed highest, then
+//presentation, decode at normal and background jobs lowest. pool workers
+//take the role of every task they run, the change costs one system call
+//and only happens when the class differs from the previous task.
+//a level the process may not use falls back towards normal, the report
+//tells what was actually applied.
+class ThreadPolicy final
+{
+public:
+	typedef NemoThreadPool::Priority Role;
+
+	struct RoleReport {
+		std::string name;
+		//what was asked for and what the OS accepted
+		std::string requested;
+		std::string applied;
+		uint64_t affinity = 0;
+		int64_t switches = 0;
+		int64_t failures = 0;
+	};
+
+private:
+	struct RoleState {
+		int level = 0;
+		//cpu mask, 0 leaves the affinity alone
+		std::atomic<uint64_t> affinity{ 0 };
+		//level the OS accepted, written under lock before tried is set
+		int appliedLevel = 0;
+		std::atomic<bool> tried{ false };
+		std::atomic<int64_t> switches{ 0 };
+		std::atomic<int64_t> failures{ 0 };
+	};
+
+	std::mutex lock;
+	std::atomic<bool> enabled{ true };
+	RoleState roles[NemoThreadPool::priorityCount];
+	//affinity of the process, restored for roles without a mask
+	uint64_t processAffinity = 0;
+	//unprivileged POSIX threads cannot lower their nice value again,
+	//so nothing is lowered that a later task would have to raise
+	bool canRaise = true;
+
+	ThreadPolicy();
+	//calling thread, 0 on success
+	static int setThreadLevel(int level);
+	static int setThreadAffinity(uint64_t mask);
+	static std::string levelName(int level);
+
+public:
+	ThreadPolicy(const ThreadPolicy&) = delete;
+	ThreadPolicy& operator=(const ThreadPolicy&) = delete;
+
+	static ThreadPolicy* instance(void);
+	static const char* roleName(Role r);
+
+	//off leaves every thread at the default priority
+	void setEnabled(bool on);
+	bool isEnabled(void) const { return enabled; }
+	void setAffinity(Role r, uint64_t mask);
+	//"audio=1,background=c", masks in hex. false on a syntax error
+	bool parseAffinity(const std::string& spec);
+
+	//role of the calling thread, a no-op when it already has it
+	void apply(Role r);
+
+	std::vector<RoleReport> report(void);
+};
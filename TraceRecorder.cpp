@@ -0,0 +1,176 @@
+#include "TraceRecorder.h"
+#include <fstream>
+#include <ctime>
+#include "NemoThreadPool.h"
+
+using namespace std;
+
+static thread_local void* currentBuffer = nullptr;
+
+TraceRecorder::Scope::Scope(const char* eventName, int64_t eventPts)
+{
+	auto recorder = TraceRecorder::instance();
+	name = recorder->isEnabled() ? eventName : nullptr;
+	begin = name ? recorder->now() : 0;
+	pts = eventPts;
+}
+
+TraceRecorder::Scope::~Scope()
+{
+	if (name) {
+		auto recorder = TraceRecorder::instance();
+		recorder->record(name, 'X', begin, recorder->now() - begin, pts, 0);
+	}
+}
+
+TraceRecorder::TraceRecorder()
+{
+	origin = chrono::steady_clock::now();
+}
+
+TraceRecorder* TraceRecorder::instance(void)
+{
+	static TraceRecorder recorder;
+	return &recorder;
+}
+
+int64_t TraceRecorder::now(void) const
+{
+	return chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now() - origin).count();
+}
+
+TraceRecorder::ThreadBuffer* TraceRecorder::threadBuffer(void)
+{
+	if (currentBuffer) {
+		return (ThreadBuffer*)currentBuffer;
+	}
+
+	//once per thread
+	auto buffer = make_unique<ThreadBuffer>();
+
+	lock_guard<mutex> guard(bufferLock);
+	buffer->tid = (int)bufferList.size() + 1;
+	buffer->name = "thread " + to_string(buffer->tid);
+	currentBuffer = buffer.get();
+	bufferList.push_back(std::move(buffer));
+	return (ThreadBuffer*)currentBuffer;
+}
+
+void TraceRecorder::setThreadName(const std::string& name)
+{
+	auto buffer = threadBuffer();
+	lock_guard<mutex> guard(bufferLock);
+	buffer->name = name;
+}
+
+void TraceRecorder::record(const char* name, char phase, int64_t ts, int64_t duration,
+	int64_t pts, int64_t value)
+{
+	auto buffer = threadBuffer();
+	uint64_t head = buffer->head.load(memory_order_relaxed);
+	if (!buffer->ring) {
+		buffer->ring = make_unique<Event[]>(ringSize);
+	}
+
+	auto& e = buffer->ring[head % ringSize];
+	e.name.store(name, memory_order_relaxed);
+	e.ts.store(ts, memory_order_relaxed);
+	e.duration.store(duration, memory_order_relaxed);
+	e.pts.store(pts, memory_order_relaxed);
+	e.value.store(value, memory_order_relaxed);
+	e.phase.store(phase, memory_order_relaxed);
+
+	buffer->head.store(head + 1, memory_order_release);
+}
+
+void TraceRecorder::instant(const char* name, int64_t pts)
+{
+	if (isEnabled()) {
+		record(name, 'i', now(), 0, pts, 0);
+	}
+}
+
+void TraceRecorder::counter(const char* name, int64_t value)
+{
+	if (isEnabled()) {
+		record(name, 'C', now(), 0, noPts, value);
+	}
+}
+
+int TraceRecorder::dump(const std::string& path)
+{
+	ofstream out(path, ios::out | ios::trunc);
+	if (!out) {
+		return -1;
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+	bool first = true;
+
+	lock_guard<mutex> guard(bufferLock);
+	for (auto& buffer : bufferList) {
+		out << (first ? "" : ",\n")
+			<< "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+			<< ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+		first = false;
+
+		//the writer may be overwriting the oldest slots while we copy,
+		//leave an eighth of the ring as a margin
+		uint64_t head = buffer->head.load(memory_order_acquire);
+		if (head == 0) {
+			continue;
+		}
+		uint64_t count = min(head, ringSize - ringSize / 8);
+		for (uint64_t i = head - count; i < head; i++) {
+			auto& e = buffer->ring[i % ringSize];
+			auto name = e.name.load(memory_order_relaxed);
+			auto phase = e.phase.load(memory_order_relaxed);
+			auto pts = e.pts.load(memory_order_relaxed);
+			if (!name) {
+				continue;
+			}
+
+			out << ",\n{\"ph\":\"" << phase << "\",\"name\":\"" << name
+				<< "\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"ts\":" << e.ts.load(memory_order_relaxed);
+			if (phase == 'X') {
+				out << ",\"dur\":" << e.duration.load(memory_order_relaxed);
+			}
+			else if (phase == 'i') {
+				out << ",\"s\":\"t\"";
+			}
+
+			if (phase == 'C') {
+				out << ",\"args\":{\"value\":" << e.value.load(memory_order_relaxed) << "}";
+			}
+			else if (pts != noPts) {
+				out << ",\"args\":{\"pts_us\":" << pts << "}";
+			}
+			out << "}";
+		}
+	}
+
+	out << "\n]}" << endl;
+	return out.good() ? 0 : -1;
+}
+
+void TraceRecorder::stall(const char* reason)
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	int64_t t = now();
+	int64_t last = lastStallDump;
+	if (t - last < stallInterval.count() ||
+		!lastStallDump.compare_exchange_strong(last, t)) {
+		return;
+	}
+	instant(reason);
+
+	string path = stallPath + "-" + to_string((long long)time(nullptr)) + ".json";
+	NemoThreadPool::instance()->post(NemoThreadPool::Priority::PRIORITY_BACKGROUND, [this, path]() {
+		dump(path);
+	});
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//timeline recorder for the playback pipeline, dumped as Chrome Trace
+//JSON (chrome://tracing, ui.perfetto.dev).
+//every thread writes into its own ring of the latest events without
+//locks or allocations, a disabled recorder costs one atomic load per
+//scope. dumps copy the rings while the threads keep writing.
+class TraceRecorder final
+{
+public:
+	//no media timestamp
+	static constexpr int64_t noPts = INT64_MIN;
+
+	//records [construction, destruction) as one complete event.
+	//event names are stored by pointer, pass string literals.
+	class Scope {
+	private:
+		const char* name;
+		int64_t begin;
+		int64_t pts;
+
+	public:
+		explicit Scope(const char* eventName, int64_t eventPts = noPts);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		//for pts only known at the end, like a decoded frame
+		void setPts(int64_t eventPts) { pts = eventPts; }
+	};
+
+private:
+	//relaxed atomics, plain stores on x86. a slot copied while it is
+	//overwritten may come out mixed but never undefined.
+	struct Event {
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<int64_t> ts{ 0 };
+		std::atomic<int64_t> duration{ 0 };
+		std::atomic<int64_t> pts{ 0 };
+		std::atomic<int64_t> value{ 0 };
+		//'X' complete, 'i' instant, 'C' counter
+		std::atomic<char> phase{ 0 };
+	};
+
+	//written by its thread only, head is published after each event.
+	//the ring is allocated with the first event.
+	struct ThreadBuffer {
+		std::string name;
+		int tid = 0;
+		std::unique_ptr<Event[]> ring;
+		std::atomic<uint64_t> head{ 0 };
+	};
+
+	static constexpr uint64_t ringSize = 8192;
+
+	std::atomic<bool> enabled{ false };
+	std::chrono::steady_clock::time_point origin;
+	std::mutex bufferLock;
+	std::vector<std::unique_ptr<ThreadBuffer>> bufferList;
+
+	std::atomic<int64_t> lastStallDump{ INT64_MIN / 2 };
+	std::chrono::microseconds stallInterval = std::chrono::seconds(30);
+	const std::string stallPath = "nemo-trace";
+
+	TraceRecorder();
+	ThreadBuffer* threadBuffer(void);
+	void record(const char* name, char phase, int64_t ts, int64_t duration,
+		int64_t pts, int64_t value);
+
+public:
+	TraceRecorder(const TraceRecorder&) = delete;
+	TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+	static TraceRecorder* instance(void);
+
+	void setEnabled(bool enable) { enabled = enable; }
+	bool isEnabled(void) const { return enabled.load(std::memory_order_relaxed); }
+	//microseconds since the recorder was created
+	int64_t now(void) const;
+	//shown as the track name, the pool names its workers
+	void setThreadName(const std::string& name);
+
+	void instant(const char* name, int64_t pts = noPts);
+	void counter(const char* name, int64_t value);
+
+	//write every ring to path, 0 on success
+	int dump(const std::string& path);
+	//dump to <stallPath>-<time>.json on a background task, at most once
+	//per stallInterval so a stuck pipeline does not flood the disk
+	void stall(const char* reason);
+};
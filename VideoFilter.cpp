@@ -0,0 +1,432 @@
+#include "VideoFilter.h"
+#include <cstring>
+
+using namespace std;
+
+static const AVRational usTimeBase = { 1, 1000000 };
+
+bool VideoFilter::Input::operator==(const Input& in) const
+{
+	return width == in.width && height == in.height && format == in.format &&
+		av_cmp_q(sar, in.sar) == 0;
+}
+
+VideoFilter::~VideoFilter()
+{
+	reset();
+}
+
+vector<QString> VideoFilter::split(const QString& chain)
+{
+	//top level commas only, not the escaped or quoted ones of arguments
+	vector<QString> list;
+	QString cur;
+	bool quoted = false;
+	for (int i = 0; i < chain.size(); i++) {
+		QChar c = chain[i];
+		if (c == '\\' && i + 1 < chain.size()) {
+			cur += c;
+			cur += chain[++i];
+			continue;
+		}
+		if (c == '\'') {
+			quoted = !quoted;
+		}
+		if (c == ',' && !quoted) {
+			if (cur.trimmed().size()) {
+				list.push_back(cur.trimmed());
+			}
+			cur.clear();
+			continue;
+		}
+		cur += c;
+	}
+	if (cur.trimmed().size()) {
+		list.push_back(cur.trimmed());
+	}
+	return list;
+}
+
+int VideoFilter::build(Stage* stage, const AVFrame* frame, AVRational rate, int threads)
+{
+	stage->graph = avfilter_graph_alloc();
+	if (!stage->graph) {
+		return AVERROR(ENOMEM);
+	}
+	//yadif, bwdif, hqdn3d and scale all split their work into slices
+	stage->graph->nb_threads = threads;
+	stage->graph->thread_type = AVFILTER_THREAD_SLICE;
+
+	//every stage takes pts in us
+	char args[256] = { 0 };
+	int sarNum = frame->sample_aspect_ratio.num;
+	int sarDen = frame->sample_aspect_ratio.den;
+	snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+		frame->width, frame->height, frame->format, usTimeBase.num, usTimeBase.den,
+		sarNum > 0 ? sarNum : 1, sarDen > 0 ? sarDen : 1);
+	if (rate.num > 0 && rate.den > 0) {
+		size_t n = strlen(args);
+		snprintf(args + n, sizeof(args) - n, ":frame_rate=%d/%d", rate.num, rate.den);
+	}
+
+	int ret = avfilter_graph_create_filter(&stage->src, avfilter_get_by_name("buffer"),
+		"in", args, NULL, stage->graph);
+	if (ret >= 0) {
+		ret = avfilter_graph_create_filter(&stage->sink, avfilter_get_by_name("buffersink"),
+			"out", NULL, NULL, stage->graph);
+	}
+
+	AVFilterInOut* outputs = avfilter_inout_alloc();
+	AVFilterInOut* inputs = avfilter_inout_alloc();
+	if (ret >= 0 && (!outputs || !inputs)) {
+		ret = AVERROR(ENOMEM);
+	}
+	if (ret >= 0) {
+		outputs->name = av_strdup("in");
+		outputs->filter_ctx = stage->src;
+		outputs->pad_idx = 0;
+		outputs->next = NULL;
+		inputs->name = av_strdup("out");
+		inputs->filter_ctx = stage->sink;
+		inputs->pad_idx = 0;
+		inputs->next = NULL;
+		ret = avfilter_graph_parse_ptr(stage->graph, stage->spec.toUtf8().constData(),
+			&inputs, &outputs, NULL);
+	}
+	if (ret >= 0) {
+		ret = avfilter_graph_config(stage->graph, NULL);
+	}
+	avfilter_inout_free(&inputs);
+	avfilter_inout_free(&outputs);
+
+	if (ret < 0) {
+		avfilter_graph_free(&stage->graph);
+		stage->src = nullptr;
+		stage->sink = nullptr;
+	}
+	return ret;
+}
+
+void VideoFilter::release(void)
+{
+	for (auto& s : stageList) {
+		avfilter_graph_free(&s.graph);
+	}
+	stageList.clear();
+}
+
+void VideoFilter::setChain(const QString& spec)
+{
+	lock_guard<mutex> guard(lock);
+	chain = spec.trimmed();
+	resetPending = true;
+}
+
+QString VideoFilter::currentChain(void)
+{
+	lock_guard<mutex> guard(lock);
+	return chain;
+}
+
+bool VideoFilter::enabled(void)
+{
+	lock_guard<mutex> guard(lock);
+	return chain.size() > 0;
+}
+
+void VideoFilter::setThreads(int n)
+{
+	lock_guard<mutex> guard(lock);
+	threads = max(0, n);
+	resetPending = true;
+}
+
+void VideoFilter::setFrameRate(AVRational rate)
+{
+	lock_guard<mutex> guard(lock);
+	frameRate = rate;
+	resetPending = true;
+}
+
+bool VideoFilter::push(AVFrame* frame)
+{
+	AVFrame* f = av_frame_alloc();
+	if (!f) {
+		return false;
+	}
+	av_frame_move_ref(f, frame);
+
+	lock_guard<mutex> guard(lock);
+	bool room = queue.size() < capacity;
+	if (!room) {
+		//the newest frames are closest to the playback clock
+		av_frame_free(&queue.front());
+		queue.pop_front();
+		droppedCount++;
+	}
+	queue.push_back(f);
+	queuedCount++;
+	hasInput = true;
+	return room;
+}
+
+void VideoFilter::finish(void)
+{
+	lock_guard<mutex> guard(lock);
+	if (hasInput) {
+		hasInput = false;
+		endPending = true;
+	}
+}
+
+void VideoFilter::flush(void)
+{
+	lock_guard<mutex> guard(lock);
+	for (auto f : queue) {
+		av_frame_free(&f);
+	}
+	queue.clear();
+	generation++;
+	endPending = false;
+	//yadif and hqdn3d hold frames from before the seek
+	resetPending = true;
+}
+
+void VideoFilter::reset(void)
+{
+	flush();
+	release();
+	input = Input();
+	failed = false;
+}
+
+AVFrame* VideoFilter::take(uint64_t* gen)
+{
+	lock_guard<mutex> guard(lock);
+	if (queue.empty()) {
+		return nullptr;
+	}
+	AVFrame* f = queue.front();
+	queue.pop_front();
+	*gen = generation;
+	return f;
+}
+
+bool VideoFilter::takeEnd(uint64_t* gen)
+{
+	lock_guard<mutex> guard(lock);
+	if (!queue.empty() || !endPending) {
+		return false;
+	}
+	endPending = false;
+	*gen = generation;
+	return true;
+}
+
+bool VideoFilter::current(uint64_t gen)
+{
+	lock_guard<mutex> guard(lock);
+	return gen == generation;
+}
+
+int VideoFilter::process(AVFrame* frame, uint64_t gen, vector<AVFrame*>* out)
+{
+	lock.lock();
+	if (gen != generation) {
+		//queued before a flush, the reset is for the frames after it
+		lock.unlock();
+		return 0;
+	}
+	bool rebuild = resetPending;
+	QString spec = chain;
+	AVRational rate = frameRate;
+	int n = threads;
+	resetPending = false;
+	lock.unlock();
+
+	Input in;
+	in.width = frame->width;
+	in.height = frame->height;
+	in.format = frame->format;
+	in.sar = frame->sample_aspect_ratio;
+	if (rebuild || !(in == input)) {
+		release();
+		input = in;
+		failed = false;
+		for (auto& s : split(spec)) {
+			Stage stage;
+			stage.spec = s;
+			stage.stats.name = s.section('=', 0, 0);
+			stageList.push_back(stage);
+		}
+		lock.lock();
+		rebuildCount++;
+		lock.unlock();
+	}
+
+	if (failed || stageList.empty()) {
+		AVFrame* f = av_frame_clone(frame);
+		if (f) {
+			out->push_back(f);
+		}
+		return 0;
+	}
+
+	int ret = 0;
+	vector<AVFrame*> pending;
+	vector<AVFrame*> next;
+	pending.push_back(av_frame_clone(frame));
+	for (size_t i = 0; i < stageList.size() && ret >= 0; i++) {
+		auto& stage = stageList[i];
+		for (auto& f : pending) {
+			if (!f) {
+				ret = AVERROR(ENOMEM);
+				break;
+			}
+			if (!stage.graph && (ret = build(&stage, f, rate, n)) < 0) {
+				qDebug("video filter %s cannot be built: %d", stage.spec.toUtf8().constData(), ret);
+				break;
+			}
+
+			auto t0 = chrono::steady_clock::now();
+			ret = av_buffersrc_add_frame(stage.src, f);
+			av_frame_free(&f);
+			if (ret >= 0) {
+				receive(&stage, &next);
+			}
+			stage.stats.time += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0);
+			stage.stats.frames++;
+			if (ret < 0) {
+				break;
+			}
+		}
+
+		for (auto& f : pending) {
+			av_frame_free(&f);
+		}
+		pending.clear();
+		pending.swap(next);
+		if (stage.sink) {
+			//field rate deinterlacing doubles it for the next stage
+			rate = av_buffersink_get_frame_rate(stage.sink);
+			if (rate.num > 0 && rate.den > 0) {
+				for (auto f : pending) {
+					f->pkt_duration = av_rescale_q(1, av_inv_q(rate), usTimeBase);
+				}
+			}
+		}
+	}
+
+	if (ret < 0) {
+		//show the video unfiltered rather than nothing
+		for (auto& f : pending) {
+			av_frame_free(&f);
+		}
+		pending.clear();
+		release();
+		failed = true;
+		AVFrame* f = av_frame_clone(frame);
+		if (f) {
+			pending.push_back(f);
+		}
+	}
+	out->insert(out->end(), pending.begin(), pending.end());
+
+	lock.lock();
+	outputCount += pending.size();
+	lastStats.clear();
+	for (auto& s : stageList) {
+		lastStats.push_back(s.stats);
+	}
+	lock.unlock();
+	return ret;
+}
+
+void VideoFilter::receive(Stage* stage, vector<AVFrame*>* out)
+{
+	while (true) {
+		AVFrame* o = av_frame_alloc();
+		if (!o || av_buffersink_get_frame(stage->sink, o) < 0) {
+			av_frame_free(&o);
+			break;
+		}
+		if (o->pts != AV_NOPTS_VALUE) {
+			o->pts = av_rescale_q(o->pts, av_buffersink_get_time_base(stage->sink), usTimeBase);
+		}
+		out->push_back(o);
+	}
+}
+
+int VideoFilter::drain(uint64_t gen, vector<AVFrame*>* out)
+{
+	lock.lock();
+	bool stale = gen != generation || resetPending;
+	AVRational rate = frameRate;
+	int n = threads;
+	lock.unlock();
+	if (stale || failed || stageList.empty()) {
+		return 0;
+	}
+
+	//what a stage gives up at its end goes through the later ones first
+	int ret = 0;
+	vector<AVFrame*> pending;
+	for (auto& stage : stageList) {
+		vector<AVFrame*> next;
+		auto t0 = chrono::steady_clock::now();
+		for (auto& f : pending) {
+			if (ret >= 0 && !stage.graph) {
+				ret = build(&stage, f, rate, n);
+			}
+			if (ret >= 0) {
+				ret = av_buffersrc_add_frame(stage.src, f);
+			}
+			av_frame_free(&f);
+			if (ret >= 0) {
+				receive(&stage, &next);
+			}
+		}
+		if (ret >= 0 && stage.graph && (ret = av_buffersrc_add_frame(stage.src, nullptr)) >= 0) {
+			receive(&stage, &next);
+		}
+		stage.stats.time += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0);
+		pending.swap(next);
+		if (ret < 0) {
+			break;
+		}
+	}
+	if (ret < 0) {
+		qDebug("video filter drain failed: %d", ret);
+		for (auto& f : pending) {
+			av_frame_free(&f);
+		}
+		pending.clear();
+	}
+	out->insert(out->end(), pending.begin(), pending.end());
+
+	//the graphs are at their end, a loop or seek needs new ones
+	release();
+	input = Input();
+	lock.lock();
+	outputCount += pending.size();
+	lock.unlock();
+	return ret;
+}
+
+size_t VideoFilter::depth(void)
+{
+	lock_guard<mutex> guard(lock);
+	return queue.size();
+}
+
+VideoFilter::Stats VideoFilter::stats(void)
+{
+	lock_guard<mutex> guard(lock);
+	Stats s;
+	s.queued = queuedCount;
+	s.dropped = droppedCount;
+	s.output = outputCount;
+	s.rebuilds = rebuildCount;
+	s.filters = lastStats;
+	return s;
+}
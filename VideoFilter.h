@@ -0,0 +1,125 @@
+#pragma once
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <QString>
+#include "FFmpegHeader.h"
+
+//optional libavfilter stage between decoding and conversion.
+//the decoder side queues frames and returns at once, a worker filters
+//them. the queue is short and drops its oldest frame when full, so a
+//slow chain loses video frames instead of holding up audio decoding.
+//every filter of the chain gets its own graph to be timed separately,
+//the graphs use slice threading and are rebuilt by the worker when the
+//chain or the input changes.
+class VideoFilter final
+{
+public:
+	struct FilterStats {
+		QString name;
+		int64_t frames = 0;
+		std::chrono::microseconds time = std::chrono::microseconds(0);
+	};
+
+	struct Stats {
+		int64_t queued = 0;
+		int64_t dropped = 0;
+		int64_t output = 0;
+		int64_t rebuilds = 0;
+		std::vector<FilterStats> filters;
+	};
+
+private:
+	struct Stage {
+		QString spec;
+		AVFilterGraph* graph = nullptr;
+		AVFilterContext* src = nullptr;
+		AVFilterContext* sink = nullptr;
+		FilterStats stats;
+	};
+
+	struct Input {
+		int width = 0;
+		int height = 0;
+		int format = -1;
+		AVRational sar = { 0, 1 };
+		bool operator==(const Input& in) const;
+	};
+
+	//guards everything shared with the decoder side
+	std::mutex lock;
+	QString chain;
+	bool resetPending = false;
+	std::deque<AVFrame*> queue;
+	//frames were pushed since the last end of stream
+	bool hasInput = false;
+	//end of stream behind the queued frames
+	bool endPending = false;
+	size_t capacity = 8;
+	int threads = 0;
+	AVRational frameRate = { 0, 1 };
+	//bumped by flush, output of older frames is stale
+	uint64_t generation = 0;
+	int64_t queuedCount = 0;
+	int64_t droppedCount = 0;
+	int64_t outputCount = 0;
+	int64_t rebuildCount = 0;
+	std::vector<FilterStats> lastStats;
+
+	//worker only
+	std::vector<Stage> stageList;
+	Input input;
+	bool failed = false;
+
+	static std::vector<QString> split(const QString& chain);
+	//lazily on the first frame a stage sees, rate is its input frame rate
+	static int build(Stage* stage, const AVFrame* frame, AVRational rate, int threads);
+	//takes every frame the stage's sink has ready, pts in us
+	static void receive(Stage* stage, std::vector<AVFrame*>* out);
+	void release(void);
+
+public:
+	VideoFilter() = default;
+	~VideoFilter();
+	VideoFilter(const VideoFilter&) = delete;
+	VideoFilter& operator=(const VideoFilter&) = delete;
+
+	//filtergraph syntax, e.g. "bwdif,hqdn3d,crop=iw-16:ih-16".
+	//empty turns the stage off, takes effect on the next frame
+	void setChain(const QString& spec);
+	QString currentChain(void);
+	bool enabled(void);
+	//slice threads per filter, 0 for one per core
+	void setThreads(int n);
+	//input frame rate, field rate deinterlacers double it
+	void setFrameRate(AVRational rate);
+
+	//decoder side: takes the frame's references, pts in us.
+	//false when the oldest queued frame was dropped to make room
+	bool push(AVFrame* frame);
+	//end of the input, the frames the filters still hold are drained
+	//after the queued ones. no-op when nothing was pushed since the last
+	void finish(void);
+	//after a seek, drops queued frames and the state of the filters
+	void flush(void);
+	//closing the file, keeps the chain
+	void reset(void);
+
+	//worker side: next queued frame or nullptr, the caller frees it
+	AVFrame* take(uint64_t* gen);
+	//runs one frame through the chain, outputs are appended with pts
+	//and pkt_duration in us. the caller frees them. a chain that fails
+	//to build passes frames through unfiltered
+	int process(AVFrame* frame, uint64_t gen, std::vector<AVFrame*>* out);
+	//true once when the queue is empty and finish() was called
+	bool takeEnd(uint64_t* gen);
+	//sends the end of stream through the chain and appends the frames the
+	//filters held back, like process. the graphs are rebuilt on the next frame
+	int drain(uint64_t gen, std::vector<AVFrame*>* out);
+	bool current(uint64_t gen);
+
+	size_t depth(void);
+	Stats stats(void);
+};
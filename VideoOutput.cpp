@@ -0,0 +1,85 @@
+#include "VideoOutput.h"
+#include <algorithm>
+#include <QString>
+#include <QStringList>
+#include "OffscreenVideoOutput.h"
+#include "NullVideoOutput.h"
+
+using namespace std;
+
+void VideoOutput::addUpload(std::chrono::microseconds t)
+{
+	st.uploadTime += t;
+	st.uploadMax = max(st.uploadMax, t);
+}
+
+void VideoOutput::addRender(std::chrono::microseconds t)
+{
+	st.renders++;
+	st.renderTime += t;
+	st.renderMax = max(st.renderMax, t);
+}
+
+const char* VideoOutput::backendName(Backend b)
+{
+	switch (b) {
+	case Backend::BACKEND_WIDGET:
+		return "widget";
+	case Backend::BACKEND_OFFSCREEN:
+		return "offscreen";
+	case Backend::BACKEND_NULL:
+		return "null";
+	}
+	return "?";
+}
+
+bool VideoOutput::parse(const std::string& spec, Backend* b, int* width, int* height)
+{
+	*width = 0;
+	*height = 0;
+	if (spec == "widget") {
+		*b = Backend::BACKEND_WIDGET;
+		return true;
+	}
+	if (spec == "null") {
+		*b = Backend::BACKEND_NULL;
+		return true;
+	}
+	if (spec == "offscreen") {
+		*b = Backend::BACKEND_OFFSCREEN;
+		return true;
+	}
+
+	//offscreen:WxH
+	const string prefix = "offscreen:";
+	if (spec.compare(0, prefix.size(), prefix) != 0) {
+		return false;
+	}
+	QStringList size = QString::fromStdString(spec.substr(prefix.size())).split('x');
+	bool wOk = false, hOk = false;
+	int w = size.size() == 2 ? size[0].toInt(&wOk) : 0;
+	int h = size.size() == 2 ? size[1].toInt(&hOk) : 0;
+	if (!wOk || !hOk || w <= 0 || h <= 0) {
+		return false;
+	}
+	*b = Backend::BACKEND_OFFSCREEN;
+	*width = w;
+	*height = h;
+	return true;
+}
+
+VideoOutput* VideoOutput::create(Backend b, int width, int height)
+{
+	if (b == Backend::BACKEND_NULL) {
+		return new NullVideoOutput;
+	}
+	if (b == Backend::BACKEND_OFFSCREEN) {
+		auto out = new OffscreenVideoOutput(width, height);
+		if (out->create() < 0) {
+			delete out;
+			return nullptr;
+		}
+		return out;
+	}
+	return nullptr;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include "AudioMeter.h"
+
+class QOpenGLWidget;
+
+//where ScreenWidget presents its frames.
+//the frame schedule, the sync probe and the frame pacer stay in
+//ScreenWidget, an output only receives the RGB24 frames at their
+//presentation time. widget draws into the visible window, offscreen
+//draws the same way into a framebuffer of its own GL context and waits
+//for the GPU, null only records when each frame was presented.
+//GUI thread only.
+class VideoOutput
+{
+public:
+	enum class Backend {
+		BACKEND_WIDGET,
+		BACKEND_OFFSCREEN,
+		BACKEND_NULL
+	};
+
+	struct Frame {
+		int64_t pts = 0;
+		//playback clock at presentation
+		std::chrono::steady_clock::time_point presentTime;
+		//packed RGB24, only valid during present
+		const uint8_t* data = nullptr;
+		int width = 0;
+		int height = 0;
+		//nullptr without the meter overlay
+		const AudioMeter::Levels* meters = nullptr;
+	};
+
+	struct Stats {
+		int64_t frames = 0;
+		int64_t bytes = 0;
+		//texture upload, and drawing until the GPU is done where that is known
+		std::chrono::microseconds uploadTime = std::chrono::microseconds(0);
+		std::chrono::microseconds uploadMax = std::chrono::microseconds(0);
+		std::chrono::microseconds renderTime = std::chrono::microseconds(0);
+		std::chrono::microseconds renderMax = std::chrono::microseconds(0);
+		int64_t renders = 0;
+	};
+
+protected:
+	Stats st;
+	void addUpload(std::chrono::microseconds t);
+	void addRender(std::chrono::microseconds t);
+
+public:
+	virtual ~VideoOutput() {}
+
+	virtual Backend backend(void) const = 0;
+	virtual void present(const Frame& f) = 0;
+	//black until the next frame
+	virtual void clear(void) = 0;
+	const Stats& stats(void) const { return st; }
+	void resetStats(void) { st = Stats(); }
+
+	static const char* backendName(Backend b);
+	//"widget", "null", "offscreen" or "offscreen:<w>x<h>", the offscreen
+	//size is 0x0 when it follows the frames. false on a syntax error
+	static bool parse(const std::string& spec, Backend* b, int* width, int* height);
+	//widget outputs belong to their widget. nullptr when there is no GL
+	static VideoOutput* create(Backend b, int width, int height);
+};
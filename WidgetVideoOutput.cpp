@@ -0,0 +1,54 @@
+#include "WidgetVideoOutput.h"
+#include <QOpenGLWidget>
+
+using namespace std;
+
+WidgetVideoOutput::~WidgetVideoOutput()
+{
+	//never initialized when headless
+	if (renderer.isReady()) {
+		widget->makeCurrent();
+		renderer.release();
+		widget->doneCurrent();
+	}
+}
+
+void WidgetVideoOutput::initialize(void)
+{
+	renderer.initialize();
+}
+
+void WidgetVideoOutput::paint(const AudioMeter::Levels* meters)
+{
+	if (!renderer.isReady()) {
+		return;
+	}
+	auto t0 = chrono::steady_clock::now();
+	renderer.paint(meters);
+	//submission only, the widget swaps and waits on its own
+	addRender(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0));
+}
+
+void WidgetVideoOutput::present(const Frame& f)
+{
+	st.frames++;
+	if (!renderer.isReady()) {
+		return;
+	}
+	auto t0 = chrono::steady_clock::now();
+	widget->makeCurrent();
+	renderer.upload(f.data, f.width, f.height);
+	addUpload(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0));
+	st.bytes += (int64_t)f.width * f.height * 3;
+	widget->update();
+}
+
+void WidgetVideoOutput::clear(void)
+{
+	if (!renderer.isReady()) {
+		return;
+	}
+	widget->makeCurrent();
+	renderer.clear();
+	widget->update();
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "VideoOutput.h"
+#include "GLRenderer.h"
+
+//the visible window. frames are uploaded into the widget's context on
+//present and drawn by its paintGL.
+class WidgetVideoOutput final : public VideoOutput
+{
+private:
+	QOpenGLWidget* widget;
+	GLRenderer renderer;
+
+public:
+	explicit WidgetVideoOutput(QOpenGLWidget* w) : widget(w) {}
+	~WidgetVideoOutput();
+	WidgetVideoOutput(const WidgetVideoOutput&) = delete;
+	WidgetVideoOutput& operator=(const WidgetVideoOutput&) = delete;
+
+	//initializeGL of the widget
+	void initialize(void);
+	//paintGL of the widget
+	void paint(const AudioMeter::Levels* meters);
+
+	Backend backend(void) const override { return Backend::BACKEND_WIDGET; }
+	void present(const Frame& f) override;
+	void clear(void) override;
+};
@@ -1,10 +1,116 @@
 #include "NemoPlayer.h"
+#include "NemoBench.h"
+#include "TraceRecorder.h"
+#include "ThreadPolicy.h"
+#include "NemoThreadPool.h"
+#include "AudioOutput.h"
+#include "VideoOutput.h"
 #include <QtWidgets/QApplication>
+#include <cstring>
 
 int main(int argc, char *argv[])
 {
+    //thread policy and output options go with every mode
+    const char* audioOutput = nullptr;
+    const char* videoOutput = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-thread-policy") == 0) {
+            ThreadPolicy::instance()->setEnabled(false);
+        }
+        else if (strcmp(argv[i], "--affinity") == 0 && i + 1 < argc) {
+            //e.g. audio=1,presentation=2,background=c
+            if (!ThreadPolicy::instance()->parseAffinity(argv[++i])) {
+                fprintf(stderr, "invalid affinity: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            //pool workers, clamped to the core count
+            int threads = atoi(argv[++i]);
+            if (threads <= 0) {
+                fprintf(stderr, "invalid thread count: %s\n", argv[i]);
+                return 1;
+            }
+            NemoThreadPool::instance()->setThreadBudget(threads);
+        }
+        else if (strcmp(argv[i], "--audio-output") == 0 && i + 1 < argc) {
+            //qt, null, wav:<path> or raw:<path>
+            AudioOutput::Backend backend;
+            std::string path;
+            audioOutput = argv[++i];
+            if (!AudioOutput::parse(audioOutput, &backend, &path)) {
+                fprintf(stderr, "invalid audio output: %s\n", audioOutput);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--video-output") == 0 && i + 1 < argc) {
+            //widget, null, offscreen or offscreen:<w>x<h>
+            VideoOutput::Backend backend;
+            int width = 0, height = 0;
+            videoOutput = argv[++i];
+            if (!VideoOutput::parse(videoOutput, &backend, &width, &height)) {
+                fprintf(stderr, "invalid video output: %s\n", videoOutput);
+                return 1;
+            }
+        }
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-audio") == 0) {
+        return audioLatencyBench(argc > 2 ? atoi(argv[2]) : 5);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-meter") == 0) {
+        return audioMeterBench(argc > 2 ? atoi(argv[2]) : 5);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-sync") == 0) {
+        return avSyncBench(argc, argv, argc > 2 ? atoi(argv[2]) : 10);
+    }
+    if (argc > 1 && strcmp(argv[1], "--soak") == 0) {
+        return soakRun(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--frame-client") == 0) {
+        return frameClient(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-frames") == 0) {
+        return frameServerBench(argc > 2 ? atoi(argv[2]) : 3);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-render") == 0) {
+        return renderBench(argc, argv, argc > 2 ? atoi(argv[2]) : 3);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-scrub") == 0) {
+        return scrubBench(argc, argv, argc > 2 ? atoi(argv[2]) : 10);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-quality") == 0) {
+        return qualityBench(argc, argv, argc > 2 ? atoi(argv[2]) : 10);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-stream") == 0) {
+        return streamBench(argc, argv, argc > 2 ? atoi(argv[2]) : 15);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-export") == 0) {
+        return exportBench(argc, argv, argc > 2 ? atoi(argv[2]) : 10);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-probe") == 0) {
+        return probeCacheBench(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--scan") == 0) {
+        return libraryScan(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-scan") == 0) {
+        return libraryScanBench(argc, argv, argc > 2 ? atoi(argv[2]) : 500);
+    }
+
+    //record from startup, stalls are dumped to the working directory
+    if (argc > 1 && strcmp(argv[1], "--trace") == 0) {
+        TraceRecorder::instance()->setEnabled(true);
+    }
+
     QApplication a(argc, argv);
     NemoPlayer w;
+    if (audioOutput) {
+        w.setAudioOutput(audioOutput);
+    }
+    if (videoOutput) {
+        w.setVideoOutput(videoOutput);
+    }
     w.show();
     return a.exec();
 }